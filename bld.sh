@@ -3,12 +3,44 @@
 
 . ./lbm.sh
 
-rm -f jtr_null jtr_sock jtr_ss jtr_src
+rm -f jtr_null jtr_sock jtr_ss jtr_src jtr_rcv jtr_ipc jtr_shm jtr_probe jtr_top jtr_detour jtr_tscskew jtr_query jtr_preflight jtr_alloc jtr_syscall jtr_wake jtr_lock
+rm -f jtr.o libjtr.a libjtr.so
+
+# libjtr: jtr.c as a library, for the probe API in applications.
+gcc -g -Wall -pedantic -std=gnu99 -fPIC -c -o jtr.o jtr.c
+ar rcs libjtr.a jtr.o
+gcc -shared -o libjtr.so jtr.o -lm -lpthread -lrt
 
 gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_null jtr.c jtr_null.c
 
 gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_sock jtr.c jtr_sock.c
 
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_rcv jtr.c jtr_rcv.c
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_ipc jtr.c jtr_ipc.c
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_shm jtr.c jtr_shm.c
+
+gcc -g -Wall -pedantic -std=gnu99 -o jtr_probe jtr_probe.c libjtr.a -lm -lpthread -lrt
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_top jtr.c jtr_top.c
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_detour jtr.c jtr_detour.c
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_tscskew jtr.c jtr_tscskew.c
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_query jtr.c jtr_query.c
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_preflight jtr.c jtr_preflight.c
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_alloc jtr.c jtr_alloc.c
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_syscall jtr.c jtr_syscall.c
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_wake jtr.c jtr_wake.c
+
+gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -lm -lpthread -lrt -o jtr_lock jtr.c jtr_lock.c
+
 gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -llbm -lm -lpthread -lrt -o jtr_ss jtr.c jtr_ss.c
 
 gcc -g -Wall -pedantic -std=gnu99 -I$LBM_INCLUDE -L$LBM_PLATFORM/lib -llbm -lm -lpthread -lrt -o jtr_src jtr.c jtr_src.c
@@ -28,17 +28,25 @@
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/utsname.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <linux/perf_event.h>
 #include "jtr.h"
 
-long long sum_a1;
-long long sum_a2;
-long long sum_a3;
-long long sum_a4;
-long long sum_hooks;
 int jtr_neg_diffs;
 
 /* Time the host takes to do various things. Start them at maximum value;
@@ -48,6 +56,8 @@ long long jtr_gettime_cost = 0x7fffffffffffffff;
 long long jtr_rdtsc_cost = 0x7fffffffffffffff;
 long long jtr_1000_loops_cost = 0x7fffffffffffffff;
 long long jtr_ticks_per_sec = 0x7fffffffffffffff;
+long long jtr_rdpmc_cost = 0x7fffffffffffffff;  /* Timebase 3 only. */
+long long jtr_1000_loops_cycles_cost = 0x7fffffffffffffff;  /* Timebase 3. */
 
 /* Histogram, in HISTO_GRANULARITY ns increments. */
 int jtr_histo_num_buckets;
@@ -58,6 +68,21 @@ int jtr_histo_min_time;
 long long jtr_histo_tot_time;
 int jtr_histo_num_samples;
 int jtr_histo_average;
+int jtr_histo_faults_counted;  /* Set by jtr_measure_calls(). */
+int jtr_histo_from_ab;  /* Loaded by jtr_ab_histo(); no PMU or freq data. */
+int jtr_histo_runs = 0;  /* Number of jtr_histo_init() calls. */
+volatile unsigned int jtr_histo_gen = 0;  /* Odd while being rewritten. */
+
+/* Raw RDTSC deltas, bucketed by "ticks >> jtr_tick_shift". With timebase 1,
+ * jtr_measure_one() only increments a bucket here; jtr_histo_fold() does
+ * the conversion to ns into the histogram above at report time.
+ */
+#define JTR_TICK_MAX_BUCKETS (1024 * 1024)
+int jtr_tick_num_buckets;
+int *jtr_tick_buckets = NULL;
+int jtr_tick_shift = 0;
+long jtr_histo_minflt;
+long jtr_histo_majflt;
 
 char jtr_results_buf[65536];
 char jtr_gnuplot_buf[65536];
@@ -76,6 +101,18 @@ void jtr_pin_cpu(int cpu_num)
 }  /* jtr_pin_cpu */
 
 
+/* Pin another thread, e.g. to move a helper thread between runs.
+ */
+void jtr_pin_thread(pthread_t thread_id, int cpu_num)
+{
+  cpu_set_t cpu_set;
+
+  memset(&cpu_set, 0, sizeof(cpu_set));
+  CPU_SET(cpu_num, &cpu_set);
+  SYSE(pthread_setaffinity_np(thread_id, sizeof(cpu_set), &cpu_set));
+}  /* jtr_pin_thread */
+
+
 /* Set real-time priority. Requires root.
  */
 void jtr_set_fifo_priority(int priority)
@@ -87,6 +124,103 @@ void jtr_set_fifo_priority(int priority)
   SYSE(sched_setscheduler(0, SCHED_FIFO, &sched_parameter));
 }  /* jtr_set_fifo_priority */
 
+/* Memory mode (jtr_mem_init()): 0=default, 1=mlockall and prefault,
+ * 2=also carve buffers from 2MB huge pages, 3=from 1GB huge pages.
+ */
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#define JTR_MEM_STACK_PREFAULT (256 * 1024)
+
+int jtr_mem_mode = 0;
+char *jtr_mem_arena = NULL;  /* Current huge page. */
+size_t jtr_mem_arena_size;
+size_t jtr_mem_arena_used;
+
+
+/* Touch a good chunk of stack below the caller so the measurement never
+ * grows it into new pages.
+ */
+void jtr_mem_prefault_stack(void)
+{
+  char stack_buf[JTR_MEM_STACK_PREFAULT];
+
+  memset(stack_buf, 0, sizeof(stack_buf));
+  asm volatile ("" : : "r" (stack_buf) : "memory");  /* Keep the memset. */
+}  /* jtr_mem_prefault_stack */
+
+
+/* Set the memory mode. Call from the measuring thread before allocating
+ * buffers. Modes 1-3 lock all current and future pages (requires root or
+ * a large enough RLIMIT_MEMLOCK) and turn off transparent huge pages so
+ * khugepaged can't collapse pages under a running test.
+ */
+void jtr_mem_init(int mode)
+{
+  jtr_mem_mode = mode;
+  if (mode == 0) {
+    return;
+  }
+  ASSRT(mode >= 1 && mode <= 3);
+
+  SYSE(prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0));
+  SYSE(mlockall(MCL_CURRENT | MCL_FUTURE));
+  jtr_mem_prefault_stack();
+}  /* jtr_mem_init */
+
+
+/* Allocate a buffer according to the memory mode. In modes 2 and 3 buffers
+ * are packed into huge pages; if none are reserved (see
+ * /proc/sys/vm/nr_hugepages), warns and falls back to prefaulted malloc().
+ * Buffers from huge pages are never freed.
+ */
+void *jtr_mem_alloc(size_t size)
+{
+  size_t page_size;
+  void *buf;
+
+  if (jtr_mem_mode >= 2) {
+    size = (size + 63) & ~(size_t)63;  /* Keep buffers cache-line aligned. */
+    page_size = (jtr_mem_mode == 3) ? (1ul << 30) : (2ul << 20);
+    if (jtr_mem_arena == NULL
+        || jtr_mem_arena_used + size > jtr_mem_arena_size) {
+      jtr_mem_arena_size = (size + page_size - 1) & ~(page_size - 1);
+      jtr_mem_arena = mmap(NULL, jtr_mem_arena_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB
+                           | ((jtr_mem_mode == 3) ? MAP_HUGE_1GB : MAP_HUGE_2MB),
+                           -1, 0);
+      if (jtr_mem_arena == MAP_FAILED) {
+        fprintf(stderr, "Warning, no %s huge pages: %s\n",
+                (jtr_mem_mode == 3) ? "1GB" : "2MB", strerror(errno));
+        jtr_mem_arena = NULL;
+        jtr_mem_mode = 1;
+      } else {
+        memset(jtr_mem_arena, 0, jtr_mem_arena_size);  /* Prefault. */
+        jtr_mem_arena_used = 0;
+      }
+    }
+    if (jtr_mem_arena != NULL) {
+      buf = jtr_mem_arena + jtr_mem_arena_used;
+      jtr_mem_arena_used += size;
+      return buf;
+    }
+  }
+
+  buf = malloc(size);
+  SYSE(buf == NULL);
+  if (jtr_mem_mode >= 1) {
+    memset(buf, 0, size);  /* Prefault. */
+  }
+  return buf;
+}  /* jtr_mem_alloc */
+
+
 
 /* Use busy looping to delay short periods of time.
  * Note that it can use either RDTSC or clock_gettime().
@@ -105,7 +239,7 @@ void jtr_spin_sleep_ns(long long sleep_ns, int timebase)
     return;
   }
 
-  if (likely(timebase == 1)) {
+  if (likely(timebase != 2)) {  /* Pauses are wall time, even for 3. */
     RDTSC(start_ticks_hi, start_ticks_lo);
     end_ticks = ((long long)start_ticks_hi << 32) + (long long)start_ticks_lo
       + ((sleep_ns * jtr_ticks_per_sec) / 1000000000ll);
@@ -114,7 +248,7 @@ void jtr_spin_sleep_ns(long long sleep_ns, int timebase)
       RDTSC(cur_ticks_hi, cur_ticks_lo);
       cur_ticks = ((long long)cur_ticks_hi << 32) + (long long)cur_ticks_lo;
     } while (cur_ticks < end_ticks);
-  }  /* timebase == 1 */
+  }  /* timebase != 2 */
   else {
     if (sleep_ns > 2*jtr_gettime_cost) {
       sleep_ns -= 2*jtr_gettime_cost;  /* Adjust for cost of gettime. */
@@ -235,6 +369,10 @@ void jtr_calibrate()
   if (diff_ns < jtr_1000_loops_cost) {
     jtr_1000_loops_cost = diff_ns;
   }
+
+  if (jtr_cycles_enabled) {
+    jtr_calibrate_cycles();
+  }
 }  /* jtr_calibrate */
 
 
@@ -244,8 +382,10 @@ void jtr_histo_init(int num_buckets)
 {
   int i;
 
+  __atomic_store_n(&jtr_histo_gen, jtr_histo_gen + 1, __ATOMIC_RELEASE);
+
   if (jtr_histo_buckets == NULL) {
-    jtr_histo_buckets = (int *)malloc(num_buckets * sizeof(int));
+    jtr_histo_buckets = (int *)jtr_mem_alloc(num_buckets * sizeof(int));
     jtr_histo_num_buckets = num_buckets;
   }
   else {
@@ -256,12 +396,26 @@ void jtr_histo_init(int num_buckets)
     jtr_histo_buckets[i] = 0;
   }
 
-   sum_a1 = 0;
-   sum_a2 = 0;
-   sum_a3 = 0;
-   sum_a4 = 0;
-   sum_hooks = 0;
-   jtr_neg_diffs = 0;
+  /* Size the tick histogram to cover the ns histogram (needs calibration).
+   * Shift stays 0, one bucket per tick, unless that's too many buckets.
+   */
+  if (jtr_tick_buckets == NULL && jtr_ticks_per_sec < 0x7fffffffffffffff) {
+    long long max_ticks = ((jtr_histo_num_buckets * HISTO_GRANULARITY
+                            + jtr_rdtsc_cost) * jtr_ticks_per_sec)
+                          / NANOS_PER_SEC + 1;
+    while ((max_ticks >> jtr_tick_shift) >= JTR_TICK_MAX_BUCKETS) {
+      jtr_tick_shift ++;
+    }
+    jtr_tick_num_buckets = (int)(max_ticks >> jtr_tick_shift) + 1;
+    jtr_tick_buckets = (int *)jtr_mem_alloc(jtr_tick_num_buckets * sizeof(int));
+  }
+  if (jtr_tick_buckets != NULL) {
+    for (i = 0; i < jtr_tick_num_buckets; i++) {
+      jtr_tick_buckets[i] = 0;
+    }
+  }
+
+  jtr_neg_diffs = 0;
 
   jtr_histo_overflows = 0;
   jtr_histo_min_time = 0x7fffffff;
@@ -269,6 +423,23 @@ void jtr_histo_init(int num_buckets)
   jtr_histo_tot_time = 0;
   jtr_histo_num_samples = 0;
   jtr_histo_average = 0;
+  jtr_histo_faults_counted = 0;
+  jtr_histo_from_ab = 0;
+  jtr_histo_minflt = 0;
+  jtr_histo_majflt = 0;
+
+  if (jtr_pmu_enabled) {
+    jtr_pmu_histo_init();
+  }
+  if (jtr_cycles_enabled) {
+    jtr_freq_histo_init();
+  }
+  if (jtr_pattern_len > 0) {
+    jtr_pattern_histo_init();
+  }
+  jtr_mark_histo_init();
+  jtr_histo_runs ++;
+  __atomic_store_n(&jtr_histo_gen, jtr_histo_gen + 1, __ATOMIC_RELEASE);
 }  /* jtr_histo_init */
 
 
@@ -295,10 +466,93 @@ void jtr_histo_accum(int sample_time)
 
   jtr_histo_tot_time += sample_time;
   jtr_histo_num_samples ++;
-  jtr_histo_average = jtr_histo_tot_time / (long long)jtr_histo_num_samples;
 }  /* jtr_histo_accum */
 
 
+/* Convert a raw RDTSC delta to a corrected ns sample and add it, the same
+ * way jtr_measure_one() does for the other timebases.
+ */
+void jtr_histo_accum_ticks(long long diff_ticks)
+{
+  long long diff_ns;
+
+  diff_ns = (diff_ticks * NANOS_PER_SEC) / jtr_ticks_per_sec;
+  diff_ns -= jtr_rdtsc_cost;  /* Correct for measurement cost. */
+  if (unlikely(diff_ns < 0)) {
+    jtr_neg_diffs ++;
+    diff_ns = 0;
+  }
+  jtr_histo_accum(diff_ns);
+}  /* jtr_histo_accum_ticks */
+
+
+/* Add a tick histogram ("ticks >> shift" buckets) to the ns histogram,
+ * optionally clearing it. The buckets may be updated concurrently by their
+ * owner; each one is read once.
+ */
+void jtr_histo_add_ticks(int *tick_buckets, int num_tick_buckets, int shift,
+                         int clear)
+{
+  long long diff_ticks;
+  long long diff_ns;
+  int count;
+  int bucket;
+  int i;
+
+  for (i = 0; i < num_tick_buckets; i++) {
+    count = __atomic_load_n(&tick_buckets[i], __ATOMIC_RELAXED);
+    if (count == 0) {
+      continue;
+    }
+    if (clear) {
+      tick_buckets[i] = 0;
+    }
+
+    /* With a shift, use the middle of the bucket. */
+    diff_ticks = ((long long)i << shift) + ((1ll << shift) >> 1);
+    diff_ns = (diff_ticks * NANOS_PER_SEC) / jtr_ticks_per_sec;
+    diff_ns -= jtr_rdtsc_cost;  /* Correct for measurement cost. */
+    if (diff_ns < 0) {
+      jtr_neg_diffs += count;
+      diff_ns = 0;
+    }
+
+    bucket = diff_ns / HISTO_GRANULARITY;
+    if (bucket < jtr_histo_num_buckets) {
+      jtr_histo_buckets[bucket] += count;
+    } else {
+      jtr_histo_overflows += count;
+    }
+    if (diff_ns < jtr_histo_min_time) {
+      jtr_histo_min_time = diff_ns;
+    }
+    if (diff_ns > jtr_histo_max_time) {
+      jtr_histo_max_time = diff_ns;
+    }
+    jtr_histo_tot_time += diff_ns * count;
+    jtr_histo_num_samples += count;
+  }
+}  /* jtr_histo_add_ticks */
+
+
+/* Move the tick histogram into the ns histogram and compute the average.
+ * Called before anything reads the histogram; safe to call repeatedly.
+ */
+void jtr_histo_fold(void)
+{
+  if (jtr_tick_buckets != NULL) {
+    __atomic_store_n(&jtr_histo_gen, jtr_histo_gen + 1, __ATOMIC_RELEASE);
+    jtr_histo_add_ticks(jtr_tick_buckets, jtr_tick_num_buckets,
+                        jtr_tick_shift, 1);
+    __atomic_store_n(&jtr_histo_gen, jtr_histo_gen + 1, __ATOMIC_RELEASE);
+  }
+
+  if (jtr_histo_num_samples > 0) {
+    jtr_histo_average = jtr_histo_tot_time / (long long)jtr_histo_num_samples;
+  }
+}  /* jtr_histo_fold */
+
+
 /* Print min/max/avg/overflows. (Overflow means samples beyond the histogram.)
  */
 void jtr_histo_print_summary(void)
@@ -315,25 +569,50 @@ void jtr_histo_print_summary(void)
 }  /* jtr_histo_print_summary */
 
 
-/* Print histo percentiles.
+/* Return the histogram value (ns) below which "percentile" of the samples
+ * fall, or -1 if that percentile is in the overflows.
  */
-void jtr_histo_print_perc(double percentile)
+int jtr_histo_perc_ns(double percentile)
+{
+  jtr_histo_fold();
+  return jtr_buckets_perc_ns(jtr_histo_buckets, jtr_histo_num_samples,
+                             percentile);
+}  /* jtr_histo_perc_ns */
+
+
+/* Same as jtr_histo_perc_ns(), for any array of jtr_histo_num_buckets
+ * buckets holding "num_samples" samples (including overflows).
+ */
+int jtr_buckets_perc_ns(int *buckets, int num_samples, double percentile)
 {
   int i = 0;
   int tot_at_i_or_below = 0;
   int min_count;
 
-  min_count = (int)((percentile / 100.0) * (double)jtr_histo_num_samples + 0.5);
+  min_count = (int)((percentile / 100.0) * (double)num_samples + 0.5);
   while (i < jtr_histo_num_buckets && tot_at_i_or_below < min_count) {
-    tot_at_i_or_below += jtr_histo_buckets[i];
+    tot_at_i_or_below += buckets[i];
     i++;
   }  /* while i */
   if (tot_at_i_or_below >= min_count) {
+    return i * HISTO_GRANULARITY;
+  }
+  return -1;
+}  /* jtr_buckets_perc_ns */
+
+
+/* Print histo percentiles.
+ */
+void jtr_histo_print_perc(double percentile)
+{
+  int perc_ns = jtr_histo_perc_ns(percentile);
+
+  if (perc_ns >= 0) {
     snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
              sizeof(jtr_results_buf) - strlen(jtr_results_buf),
              "%6.3lf%% are below %d ns\n",
              percentile,
-             i * HISTO_GRANULARITY);
+             perc_ns);
     SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
   } else {
     snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
@@ -346,6 +625,24 @@ void jtr_histo_print_perc(double percentile)
 }  /* jtr_histo_print_perc */
 
 
+/* Append a one-line percentile summary of the current histogram to "buf",
+ * for side-by-side comparison of several runs.
+ */
+void jtr_histo_brief(char *buf, size_t buf_size, char *label)
+{
+  jtr_histo_fold();
+  snprintf(&buf[strlen(buf)], buf_size - strlen(buf),
+           "%s: Average=%d, p90=%d, p99=%d, p99.9=%d, p99.99=%d,"
+           " p99.999=%d, Maximum=%d, Overflows=%d\n",
+           label, jtr_histo_average,
+           jtr_histo_perc_ns(90.0), jtr_histo_perc_ns(99.0),
+           jtr_histo_perc_ns(99.9), jtr_histo_perc_ns(99.99),
+           jtr_histo_perc_ns(99.999), jtr_histo_max_time,
+           jtr_histo_overflows);
+  SYSE(buf[buf_size-2] != '\0'); /* Don't fill. */
+}  /* jtr_histo_brief */
+
+
 /* Print full jitter histo to results buf.
  */
 void jtr_histo_print_details(void)
@@ -450,6 +747,7 @@ void jtr_histo_gnuplot(char *title)
  */
 void jtr_histo_print_all(int verbose, char *title)
 {
+  jtr_histo_fold();
   if (verbose > 0) {
     jtr_histo_print_details();
   }
@@ -459,98 +757,3398 @@ void jtr_histo_print_all(int verbose, char *title)
   jtr_histo_print_perc(99.9);
   jtr_histo_print_perc(99.99);
   jtr_histo_print_perc(99.999);
+  if (jtr_histo_faults_counted) {
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Page faults while measuring: minor=%ld, major=%ld\n",
+             jtr_histo_minflt, jtr_histo_majflt);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  }
+  if (jtr_pmu_enabled && ! jtr_histo_from_ab) {
+    jtr_pmu_print(verbose);
+  }
+  if (jtr_cycles_enabled && ! jtr_histo_from_ab) {
+    jtr_freq_print(verbose);
+  }
+  jtr_converge_print();
+  jtr_pattern_print();
+  jtr_mark_print();
 
   jtr_histo_gnuplot(title);
+  jtr_store_append(title);
 }  /* jtr_histo_print_all */
 
 
+/* Convert RDTSC ticks to ns. */
+long long jtr_ticks_to_ns(long long ticks)
+{
+  return (ticks * NANOS_PER_SEC) / jtr_ticks_per_sec;
+}  /* jtr_ticks_to_ns */
+
+
 /* Use the calibration results to calculate how many times to busy loop
  * to wait a desired number of ns.
  */
 int jtr_busy_loop_wait_count(long long wait_ns)
 {
+  if (jtr_cycles_enabled) {
+    /* Samples are in core cycles; size the null loop in the same units so
+     * the comparison holds when the core frequency moves. */
+    return (int)((wait_ns * 1000ll) / jtr_1000_loops_cycles_cost);
+  }
   return (int)((wait_ns * 1000ll) / jtr_1000_loops_cost);
 }  /* jtr_busy_loop_wait_count */
 
 
-void jtr_measure_one(int timebase, int accum,
-                     app_cb_t app_cb, void *clientd)
-{
-  uint32_t start_ticks_hi, start_ticks_lo;
-  uint32_t end_ticks_hi, end_ticks_lo;
-  struct timespec start_ts;  /* tv_sec, tv_nsec */
-  struct timespec end_ts;  /* tv_sec, tv_nsec */
-  long long start_ns;
-  long long end_ns;
-  long long diff_ns;
-  long long start_ticks;
-  long long end_ticks;
-  long long diff_ticks;
+/* Hardware performance counters, read in user space with RDPMC around each
+ * sample. Enabled by jtr_pmu_init(), which must be called from the
+ * measuring thread (after pinning) since the events count only that thread.
+ */
+char *jtr_pmu_names[JTR_PMU_NUM_EVENTS] = {
+  "llc_misses", "dtlb_misses", "branch_misses", "instructions"
+};
+int jtr_pmu_enabled = 0;
+int jtr_pmu_fds[JTR_PMU_NUM_EVENTS];
+struct perf_event_mmap_page *jtr_pmu_pc[JTR_PMU_NUM_EVENTS];  /* Mapped. */
+uint64_t jtr_pmu_start[JTR_PMU_NUM_EVENTS];
+uint64_t jtr_pmu_end[JTR_PMU_NUM_EVENTS];
 
-  if (timebase == 1) {
-    /* Make sure timestamp memory is in cache. */
-    RDTSC(start_ticks_hi, start_ticks_lo);
-    RDTSC(end_ticks_hi, end_ticks_lo);
-    RDTSC(start_ticks_hi, start_ticks_lo);
-    RDTSC(end_ticks_hi, end_ticks_lo);
+/* Per-histogram PMU statistics, reset by jtr_histo_init(). */
+long long jtr_pmu_sums[JTR_PMU_NUM_EVENTS];
+int *jtr_pmu_llc_buckets = NULL;    /* Samples that had an LLC miss. */
+int *jtr_pmu_nollc_buckets = NULL;  /* Samples that did not. */
+int jtr_pmu_llc_samples;
+int jtr_pmu_nollc_samples;
+jtr_pmu_sample_t jtr_pmu_tail[JTR_PMU_TAIL_SAMPLES];  /* Slowest samples. */
+int jtr_pmu_tail_count;
+int jtr_pmu_tail_min;  /* Index of fastest entry in jtr_pmu_tail. */
 
-    RDTSC(start_ticks_hi, start_ticks_lo);
-    app_cb(clientd);
-    RDTSC(end_ticks_hi, end_ticks_lo);
 
-    start_ticks = ((long long)start_ticks_hi << 32) + (long long)start_ticks_lo;
-    end_ticks = ((long long)end_ticks_hi << 32) + (long long)end_ticks_lo;
+/* Read a counter through its mapped control page the way perf_event.h
+ * documents it: under the page's seqlock, at the counter's current RDPMC
+ * index, plus the kernel's offset. The kernel may move the event to
+ * another counter (or take it off, index 0) whenever the thread is
+ * switched out, so the index can't be cached. "seq" gets the lock count;
+ * it changes if the event was rescheduled between two reads.
+ */
+#define JTR_RDPMC_READ(pc, val, seq) do { \
+  uint32_t _hi, _lo, _idx; \
+  int _shift; \
+  do { \
+    seq = (pc)->lock; \
+    asm volatile ("" ::: "memory"); \
+    _idx = (pc)->index; \
+    val = (uint64_t)(pc)->offset; \
+    if (likely(_idx != 0)) { \
+      RDPMC(_idx - 1, _hi, _lo); \
+      _shift = 64 - (pc)->pmc_width; \
+      val += (uint64_t)((int64_t)((((uint64_t)_hi << 32) + _lo) << _shift) \
+                        >> _shift); \
+    } \
+    asm volatile ("" ::: "memory"); \
+  } while ((pc)->lock != seq); \
+} while (0)
 
-    diff_ticks = end_ticks - start_ticks;  /* start-to-finish */
-    diff_ns = (diff_ticks * NANOS_PER_SEC) / jtr_ticks_per_sec;
-    diff_ns -= jtr_rdtsc_cost;  /* Correct for measurement cost. */
+
+void jtr_rdpmc_close(int fd, struct perf_event_mmap_page *pc)
+{
+  SYSE(munmap(pc, sysconf(_SC_PAGESIZE)));
+  SYSE(close(fd));
+}  /* jtr_rdpmc_close */
+
+
+/* Open one counting event for the calling thread and map its control page
+ * for RDPMC into "pc". Returns the event fd, or -1 if the host can't do it.
+ */
+int jtr_rdpmc_open(char *name, uint32_t type, uint64_t config,
+                   struct perf_event_mmap_page **pc)
+{
+  struct perf_event_attr attr;
+  int fd;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.pinned = 1;  /* Never multiplexed. */
+  fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (fd == -1) {
+    /* perf_event_paranoid may forbid counting kernel time. */
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  if (fd == -1) {
+    fprintf(stderr, "Warning, perf_event_open(%s): %s\n",
+            name, strerror(errno));
+    return -1;
   }
-  else {  /* alternate timebase */
-    /* Make sure timestamp memory is in cache. */
-    clock_gettime(CLOCK_MONOTONIC, &start_ts);
-    clock_gettime(CLOCK_MONOTONIC, &end_ts);
-    clock_gettime(CLOCK_MONOTONIC, &start_ts);
-    clock_gettime(CLOCK_MONOTONIC, &end_ts);
 
-    clock_gettime(CLOCK_MONOTONIC, &start_ts);
-    app_cb(clientd);
-    clock_gettime(CLOCK_MONOTONIC, &end_ts);
-    start_ns = ((long long)start_ts.tv_sec * NANOS_PER_SEC)
-               + (long long)start_ts.tv_nsec;
-    end_ns = ((long long)end_ts.tv_sec * NANOS_PER_SEC)
-             + (long long)end_ts.tv_nsec;
-    diff_ns = end_ns - start_ns;
-    diff_ns -= jtr_gettime_cost;  /* Correct measurement cost. */
+  *pc = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+  if (*pc == MAP_FAILED) {
+    fprintf(stderr, "Warning, RDPMC not available for %s\n", name);
+    close(fd);
+    return -1;
+  }
+  if (! (*pc)->cap_user_rdpmc || (*pc)->index == 0) {
+    fprintf(stderr, "Warning, RDPMC not available for %s\n", name);
+    jtr_rdpmc_close(fd, *pc);
+    return -1;
   }
 
-  if (accum) {
-    if (unlikely(diff_ns < 0)) {
-      jtr_neg_diffs ++;
-      diff_ns = 0;
+  return fd;
+}  /* jtr_rdpmc_open */
+
+
+int jtr_pmu_open(int event, uint32_t type, uint64_t config)
+{
+  jtr_pmu_fds[event] = jtr_rdpmc_open(jtr_pmu_names[event], type, config,
+                                      &jtr_pmu_pc[event]);
+  return (jtr_pmu_fds[event] == -1) ? -1 : 0;
+}  /* jtr_pmu_open */
+
+
+/* Set up the PMU counters for the calling thread. Returns 1 if enabled;
+ * on hosts without a usable PMU (e.g. many VMs) prints a warning and
+ * returns 0, and measurements proceed without counters.
+ */
+int jtr_pmu_init(void)
+{
+  int ok = 0;
+  int i;
+
+  ok |= jtr_pmu_open(JTR_PMU_LLC, PERF_TYPE_HARDWARE,
+                     PERF_COUNT_HW_CACHE_MISSES);
+  ok |= jtr_pmu_open(JTR_PMU_DTLB, PERF_TYPE_HW_CACHE,
+                     PERF_COUNT_HW_CACHE_DTLB
+                     | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                     | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  ok |= jtr_pmu_open(JTR_PMU_BRANCH, PERF_TYPE_HARDWARE,
+                     PERF_COUNT_HW_BRANCH_MISSES);
+  ok |= jtr_pmu_open(JTR_PMU_INSTR, PERF_TYPE_HARDWARE,
+                     PERF_COUNT_HW_INSTRUCTIONS);
+
+  if (ok != 0) {
+    /* Abandon the group; release the events that did open. */
+    for (i = 0; i < JTR_PMU_NUM_EVENTS; i++) {
+      if (jtr_pmu_fds[i] != -1) {
+        jtr_rdpmc_close(jtr_pmu_fds[i], jtr_pmu_pc[i]);
+        jtr_pmu_fds[i] = -1;
+      }
     }
+  }
 
-    jtr_histo_accum(diff_ns);
-  }  /* if accum */
-}  /* jtr_measure_one */
+  jtr_pmu_enabled = (ok == 0);
+  return jtr_pmu_enabled;
+}  /* jtr_pmu_init */
 
 
-/* Main measurement loop. */
-void jtr_measure_calls(int warmup_loops, int measure_loops,
-                       int post_call_wait_ns, int timebase,
-                       app_cb_t app_cb, void *clientd)
+/* Reset PMU statistics; called by jtr_histo_init().
+ */
+void jtr_pmu_histo_init(void)
 {
   int i;
 
-  /* Use negative values for "i" as warm-up loops. */
-  for (i = -warmup_loops; i < measure_loops; i++) {
-    jtr_measure_one(timebase, (i >= 0),
-                    app_cb, clientd);
+  if (jtr_pmu_llc_buckets == NULL) {
+    jtr_pmu_llc_buckets =
+      (int *)jtr_mem_alloc(jtr_histo_num_buckets * sizeof(int));
+    jtr_pmu_nollc_buckets =
+      (int *)jtr_mem_alloc(jtr_histo_num_buckets * sizeof(int));
+  }
+  for (i = 0; i < jtr_histo_num_buckets; i++) {
+    jtr_pmu_llc_buckets[i] = 0;
+    jtr_pmu_nollc_buckets[i] = 0;
+  }
+  for (i = 0; i < JTR_PMU_NUM_EVENTS; i++) {
+    jtr_pmu_sums[i] = 0;
+  }
+  jtr_pmu_llc_samples = 0;
+  jtr_pmu_nollc_samples = 0;
+  jtr_pmu_tail_count = 0;
+  jtr_pmu_tail_min = 0;
+}  /* jtr_pmu_histo_init */
 
-    /* Pause between calls. */
-    if (likely(post_call_wait_ns >= 0)) {
-      jtr_spin_sleep_ns(post_call_wait_ns, timebase);
-    } else {
-      usleep(-post_call_wait_ns/1000);
+
+/* Account the counter deltas of one sample (already in jtr_pmu_start/end).
+ */
+void jtr_pmu_accum(int sample_time)
+{
+  jtr_pmu_sample_t *tail;
+  long long deltas[JTR_PMU_NUM_EVENTS];
+  int bucket;
+  int i;
+
+  for (i = 0; i < JTR_PMU_NUM_EVENTS; i++) {
+    deltas[i] = jtr_pmu_end[i] - jtr_pmu_start[i];
+    jtr_pmu_sums[i] += deltas[i];
+  }
+
+  /* Conditional histograms: split by "had an LLC miss". */
+  bucket = sample_time / HISTO_GRANULARITY;
+  if (deltas[JTR_PMU_LLC] > 0) {
+    jtr_pmu_llc_samples ++;
+    if (likely(bucket < jtr_histo_num_buckets)) {
+      jtr_pmu_llc_buckets[bucket] ++;
+    }
+  } else {
+    jtr_pmu_nollc_samples ++;
+    if (likely(bucket < jtr_histo_num_buckets)) {
+      jtr_pmu_nollc_buckets[bucket] ++;
     }
   }
-}  /* jtr_measure_calls */
+
+  /* Keep the slowest samples; replace the fastest of them when full. */
+  if (jtr_pmu_tail_count < JTR_PMU_TAIL_SAMPLES) {
+    tail = &jtr_pmu_tail[jtr_pmu_tail_count];
+    jtr_pmu_tail_count ++;
+  } else if (sample_time > jtr_pmu_tail[jtr_pmu_tail_min].sample_time) {
+    tail = &jtr_pmu_tail[jtr_pmu_tail_min];
+  } else {
+    return;
+  }
+  tail->sample_time = sample_time;
+  for (i = 0; i < JTR_PMU_NUM_EVENTS; i++) {
+    tail->deltas[i] = deltas[i];
+  }
+  jtr_pmu_tail_min = 0;
+  for (i = 1; i < jtr_pmu_tail_count; i++) {
+    if (jtr_pmu_tail[i].sample_time
+        < jtr_pmu_tail[jtr_pmu_tail_min].sample_time) {
+      jtr_pmu_tail_min = i;
+    }
+  }
+}  /* jtr_pmu_accum */
+
+
+/* Print counter averages for all samples vs. the slowest samples, and
+ * percentiles of the LLC-miss conditional histograms.
+ */
+void jtr_pmu_print(int verbose)
+{
+  double tail_avgs[JTR_PMU_NUM_EVENTS];
+  int i, t;
+
+  for (i = 0; i < JTR_PMU_NUM_EVENTS; i++) {
+    tail_avgs[i] = 0.0;
+    for (t = 0; t < jtr_pmu_tail_count; t++) {
+      tail_avgs[i] += (double)jtr_pmu_tail[t].deltas[i];
+    }
+    if (jtr_pmu_tail_count > 0) {
+      tail_avgs[i] /= (double)jtr_pmu_tail_count;
+    }
+  }
+
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "PMU avg per sample (all): %s=%.2lf, %s=%.2lf, %s=%.2lf, %s=%.1lf\n"
+           "PMU avg per sample (%d slowest): %s=%.2lf, %s=%.2lf, %s=%.2lf,"
+           " %s=%.1lf\n"
+           "PMU LLC miss: samples=%d, p99=%d, p99.9=%d;"
+           " no LLC miss: samples=%d, p99=%d, p99.9=%d\n",
+           jtr_pmu_names[0],
+           (double)jtr_pmu_sums[0] / (double)jtr_histo_num_samples,
+           jtr_pmu_names[1],
+           (double)jtr_pmu_sums[1] / (double)jtr_histo_num_samples,
+           jtr_pmu_names[2],
+           (double)jtr_pmu_sums[2] / (double)jtr_histo_num_samples,
+           jtr_pmu_names[3],
+           (double)jtr_pmu_sums[3] / (double)jtr_histo_num_samples,
+           jtr_pmu_tail_count,
+           jtr_pmu_names[0], tail_avgs[0], jtr_pmu_names[1], tail_avgs[1],
+           jtr_pmu_names[2], tail_avgs[2], jtr_pmu_names[3], tail_avgs[3],
+           jtr_pmu_llc_samples,
+           jtr_buckets_perc_ns(jtr_pmu_llc_buckets, jtr_pmu_llc_samples, 99.0),
+           jtr_buckets_perc_ns(jtr_pmu_llc_buckets, jtr_pmu_llc_samples, 99.9),
+           jtr_pmu_nollc_samples,
+           jtr_buckets_perc_ns(jtr_pmu_nollc_buckets, jtr_pmu_nollc_samples,
+                               99.0),
+           jtr_buckets_perc_ns(jtr_pmu_nollc_buckets, jtr_pmu_nollc_samples,
+                               99.9));
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+  if (verbose > 0) {
+    for (t = 0; t < jtr_pmu_tail_count; t++) {
+      snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+               sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+               "PMU tail sample %d ns: %lld %lld %lld %lld\n",
+               jtr_pmu_tail[t].sample_time,
+               jtr_pmu_tail[t].deltas[0], jtr_pmu_tail[t].deltas[1],
+               jtr_pmu_tail[t].deltas[2], jtr_pmu_tail[t].deltas[3]);
+      SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+    }
+  }
+}  /* jtr_pmu_print */
+
+/* Core-cycle timebase (timebase 3). The timed region is measured in
+ * unhalted core cycles, read with RDPMC, and reported as ns at the TSC's
+ * nominal rate; unlike RDTSC, the result doesn't move when the core's
+ * frequency does. The effective frequency is the ratio of core cycles to
+ * unhalted reference cycles (the same ratio as APERF/MPERF), tracked over
+ * the span from the end of one sample to the end of the next.
+ */
+#define JTR_FREQ_INTERVAL_NS 10000000ll  /* Report frequency every 10 ms. */
+#define JTR_FREQ_MAX_INTERVALS 1000
+#define JTR_FREQ_PRINT_INTERVALS 100  /* Without verbose. */
+#define JTR_FREQ_CHANGE_PCT 5  /* Span-to-span step that flags a sample. */
+
+int jtr_cycles_enabled = 0;
+struct perf_event_mmap_page *jtr_cycles_pc;
+struct perf_event_mmap_page *jtr_ref_pc;
+int jtr_ref_is_tsc = 0;  /* No reference-cycles event; use the TSC. */
+
+/* Per-histogram frequency tracking, reset by jtr_histo_init(). */
+int jtr_freq_have_prev;
+uint64_t jtr_freq_prev_cycles;
+uint64_t jtr_freq_prev_ref;
+double jtr_freq_prev_ratio;
+uint64_t jtr_freq_ival_cycles;  /* Current interval. */
+uint64_t jtr_freq_ival_ref;
+uint64_t jtr_freq_tot_cycles;  /* Whole run. */
+uint64_t jtr_freq_tot_ref;
+int jtr_freq_mhz[JTR_FREQ_MAX_INTERVALS];
+int jtr_freq_num_intervals;
+int jtr_freq_changes;  /* Samples whose span crossed a frequency change. */
+int jtr_freq_change_max_time;
+int jtr_cycles_resched;  /* Samples dropped: thread switched out mid-call. */
+
+
+/* Read the reference count: unhalted reference cycles or the TSC. */
+#define JTR_REF_READ(ref) do { \
+  uint32_t _hi, _lo, _seq; \
+  if (jtr_ref_is_tsc) { \
+    RDTSC(_hi, _lo); \
+    ref = ((uint64_t)_hi << 32) + _lo; \
+  } else { \
+    JTR_RDPMC_READ(jtr_ref_pc, ref, _seq); \
+    (void)_seq; \
+  } \
+} while (0)
+
+
+/* Set up the core-cycle timebase for the calling thread. Must be called
+ * before jtr_calibrate(). Returns 1 if enabled; on hosts without a usable
+ * cycle counter prints a warning and returns 0 (caller should use RDTSC).
+ */
+int jtr_cycles_init(void)
+{
+  if (jtr_rdpmc_open("cpu_cycles", PERF_TYPE_HARDWARE,
+                     PERF_COUNT_HW_CPU_CYCLES, &jtr_cycles_pc) == -1) {
+    fprintf(stderr, "Warning, no core cycle counter; using timebase 1\n");
+    return 0;
+  }
+  if (jtr_rdpmc_open("ref_cycles", PERF_TYPE_HARDWARE,
+                     PERF_COUNT_HW_REF_CPU_CYCLES, &jtr_ref_pc) == -1) {
+    /* Without it, halted time (e.g. usleep pauses) lowers the frequency. */
+    fprintf(stderr, "Warning, frequency reference is the TSC\n");
+    jtr_ref_is_tsc = 1;
+  }
+
+  jtr_cycles_enabled = 1;
+  return 1;
+}  /* jtr_cycles_init */
+
+
+/* Timebase 3 equivalents of jtr_rdtsc_cost and jtr_1000_loops_cost, in
+ * core cycles expressed as nominal ns. Called by jtr_calibrate().
+ */
+void jtr_calibrate_cycles(void)
+{
+  uint64_t start_cycles, end_cycles;
+  uint32_t seq;
+  long long diff_ns;
+  int i;
+
+  /* Cost of a counter read. */
+  JTR_RDPMC_READ(jtr_cycles_pc, start_cycles, seq);
+  for (i = 0; i < 100; i++) {
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+  }
+  diff_ns = ((long long)(end_cycles - start_cycles) * NANOS_PER_SEC)
+            / jtr_ticks_per_sec;
+  diff_ns /= 1001;  /* Called it 1001 times. */
+  if (diff_ns < jtr_rdpmc_cost) {
+    jtr_rdpmc_cost = diff_ns;
+  }
+
+  /* Cost of a 1000-cycle null for loop. */
+  JTR_RDPMC_READ(jtr_cycles_pc, start_cycles, seq);
+  for (i = 0; i < 1000; i++) {
+  }
+  JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, seq);
+  diff_ns = ((long long)(end_cycles - start_cycles) * NANOS_PER_SEC)
+            / jtr_ticks_per_sec;
+  diff_ns -= jtr_rdpmc_cost;
+  if (diff_ns < jtr_1000_loops_cycles_cost) {
+    jtr_1000_loops_cycles_cost = diff_ns;
+  }
+  (void)seq;
+}  /* jtr_calibrate_cycles */
+
+
+/* Reset frequency tracking; called by jtr_histo_init().
+ */
+void jtr_freq_histo_init(void)
+{
+  jtr_freq_have_prev = 0;
+  jtr_freq_prev_ratio = 0.0;
+  jtr_freq_ival_cycles = 0;
+  jtr_freq_ival_ref = 0;
+  jtr_freq_tot_cycles = 0;
+  jtr_freq_tot_ref = 0;
+  jtr_freq_num_intervals = 0;
+  jtr_freq_changes = 0;
+  jtr_freq_change_max_time = 0;
+  jtr_cycles_resched = 0;
+}  /* jtr_freq_histo_init */
+
+
+int jtr_freq_mhz_of(uint64_t cycles, uint64_t ref)
+{
+  if (ref == 0) {
+    return 0;
+  }
+  return (int)(((double)cycles / (double)ref)
+               * (double)jtr_ticks_per_sec / 1000000.0);
+}  /* jtr_freq_mhz_of */
+
+
+/* Account the counts at the end of one sample. The span since the previous
+ * sample's end (pause plus this sample) is flagged if its frequency differs
+ * from the previous span's by more than JTR_FREQ_CHANGE_PCT.
+ */
+void jtr_freq_track(uint64_t cycles, uint64_t ref, int sample_time,
+                    int accum)
+{
+  uint64_t d_cycles, d_ref;
+  double ratio, step;
+
+  if (jtr_freq_have_prev) {
+    d_cycles = cycles - jtr_freq_prev_cycles;
+    d_ref = ref - jtr_freq_prev_ref;
+    if (d_ref > 0) {
+      ratio = (double)d_cycles / (double)d_ref;
+      step = ratio - jtr_freq_prev_ratio;
+      if (step < 0) {
+        step = -step;
+      }
+      if (accum && jtr_freq_prev_ratio > 0.0
+          && step * 100.0 > jtr_freq_prev_ratio * JTR_FREQ_CHANGE_PCT) {
+        jtr_freq_changes ++;
+        if (sample_time > jtr_freq_change_max_time) {
+          jtr_freq_change_max_time = sample_time;
+        }
+      }
+      jtr_freq_prev_ratio = ratio;
+    }
+
+    if (accum) {
+      jtr_freq_ival_cycles += d_cycles;
+      jtr_freq_ival_ref += d_ref;
+      if (jtr_freq_ival_ref
+          >= (uint64_t)((JTR_FREQ_INTERVAL_NS * jtr_ticks_per_sec)
+                        / NANOS_PER_SEC)) {
+        if (jtr_freq_num_intervals < JTR_FREQ_MAX_INTERVALS) {
+          jtr_freq_mhz[jtr_freq_num_intervals] =
+            jtr_freq_mhz_of(jtr_freq_ival_cycles, jtr_freq_ival_ref);
+          jtr_freq_num_intervals ++;
+        }
+        jtr_freq_tot_cycles += jtr_freq_ival_cycles;
+        jtr_freq_tot_ref += jtr_freq_ival_ref;
+        jtr_freq_ival_cycles = 0;
+        jtr_freq_ival_ref = 0;
+      }
+    }
+  }
+
+  jtr_freq_prev_cycles = cycles;
+  jtr_freq_prev_ref = ref;
+  jtr_freq_have_prev = 1;
+}  /* jtr_freq_track */
+
+
+/* Print the effective core frequency of each interval and the number of
+ * samples that crossed a frequency change. The final, partial interval is
+ * included.
+ */
+void jtr_freq_print(int verbose)
+{
+  int num_intervals = jtr_freq_num_intervals;
+  int print_intervals;
+  int min_mhz = 0x7fffffff;
+  int max_mhz = 0;
+  int i;
+
+  if (jtr_freq_ival_ref > 0 && num_intervals < JTR_FREQ_MAX_INTERVALS) {
+    jtr_freq_mhz[num_intervals] =
+      jtr_freq_mhz_of(jtr_freq_ival_cycles, jtr_freq_ival_ref);
+    num_intervals ++;
+  }
+  for (i = 0; i < num_intervals; i++) {
+    if (jtr_freq_mhz[i] < min_mhz) {
+      min_mhz = jtr_freq_mhz[i];
+    }
+    if (jtr_freq_mhz[i] > max_mhz) {
+      max_mhz = jtr_freq_mhz[i];
+    }
+  }
+  if (num_intervals == 0) {
+    min_mhz = 0;
+  }
+
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Core cycles: rdpmc_cost=%lld, jtr_1000_loops_cycles_cost=%lld,"
+           " ref=%s\n"
+           "Core freq MHz: intervals=%d, min=%d, avg=%d, max=%d;"
+           " Freq_change_samples=%d, max_flagged_ns=%d,"
+           " Resched_dropped=%d\n",
+           jtr_rdpmc_cost, jtr_1000_loops_cycles_cost,
+           jtr_ref_is_tsc ? "tsc" : "ref_cycles",
+           num_intervals, min_mhz,
+           jtr_freq_mhz_of(jtr_freq_tot_cycles + jtr_freq_ival_cycles,
+                           jtr_freq_tot_ref + jtr_freq_ival_ref),
+           max_mhz, jtr_freq_changes, jtr_freq_change_max_time,
+           jtr_cycles_resched);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+  print_intervals = num_intervals;
+  if (verbose == 0 && print_intervals > JTR_FREQ_PRINT_INTERVALS) {
+    print_intervals = JTR_FREQ_PRINT_INTERVALS;
+  }
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Core freq MHz per %lld ms:", JTR_FREQ_INTERVAL_NS / 1000000);
+  for (i = 0; i < print_intervals; i++) {
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             " %d", jtr_freq_mhz[i]);
+  }
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "%s\n", (print_intervals < num_intervals) ? " ..." : "");
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+}  /* jtr_freq_print */
+
+
+
+/* Read all enabled counters into "vals". A switch between the start and
+ * end reads is accounted for by the offsets, so the deltas still count
+ * only this thread's events.
+ */
+#define JTR_PMU_READ(vals) do { \
+  uint32_t _seq; \
+  JTR_RDPMC_READ(jtr_pmu_pc[0], vals[0], _seq); \
+  JTR_RDPMC_READ(jtr_pmu_pc[1], vals[1], _seq); \
+  JTR_RDPMC_READ(jtr_pmu_pc[2], vals[2], _seq); \
+  JTR_RDPMC_READ(jtr_pmu_pc[3], vals[3], _seq); \
+  (void)_seq; \
+} while (0)
+
+
+void jtr_measure_one(int timebase, int accum,
+                     app_cb_t app_cb, void *clientd)
+{
+  uint32_t start_ticks_hi, start_ticks_lo;
+  uint32_t end_ticks_hi, end_ticks_lo;
+  struct timespec start_ts;  /* tv_sec, tv_nsec */
+  struct timespec end_ts;  /* tv_sec, tv_nsec */
+  long long start_ns;
+  long long end_ns;
+  long long diff_ns;
+  long long start_ticks;
+  long long end_ticks;
+  long long diff_ticks;
+  uint64_t start_cycles, end_cycles;
+  uint32_t start_seq, end_seq;
+  uint64_t end_ref;
+  unsigned long long tick_bucket;
+
+  /* Counters are read outside the timed region so they don't add to it. */
+  if (jtr_pmu_enabled) {
+    JTR_PMU_READ(jtr_pmu_start);
+  }
+
+  jtr_mark_set = 0;  /* Marks from an untracked call don't carry over. */
+
+  if (timebase == 1) {
+    /* Make sure timestamp memory is in cache. */
+    RDTSC(start_ticks_hi, start_ticks_lo);
+    RDTSC(end_ticks_hi, end_ticks_lo);
+    RDTSC(start_ticks_hi, start_ticks_lo);
+    RDTSC(end_ticks_hi, end_ticks_lo);
+
+    RDTSC(start_ticks_hi, start_ticks_lo);
+    app_cb(clientd);
+    RDTSC(end_ticks_hi, end_ticks_lo);
+
+    start_ticks = ((long long)start_ticks_hi << 32) + (long long)start_ticks_lo;
+    end_ticks = ((long long)end_ticks_hi << 32) + (long long)end_ticks_lo;
+
+    diff_ticks = end_ticks - start_ticks;  /* start-to-finish */
+    if (unlikely(jtr_mark_set != 0)) {
+      jtr_mark_accum(start_ticks, end_ticks, accum);
+    }
+    if (likely(jtr_tick_buckets != NULL) && ! jtr_pmu_enabled) {
+      /* No conversion between samples; see jtr_histo_fold(). */
+      if (accum) {
+        tick_bucket = (unsigned long long)diff_ticks >> jtr_tick_shift;
+        if (likely(tick_bucket < (unsigned long long)jtr_tick_num_buckets)) {
+          jtr_tick_buckets[tick_bucket] ++;
+        } else {
+          jtr_histo_accum_ticks(diff_ticks);  /* Overflow or negative. */
+        }
+      }
+      return;
+    }
+    diff_ns = (diff_ticks * NANOS_PER_SEC) / jtr_ticks_per_sec;
+    diff_ns -= jtr_rdtsc_cost;  /* Correct for measurement cost. */
+  }
+  else if (timebase == 3) {
+    /* Make sure counter memory is in cache. */
+    JTR_RDPMC_READ(jtr_cycles_pc, start_cycles, start_seq);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, end_seq);
+    JTR_REF_READ(end_ref);
+
+    JTR_RDPMC_READ(jtr_cycles_pc, start_cycles, start_seq);
+    app_cb(clientd);
+    JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, end_seq);
+    JTR_REF_READ(end_ref);
+
+    diff_ticks = (long long)(end_cycles - start_cycles);
+    diff_ns = (diff_ticks * NANOS_PER_SEC) / jtr_ticks_per_sec;
+    diff_ns -= jtr_rdpmc_cost;  /* Correct for measurement cost. */
+
+    if (unlikely(end_seq != start_seq)) {
+      /* Rescheduled mid-call. The thread's cycles stop while it's off the
+       * CPU, so the sample would understate the time; drop it. */
+      if (accum) {
+        jtr_cycles_resched ++;
+      }
+      accum = 0;
+    }
+    jtr_freq_track(end_cycles, end_ref,
+                   (diff_ns < 0) ? 0 : (int)diff_ns, accum);
+  }
+  else {  /* alternate timebase */
+    /* Make sure timestamp memory is in cache. */
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    app_cb(clientd);
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    start_ns = ((long long)start_ts.tv_sec * NANOS_PER_SEC)
+               + (long long)start_ts.tv_nsec;
+    end_ns = ((long long)end_ts.tv_sec * NANOS_PER_SEC)
+             + (long long)end_ts.tv_nsec;
+    diff_ns = end_ns - start_ns;
+    diff_ns -= jtr_gettime_cost;  /* Correct measurement cost. */
+  }
+
+  if (jtr_pmu_enabled) {
+    JTR_PMU_READ(jtr_pmu_end);
+  }
+
+  if (accum) {
+    if (unlikely(diff_ns < 0)) {
+      jtr_neg_diffs ++;
+      diff_ns = 0;
+    }
+
+    jtr_histo_accum(diff_ns);
+    if (jtr_pmu_enabled) {
+      jtr_pmu_accum(diff_ns);
+    }
+  }  /* if accum */
+}  /* jtr_measure_one */
+
+
+/* Main measurement loop. A negative "warmup_loops" detects steady state
+ * instead (see jtr_warmup_detect()). With jtr_converge_init(), batches of
+ * "measure_loops" are repeated until the percentile has converged.
+ */
+void jtr_measure_calls(int warmup_loops, int measure_loops,
+                       int post_call_wait_ns, int timebase,
+                       app_cb_t app_cb, void *clientd)
+{
+  struct rusage start_usage;
+  struct rusage end_usage;
+  struct timespec start_ts;
+  struct timespec now_ts;
+  int k = 0;  /* Calls made, for the pattern index. */
+  int i;
+
+  if (warmup_loops < 0) {
+    k = jtr_warmup_detect(post_call_wait_ns, timebase, app_cb, clientd);
+    warmup_loops = 0;
+  }
+  jtr_converge_batches = 0;
+  jtr_converge_done = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+  do {
+    /* Use negative values for "i" as warm-up loops. */
+    for (i = -warmup_loops; i < measure_loops; i++, k++) {
+      if (unlikely(i == 0 && jtr_converge_batches == 0)) {
+        /* Count faults for the measuring thread, after the warm-up. */
+        SYSE(getrusage(RUSAGE_THREAD, &start_usage));
+      }
+      if (jtr_pattern_len > 0) {  /* Does its own pause. */
+        jtr_pattern_measure_one(k % jtr_pattern_len,
+                                timebase, (i >= 0), app_cb, clientd);
+        continue;
+      }
+      jtr_measure_one(timebase, (i >= 0),
+                      app_cb, clientd);
+
+      /* Pause between calls. */
+      if (likely(post_call_wait_ns >= 0)) {
+        jtr_spin_sleep_ns(post_call_wait_ns, timebase);
+      } else {
+        usleep(-post_call_wait_ns/1000);
+      }
+    }
+    warmup_loops = 0;
+    k %= (jtr_pattern_len > 0) ? jtr_pattern_len : 1;
+    jtr_converge_batches ++;
+
+    if (jtr_converge_perc <= 0.0 || measure_loops <= 0) {
+      break;
+    }
+    jtr_converge_done = jtr_converge_check();
+    clock_gettime(CLOCK_MONOTONIC, &now_ts);
+    jtr_converge_secs = (double)(now_ts.tv_sec - start_ts.tv_sec)
+                        + (double)(now_ts.tv_nsec - start_ts.tv_nsec) / 1e9;
+  } while (! jtr_converge_done
+           && jtr_converge_secs < (double)jtr_converge_max_sec
+           && jtr_histo_num_samples < 0x7fffffff - measure_loops);
+
+  if (measure_loops > 0) {
+    SYSE(getrusage(RUSAGE_THREAD, &end_usage));
+    jtr_histo_minflt += end_usage.ru_minflt - start_usage.ru_minflt;
+    jtr_histo_majflt += end_usage.ru_majflt - start_usage.ru_majflt;
+    jtr_histo_faults_counted = 1;
+  }
+
+  jtr_histo_fold();
+}  /* jtr_measure_calls */
+
+
+/* A/B interleaved measurement. Instead of timing all the "A" (real) calls
+ * and then all the "B" (null) calls, the calls alternate sample by sample
+ * so both see the same interrupts and cache state. Samples are kept (in ns)
+ * until the pass is done so that each A can be paired with its B.
+ */
+int *jtr_ab_ns[2] = { NULL, NULL };  /* [0]=A, [1]=B. */
+int jtr_ab_neg_diffs[2];
+int *jtr_ab_diff_ns = NULL;
+int jtr_ab_size = 0;
+int jtr_ab_num_samples = 0;
+
+
+/* Time one call, outside of the histogram. Returns corrected ns, which can
+ * be negative.
+ */
+long long jtr_time_call_ns(int timebase, app_cb_t app_cb, void *clientd)
+{
+  uint32_t start_ticks_hi, start_ticks_lo;
+  uint32_t end_ticks_hi, end_ticks_lo;
+  struct timespec start_ts;  /* tv_sec, tv_nsec */
+  struct timespec end_ts;  /* tv_sec, tv_nsec */
+  uint64_t start_cycles, end_cycles;
+  uint32_t start_seq, end_seq;
+  long long diff_ticks;
+
+  jtr_mark_set = 0;  /* Marks aren't tracked here. */
+
+  if (timebase == 1) {
+    /* Make sure timestamp memory is in cache. */
+    RDTSC(start_ticks_hi, start_ticks_lo);
+    RDTSC(end_ticks_hi, end_ticks_lo);
+    RDTSC(start_ticks_hi, start_ticks_lo);
+    RDTSC(end_ticks_hi, end_ticks_lo);
+
+    RDTSC(start_ticks_hi, start_ticks_lo);
+    app_cb(clientd);
+    RDTSC(end_ticks_hi, end_ticks_lo);
+    diff_ticks = (((long long)end_ticks_hi << 32) + (long long)end_ticks_lo)
+      - (((long long)start_ticks_hi << 32) + (long long)start_ticks_lo);
+    return ((diff_ticks * NANOS_PER_SEC) / jtr_ticks_per_sec)
+           - jtr_rdtsc_cost;
+  }
+  else if (timebase == 3) {
+    /* A call that was rescheduled mid-way understates; time it again so
+     * the A/B pair stays complete. */
+    for (;;) {
+      /* Make sure counter memory is in cache. */
+      JTR_RDPMC_READ(jtr_cycles_pc, start_cycles, start_seq);
+      JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, end_seq);
+
+      JTR_RDPMC_READ(jtr_cycles_pc, start_cycles, start_seq);
+      app_cb(clientd);
+      JTR_RDPMC_READ(jtr_cycles_pc, end_cycles, end_seq);
+      if (likely(end_seq == start_seq)) {
+        break;
+      }
+      jtr_cycles_resched ++;
+    }
+    diff_ticks = (long long)(end_cycles - start_cycles);
+    return ((diff_ticks * NANOS_PER_SEC) / jtr_ticks_per_sec)
+           - jtr_rdpmc_cost;
+  }
+  else {  /* alternate timebase */
+    /* Make sure timestamp memory is in cache. */
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    app_cb(clientd);
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    return ((long long)end_ts.tv_sec - (long long)start_ts.tv_sec)
+           * NANOS_PER_SEC
+           + ((long long)end_ts.tv_nsec - (long long)start_ts.tv_nsec)
+           - jtr_gettime_cost;
+  }
+}  /* jtr_time_call_ns */
+
+
+/* Measure "measure_loops" pairs of calls to a_cb and b_cb. "order" 1
+ * swaps which one goes first on each pair (ABBAAB...); 2 picks it at
+ * random. Load the results with jtr_ab_histo() and jtr_ab_print_diff().
+ */
+void jtr_measure_ab(int warmup_loops, int measure_loops,
+                    int post_call_wait_ns, int timebase, int order,
+                    app_cb_t a_cb, void *a_clientd,
+                    app_cb_t b_cb, void *b_clientd)
+{
+  uint32_t rand_state = 2463534242u;  /* xorshift32; fixed for repeatability. */
+  long long diff_ns;
+  int first, which;
+  int i, j;
+
+  if (jtr_ab_size < measure_loops) {
+    jtr_ab_ns[0] = (int *)jtr_mem_alloc(measure_loops * sizeof(int));
+    jtr_ab_ns[1] = (int *)jtr_mem_alloc(measure_loops * sizeof(int));
+    jtr_ab_diff_ns = (int *)jtr_mem_alloc(measure_loops * sizeof(int));
+    jtr_ab_size = measure_loops;
+  }
+  jtr_ab_neg_diffs[0] = 0;
+  jtr_ab_neg_diffs[1] = 0;
+  if (warmup_loops < 0) {  /* Use the pilot run's steady-state detection. */
+    warmup_loops = (jtr_warmup_detected >= 0) ? jtr_warmup_detected : 0;
+  }
+
+  for (i = -warmup_loops; i < measure_loops; i++) {
+    if (order == 2) {
+      rand_state ^= rand_state << 13;
+      rand_state ^= rand_state >> 17;
+      rand_state ^= rand_state << 5;
+      first = rand_state & 1;
+    } else {
+      first = i & 1;
+    }
+
+    for (j = 0; j < 2; j++) {
+      which = first ^ j;
+      if (which == 0) {
+        diff_ns = jtr_time_call_ns(timebase, a_cb, a_clientd);
+      } else {
+        diff_ns = jtr_time_call_ns(timebase, b_cb, b_clientd);
+      }
+      if (i >= 0) {
+        if (unlikely(diff_ns < 0)) {
+          jtr_ab_neg_diffs[which] ++;
+          diff_ns = 0;
+        }
+        jtr_ab_ns[which][i] = (int)diff_ns;
+      }
+
+      /* Pause between calls. */
+      if (likely(post_call_wait_ns >= 0)) {
+        jtr_spin_sleep_ns(post_call_wait_ns, timebase);
+      } else {
+        usleep(-post_call_wait_ns/1000);
+      }
+    }
+  }
+
+  jtr_ab_num_samples = measure_loops;
+}  /* jtr_measure_ab */
+
+
+/* Load the jtr_histo_* histogram with the A (which=0) or B (which=1)
+ * samples from the last jtr_measure_ab().
+ */
+void jtr_ab_histo(int which, int num_buckets)
+{
+  int i;
+
+  jtr_histo_init(num_buckets);
+  jtr_histo_from_ab = 1;  /* A/B calls aren't counted per sample. */
+  for (i = 0; i < jtr_ab_num_samples; i++) {
+    jtr_histo_accum(jtr_ab_ns[which][i]);
+  }
+  jtr_neg_diffs = jtr_ab_neg_diffs[which];
+  jtr_histo_fold();
+}  /* jtr_ab_histo */
+
+
+int jtr_int_cmp(const void *a, const void *b)
+{
+  int int_a = *(const int *)a;
+  int int_b = *(const int *)b;
+
+  return (int_a > int_b) - (int_a < int_b);
+}  /* jtr_int_cmp */
+
+
+/* Print the distribution of the per-pair differences A-B, which is the
+ * cost of A with the shared noise subtracted out.
+ */
+void jtr_ab_print_diff(void)
+{
+  long long tot_diff = 0;
+  int a_above = 0;
+  int n = jtr_ab_num_samples;
+  int i;
+
+  if (n == 0) {
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    jtr_ab_diff_ns[i] = jtr_ab_ns[0][i] - jtr_ab_ns[1][i];
+    tot_diff += jtr_ab_diff_ns[i];
+    if (jtr_ab_diff_ns[i] > 0) {
+      a_above ++;
+    }
+  }
+  qsort(jtr_ab_diff_ns, n, sizeof(int), jtr_int_cmp);
+
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Paired difference A-B (ns): Pairs=%d, Average=%lld,"
+           " A_slower_pct=%.3lf,\n"
+           " Minimum=%d, p1=%d, p10=%d, p50=%d, p90=%d, p99=%d, p99.9=%d,"
+           " Maximum=%d\n",
+           n, tot_diff / n, (100.0 * (double)a_above) / (double)n,
+           jtr_ab_diff_ns[0], jtr_ab_diff_ns[(int)(0.01 * (n - 1))],
+           jtr_ab_diff_ns[(int)(0.10 * (n - 1))],
+           jtr_ab_diff_ns[(int)(0.50 * (n - 1))],
+           jtr_ab_diff_ns[(int)(0.90 * (n - 1))],
+           jtr_ab_diff_ns[(int)(0.99 * (n - 1))],
+           jtr_ab_diff_ns[(int)(0.999 * (n - 1))], jtr_ab_diff_ns[n - 1]);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+}  /* jtr_ab_print_diff */
+
+
+/* Traffic patterns. Normally every call is followed by the same fixed
+ * pause and sends the same size. jtr_pattern_init() instead precomputes a
+ * schedule of pauses (bursts, on/off, Poisson arrivals, or a recorded
+ * trace), message sizes, and each call's position in its burst, so the
+ * measuring loop only indexes arrays. Latency is also kept per burst
+ * position and per size class: the first call after an idle gap and a call
+ * deep in a burst (or a 40-byte quote and an 8K snapshot) behave very
+ * differently.
+ */
+#define JTR_PATTERN_LEN 16384  /* Schedule length for generated patterns. */
+#define JTR_TRACE_MAX_PKTS (1024 * 1024)
+#define JTR_TRACE_MAX_GAP_NS 10000000  /* Longer trace gaps are cut to this. */
+#define JTR_SIZE_MAX_SIZES 64
+/* The longest Poisson gap drawn is 16.6 times the mean; at lower rates it
+ * would not fit in an int. */
+#define JTR_PATTERN_MIN_RATE 8
+
+typedef struct jtr_group_histo_s {  /* Per-group samples and histograms. */
+  int num_groups;
+  int *buckets;  /* [group * jtr_histo_num_buckets + bucket] */
+  int samples[JTR_PATTERN_MAX_POS];
+  int max_time[JTR_PATTERN_MAX_POS];
+  long long tot_time[JTR_PATTERN_MAX_POS];
+} jtr_group_histo_t;
+
+int jtr_pattern_len = 0;  /* 0=no schedule; fixed pause and size. */
+int *jtr_pattern_pause_ns = NULL;  /* Pause after each call. */
+int *jtr_pattern_size = NULL;  /* Message size of each call; NULL=fixed. */
+unsigned char *jtr_pattern_pos = NULL;  /* Position in burst. */
+int jtr_pattern_max_size = 0;
+int jtr_msg_size = 0;  /* Size for the current call; 0=tool's own. */
+int jtr_msg_next_size = 0;  /* Size for the call after; 0=tool's own. */
+jtr_group_histo_t jtr_pattern_pos_histo;
+jtr_group_histo_t jtr_pattern_size_histo;  /* Group is the size class. */
+
+
+/* Size class of a message: class c holds sizes 2^c to 2^(c+1)-1. */
+int jtr_size_class(int size)
+{
+  int c = 0;
+
+  while ((size >> (c + 1)) > 0 && c < JTR_SIZE_CLASSES - 1) {
+    c++;
+  }
+  return c;
+}  /* jtr_size_class */
+
+
+uint32_t jtr_pattern_rand(uint32_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}  /* jtr_pattern_rand */
+
+
+/* Set burst positions from the pauses: a pause of at least the average
+ * starts a new burst.
+ */
+void jtr_pattern_pos_from_gaps(void)
+{
+  long long tot_ns = 0;
+  long long idle_ns;
+  int pos = 0;
+  int k;
+
+  for (k = 0; k < jtr_pattern_len; k++) {
+    tot_ns += jtr_pattern_pause_ns[k];
+  }
+  idle_ns = tot_ns / jtr_pattern_len;
+  for (k = 0; k < jtr_pattern_len; k++) {
+    jtr_pattern_pos[k] = (pos < JTR_PATTERN_MAX_POS) ?
+                         pos : JTR_PATTERN_MAX_POS - 1;
+    pos = (jtr_pattern_pause_ns[k] >= idle_ns) ? 0 : pos + 1;
+  }
+}  /* jtr_pattern_pos_from_gaps */
+
+
+/* Read the UDP payload sizes and arrival gaps of a pcap file into the
+ * schedule. Handles Ethernet, Linux cooked and raw IP captures, and micro-
+ * or nanosecond timestamps in either byte order. Non-UDP packets are
+ * skipped. For other link types, the captured packet length is used.
+ */
+void jtr_trace_load(char *trace_file)
+{
+  FILE *fp;
+  unsigned char hdr[24];
+  unsigned char rec[16];
+  unsigned char pkt[64];
+  uint32_t magic;
+  int swapped, nsec, linktype;
+  int l2_len, ethertype_off;
+  long long ts_ns, gap_ns, tot_gap_ns = 0;
+  long long prev_ts_ns = -1;
+  uint32_t incl_len, orig_len;
+  int ip, size, got;
+
+#define JTR_PCAP_U32(_p) (swapped ? \
+  ((uint32_t)(_p)[0] << 24 | (uint32_t)(_p)[1] << 16 | \
+   (uint32_t)(_p)[2] << 8 | (uint32_t)(_p)[3]) : \
+  ((uint32_t)(_p)[3] << 24 | (uint32_t)(_p)[2] << 16 | \
+   (uint32_t)(_p)[1] << 8 | (uint32_t)(_p)[0]))
+
+  fp = fopen(trace_file, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Can't open trace '%s': %s\n", trace_file,
+            strerror(errno));
+    exit(1);
+  }
+  SYSE(fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr));
+  magic = (uint32_t)hdr[0] | (uint32_t)hdr[1] << 8 |
+          (uint32_t)hdr[2] << 16 | (uint32_t)hdr[3] << 24;
+  swapped = (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1);
+  nsec = (magic == 0xa1b23c4d || magic == 0x4d3cb2a1);
+  if (! swapped && magic != 0xa1b2c3d4 && magic != 0xa1b23c4d) {
+    fprintf(stderr, "'%s' is not a pcap file (pcapng is not supported)\n",
+            trace_file);
+    exit(1);
+  }
+  linktype = JTR_PCAP_U32(&hdr[20]) & 0xffff;
+  switch (linktype) {
+    case 1: l2_len = 14; ethertype_off = 12; break;  /* Ethernet */
+    case 113: l2_len = 16; ethertype_off = 14; break;  /* Linux cooked */
+    case 12: case 101: l2_len = 0; ethertype_off = -1; break;  /* Raw IP */
+    default: l2_len = -1; ethertype_off = -1;
+  }
+
+  jtr_pattern_pause_ns = (int *)jtr_mem_alloc(
+    JTR_TRACE_MAX_PKTS * sizeof(int));
+  jtr_pattern_size = (int *)jtr_mem_alloc(JTR_TRACE_MAX_PKTS * sizeof(int));
+  jtr_pattern_pos = (unsigned char *)jtr_mem_alloc(JTR_TRACE_MAX_PKTS);
+  jtr_pattern_len = 0;
+  while (jtr_pattern_len < JTR_TRACE_MAX_PKTS
+         && fread(rec, 1, sizeof(rec), fp) == sizeof(rec)) {
+    ts_ns = (long long)JTR_PCAP_U32(&rec[0]) * NANOS_PER_SEC
+            + (long long)JTR_PCAP_U32(&rec[4]) * (nsec ? 1 : 1000);
+    incl_len = JTR_PCAP_U32(&rec[8]);
+    orig_len = JTR_PCAP_U32(&rec[12]);
+    got = (incl_len < sizeof(pkt)) ? incl_len : sizeof(pkt);
+    SYSE(fread(pkt, 1, got, fp) != got);
+    SYSE(fseek(fp, incl_len - got, SEEK_CUR) != 0);
+
+    if (l2_len < 0) {
+      size = orig_len;
+    } else {
+      size = -1;
+      ip = l2_len;
+      if ((ethertype_off < 0 || (pkt[ethertype_off] == 0x08
+                                 && pkt[ethertype_off + 1] == 0x00))
+          && got >= ip + 28 && (pkt[ip] >> 4) == 4 && pkt[ip + 9] == 17) {
+        ip += (pkt[ip] & 0x0f) * 4;  /* Now at UDP header. */
+        if (got >= ip + 6) {
+          size = ((int)pkt[ip + 4] << 8 | (int)pkt[ip + 5]) - 8;
+        }
+      }
+      if (size < 0) {
+        continue;  /* Not UDP over IPv4. */
+      }
+    }
+
+    if (prev_ts_ns >= 0) {  /* Pause after the previous call. */
+      gap_ns = ts_ns - prev_ts_ns;
+      gap_ns = (gap_ns < 0) ? 0 : gap_ns;
+      gap_ns = (gap_ns > JTR_TRACE_MAX_GAP_NS) ? JTR_TRACE_MAX_GAP_NS : gap_ns;
+      jtr_pattern_pause_ns[jtr_pattern_len - 1] = (int)gap_ns;
+      tot_gap_ns += gap_ns;
+    }
+    prev_ts_ns = ts_ns;
+    jtr_pattern_size[jtr_pattern_len] = (size > 0) ? size : 1;
+    jtr_pattern_len ++;
+  }
+  fclose(fp);
+#undef JTR_PCAP_U32
+
+  if (jtr_pattern_len == 0) {
+    fprintf(stderr, "No UDP packets in trace '%s'\n", trace_file);
+    exit(1);
+  }
+  /* The trace repeats; use the average gap to get back to the start. */
+  jtr_pattern_pause_ns[jtr_pattern_len - 1] = (jtr_pattern_len > 1) ?
+    (int)(tot_gap_ns / (jtr_pattern_len - 1)) : 0;
+}  /* jtr_trace_load */
+
+
+/* Give each call of the schedule a size, drawn from a list of
+ * "size:weight" pairs like "40:70,1024:25,8192:5".
+ */
+void jtr_size_dist_init(char *size_dist)
+{
+  uint32_t rand_state = 88675123u;
+  int sizes[JTR_SIZE_MAX_SIZES];
+  int weights[JTR_SIZE_MAX_SIZES];
+  int num_sizes = 0;
+  int tot_weight = 0;
+  char *p = size_dist;
+  int r, n, k;
+
+  while (*p != '\0') {
+    SYSE(num_sizes >= JTR_SIZE_MAX_SIZES);
+    if (sscanf(p, "%d:%d%n", &sizes[num_sizes], &weights[num_sizes], &n) != 2
+        || sizes[num_sizes] <= 0 || weights[num_sizes] < 0) {
+      fprintf(stderr, "Bad size distribution '%s'\n", size_dist);
+      exit(1);
+    }
+    tot_weight += weights[num_sizes];
+    num_sizes ++;
+    p += n;
+    if (*p == ',') {
+      p++;
+    }
+  }
+  if (tot_weight == 0) {
+    fprintf(stderr, "Bad size distribution '%s'\n", size_dist);
+    exit(1);
+  }
+
+  jtr_pattern_size = (int *)jtr_mem_alloc(jtr_pattern_len * sizeof(int));
+  for (k = 0; k < jtr_pattern_len; k++) {
+    r = jtr_pattern_rand(&rand_state) % tot_weight;
+    for (n = 0; r >= weights[n]; n++) {
+      r -= weights[n];
+    }
+    jtr_pattern_size[k] = sizes[n];
+  }
+}  /* jtr_size_dist_init */
+
+
+/* Build the schedule. "pattern" gives the pauses:
+ *   fixed - "pause_ns" after every call.
+ *   burst:N:gap_ns[:pause_ns] - N calls "pause_ns" apart (default 0), then
+ *     "gap_ns" idle.
+ *   onoff:on_ns:off_ns:pause_ns - calls "pause_ns" apart for "on_ns", then
+ *     "off_ns" idle. (Same as a burst of on_ns/pause_ns calls.)
+ *   poisson:rate - random arrivals averaging "rate" calls per second
+ *     (at least JTR_PATTERN_MIN_RATE).
+ * "size_dist" (see jtr_size_dist_init()) gives the sizes, or NULL.
+ * "trace_file" is a pcap file giving both, replacing the other two.
+ * A call's burst position counts calls since the last gap of at least the
+ * average pause (for Poisson and traces). Pauses don't subtract the time
+ * taken by the call itself. With pattern "fixed" and no sizes or trace,
+ * there is no schedule.
+ */
+void jtr_pattern_init(char *pattern, char *size_dist, char *trace_file,
+                      int pause_ns)
+{
+  uint32_t rand_state = 2463534242u;  /* xorshift32; fixed for repeatability. */
+  int burst_n = 0, gap_ns = 0, on_ns = 0, rate = 0;
+  double mean_ns, u;
+  int pos;
+  int k;
+
+  jtr_pattern_len = 0;
+  jtr_pattern_size = NULL;
+  jtr_pattern_max_size = 0;
+
+  if (trace_file != NULL) {
+    jtr_trace_load(trace_file);
+    jtr_pattern_pos_from_gaps();
+  }
+  else {
+    if (pattern == NULL || strcmp(pattern, "fixed") == 0) {
+      if (size_dist == NULL) {
+        return;
+      }
+      burst_n = 1;  /* Fixed pause after every call. */
+      gap_ns = pause_ns;
+    }
+    else if (sscanf(pattern, "onoff:%d:%d:%d", &on_ns, &gap_ns, &pause_ns) == 3
+             && pause_ns > 0) {
+      burst_n = (on_ns / pause_ns > 0) ? (on_ns / pause_ns) : 1;
+    }
+    else if (sscanf(pattern, "burst:%d:%d:%d", &burst_n, &gap_ns,
+                    &pause_ns) >= 2) {
+      if (strchr(pattern + 6, ':') == strrchr(pattern + 6, ':')) {
+        pause_ns = 0;  /* No pause_ns given; back to back. */
+      }
+    }
+    else if (sscanf(pattern, "poisson:%d", &rate) != 1 || rate <= 0) {
+      fprintf(stderr, "Bad traffic pattern '%s'\n", pattern);
+      exit(1);
+    }
+    else if (rate < JTR_PATTERN_MIN_RATE) {
+      fprintf(stderr, "Poisson rate must be at least %d calls/sec\n",
+              JTR_PATTERN_MIN_RATE);
+      exit(1);
+    }
+
+    jtr_pattern_pause_ns = (int *)jtr_mem_alloc(
+      JTR_PATTERN_LEN * sizeof(int));
+    jtr_pattern_pos = (unsigned char *)jtr_mem_alloc(JTR_PATTERN_LEN);
+    if (rate > 0) {
+      mean_ns = (double)NANOS_PER_SEC / (double)rate;
+      jtr_pattern_len = JTR_PATTERN_LEN;
+      for (k = 0; k < jtr_pattern_len; k++) {
+        u = ((double)(jtr_pattern_rand(&rand_state) >> 8) + 1.0)
+            / 16777217.0;  /* (0,1) */
+        jtr_pattern_pause_ns[k] = (int)(-mean_ns * log(u));
+      }
+      jtr_pattern_pos_from_gaps();
+    }
+    else {
+      SYSE(burst_n <= 0 || burst_n > JTR_PATTERN_LEN);
+      jtr_pattern_len = (JTR_PATTERN_LEN / burst_n) * burst_n;
+      for (k = 0; k < jtr_pattern_len; k++) {
+        pos = k % burst_n;
+        jtr_pattern_pos[k] = (pos < JTR_PATTERN_MAX_POS) ?
+                             pos : JTR_PATTERN_MAX_POS - 1;
+        jtr_pattern_pause_ns[k] = (pos == burst_n - 1) ? gap_ns : pause_ns;
+      }
+    }
+
+    if (size_dist != NULL) {
+      jtr_size_dist_init(size_dist);
+    }
+  }
+
+  jtr_pattern_pos_histo.num_groups = 0;
+  for (k = 0; k < jtr_pattern_len; k++) {
+    if (jtr_pattern_pos[k] >= jtr_pattern_pos_histo.num_groups) {
+      jtr_pattern_pos_histo.num_groups = jtr_pattern_pos[k] + 1;
+    }
+    if (jtr_pattern_size != NULL
+        && jtr_pattern_size[k] > jtr_pattern_max_size) {
+      jtr_pattern_max_size = jtr_pattern_size[k];
+    }
+  }
+  jtr_pattern_size_histo.num_groups = (jtr_pattern_size == NULL) ? 0 :
+    jtr_size_class(jtr_pattern_max_size) + 1;
+  if (jtr_pattern_size != NULL) {
+    jtr_msg_next_size = jtr_pattern_size[0];  /* Each run starts at 0. */
+  }
+}  /* jtr_pattern_init */
+
+
+void jtr_group_histo_init(jtr_group_histo_t *gh)
+{
+  int i;
+
+  if (gh->num_groups == 0) {
+    return;
+  }
+  if (gh->buckets == NULL) {
+    gh->buckets = (int *)jtr_mem_alloc(
+      gh->num_groups * jtr_histo_num_buckets * sizeof(int));
+  }
+  for (i = 0; i < gh->num_groups * jtr_histo_num_buckets; i++) {
+    gh->buckets[i] = 0;
+  }
+  for (i = 0; i < gh->num_groups; i++) {
+    gh->samples[i] = 0;
+    gh->max_time[i] = 0;
+    gh->tot_time[i] = 0;
+  }
+}  /* jtr_group_histo_init */
+
+
+/* Called by jtr_histo_init() when there is a schedule. */
+void jtr_pattern_histo_init(void)
+{
+  jtr_group_histo_init(&jtr_pattern_pos_histo);
+  jtr_group_histo_init(&jtr_pattern_size_histo);
+}  /* jtr_pattern_histo_init */
+
+
+void jtr_group_histo_accum(jtr_group_histo_t *gh, int group, int sample_time)
+{
+  int bucket = sample_time / HISTO_GRANULARITY;
+
+  gh->samples[group] ++;
+  gh->tot_time[group] += sample_time;
+  if (sample_time > gh->max_time[group]) {
+    gh->max_time[group] = sample_time;
+  }
+  if (bucket < jtr_histo_num_buckets) {
+    gh->buckets[group * jtr_histo_num_buckets + bucket] ++;
+  }
+}  /* jtr_group_histo_accum */
+
+
+/* One call of a scheduled run, "k" being its index in the schedule.
+ * Samples go to the main histogram and to their position's and size
+ * class's histograms.
+ */
+void jtr_pattern_measure_one(int k, int timebase, int accum,
+                             app_cb_t app_cb, void *clientd)
+{
+  long long diff_ns;
+
+  if (jtr_pattern_size != NULL) {
+    jtr_msg_size = jtr_pattern_size[k];
+    jtr_msg_next_size = jtr_pattern_size[(k + 1) % jtr_pattern_len];
+  }
+
+  diff_ns = jtr_time_call_ns(timebase, app_cb, clientd);
+
+  if (accum) {
+    if (unlikely(diff_ns < 0)) {
+      jtr_neg_diffs ++;
+      diff_ns = 0;
+    }
+    jtr_histo_accum(diff_ns);
+    jtr_group_histo_accum(&jtr_pattern_pos_histo, jtr_pattern_pos[k],
+                          diff_ns);
+    if (jtr_pattern_size != NULL) {
+      jtr_group_histo_accum(&jtr_pattern_size_histo,
+                            jtr_size_class(jtr_pattern_size[k]), diff_ns);
+    }
+  }
+
+  jtr_spin_sleep_ns(jtr_pattern_pause_ns[k], timebase);
+}  /* jtr_pattern_measure_one */
+
+
+void jtr_group_histo_print(jtr_group_histo_t *gh, int group, char *label)
+{
+  int *buckets = &gh->buckets[group * jtr_histo_num_buckets];
+
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "%s: Samples=%d, Average=%lld, p50=%d, p99=%d, p99.9=%d,"
+           " Maximum=%d\n",
+           label, gh->samples[group], gh->tot_time[group] / gh->samples[group],
+           jtr_buckets_perc_ns(buckets, gh->samples[group], 50.0),
+           jtr_buckets_perc_ns(buckets, gh->samples[group], 99.0),
+           jtr_buckets_perc_ns(buckets, gh->samples[group], 99.9),
+           gh->max_time[group]);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+}  /* jtr_group_histo_print */
+
+
+/* Print latency by position in burst and by size class. */
+void jtr_pattern_print(void)
+{
+  char label[64];
+  int g;
+
+  if (jtr_pattern_len == 0 || jtr_pattern_pos_histo.samples[0] == 0) {
+    return;  /* Not a scheduled run. */
+  }
+  if (jtr_pattern_pos_histo.num_groups > 1) {
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Latency by position in burst (ns):\n");
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+    for (g = 0; g < jtr_pattern_pos_histo.num_groups; g++) {
+      if (jtr_pattern_pos_histo.samples[g] > 0) {
+        snprintf(label, sizeof(label), "pos=%d%s", g,
+                 (g == JTR_PATTERN_MAX_POS - 1) ? "+" : "");
+        jtr_group_histo_print(&jtr_pattern_pos_histo, g, label);
+      }
+    }
+  }
+  if (jtr_pattern_size_histo.num_groups > 0) {
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Latency by message size (ns):\n");
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+    for (g = 0; g < jtr_pattern_size_histo.num_groups; g++) {
+      if (jtr_pattern_size_histo.samples[g] > 0) {
+        snprintf(label, sizeof(label), "size=%d-%d", 1 << g,
+                 (g == JTR_SIZE_CLASSES - 1) ? 0x7fffffff : (2 << g) - 1);
+        jtr_group_histo_print(&jtr_pattern_size_histo, g, label);
+      }
+    }
+  }
+}  /* jtr_pattern_print */
+
+
+/* Steady-state detection and run-until-converged sampling.
+ * A warmup_loops of -1 replaces the fixed warm-up: calls are timed in
+ * windows of JTR_WARMUP_WINDOW, and measuring starts once the medians of
+ * the last JTR_WARMUP_STABLE_WINDOWS+1 windows no longer differ by more
+ * than their own noise (a change-point test on window medians).
+ * jtr_converge_init() makes jtr_measure_calls() repeat its measure_loops
+ * until the 95% confidence interval of a percentile is narrow enough.
+ */
+int jtr_warmup_detected = -1;  /* Samples of last detected warm-up. */
+int jtr_warmup_steady;  /* 0=hit JTR_WARMUP_MAX_LOOPS first. */
+double jtr_converge_perc = 0.0;  /* 0=off. */
+double jtr_converge_tol_pct;
+int jtr_converge_max_sec;
+int jtr_converge_batches;
+int jtr_converge_done;  /* 1=converged, 0=stopped by time limit. */
+double jtr_converge_secs;
+int jtr_converge_lo_ns;
+int jtr_converge_hi_ns;
+
+
+/* Parse "percentile:tolerance_pct:max_sec", e.g. "99.99:5:60". */
+void jtr_converge_init(char *converge)
+{
+  if (converge == NULL || strcmp(converge, "none") == 0) {
+    return;
+  }
+  jtr_converge_tol_pct = 5.0;
+  jtr_converge_max_sec = 60;
+  if (sscanf(converge, "%lf:%lf:%d", &jtr_converge_perc,
+             &jtr_converge_tol_pct, &jtr_converge_max_sec) < 1
+      || jtr_converge_perc <= 0.0 || jtr_converge_perc >= 100.0
+      || jtr_converge_tol_pct <= 0.0 || jtr_converge_max_sec <= 0) {
+    fprintf(stderr, "Bad converge spec '%s'\n", converge);
+    exit(1);
+  }
+}  /* jtr_converge_init */
+
+
+/* Time calls without accumulating until steady. Returns the number of
+ * calls made, which is also the next pattern index.
+ */
+int jtr_warmup_detect(int post_call_wait_ns, int timebase,
+                      app_cb_t app_cb, void *clientd)
+{
+  int window[JTR_WARMUP_WINDOW];
+  int medians[JTR_WARMUP_STABLE_WINDOWS + 1];
+  int spreads[JTR_WARMUP_STABLE_WINDOWS + 1];
+  int num_windows = 0;
+  int k = 0;
+  int i, w, lo, hi, noise;
+  long long diff_ns;
+
+  jtr_warmup_steady = 0;
+  while (k < JTR_WARMUP_MAX_LOOPS) {
+    for (i = 0; i < JTR_WARMUP_WINDOW; i++, k++) {
+      if (jtr_pattern_len > 0 && jtr_pattern_size != NULL) {
+        jtr_msg_size = jtr_pattern_size[k % jtr_pattern_len];
+        jtr_msg_next_size = jtr_pattern_size[(k + 1) % jtr_pattern_len];
+      }
+      diff_ns = jtr_time_call_ns(timebase, app_cb, clientd);
+      window[i] = (diff_ns < 0) ? 0 : (int)diff_ns;
+
+      if (jtr_pattern_len > 0) {
+        jtr_spin_sleep_ns(jtr_pattern_pause_ns[k % jtr_pattern_len],
+                          timebase);
+      } else if (likely(post_call_wait_ns >= 0)) {
+        jtr_spin_sleep_ns(post_call_wait_ns, timebase);
+      } else {
+        usleep(-post_call_wait_ns/1000);
+      }
+    }
+
+    /* Median, and the interquartile range as a robust noise estimate. */
+    qsort(window, JTR_WARMUP_WINDOW, sizeof(int), jtr_int_cmp);
+    w = num_windows % (JTR_WARMUP_STABLE_WINDOWS + 1);
+    medians[w] = window[JTR_WARMUP_WINDOW / 2];
+    spreads[w] = window[(JTR_WARMUP_WINDOW * 3) / 4]
+                 - window[JTR_WARMUP_WINDOW / 4];
+    num_windows ++;
+    if (num_windows < JTR_WARMUP_STABLE_WINDOWS + 1) {
+      continue;
+    }
+
+    /* The standard error of a window median is about 1.9*IQR/sqrt(N);
+     * allow three of them, but no less than a histogram bucket.
+     */
+    lo = hi = medians[0];
+    noise = 0;
+    for (w = 0; w <= JTR_WARMUP_STABLE_WINDOWS; w++) {
+      if (medians[w] < lo) lo = medians[w];
+      if (medians[w] > hi) hi = medians[w];
+      if (spreads[w] > noise) noise = spreads[w];
+    }
+    noise = (int)(3.0 * 1.9 * (double)noise / sqrt(JTR_WARMUP_WINDOW));
+    if (noise < HISTO_GRANULARITY) {
+      noise = HISTO_GRANULARITY;
+    }
+    if (hi - lo <= noise) {
+      jtr_warmup_steady = 1;
+      break;
+    }
+  }  /* while k */
+
+  jtr_warmup_detected = k;
+  return k;
+}  /* jtr_warmup_detect */
+
+
+/* Histogram value (ns) at 1-based "rank" in sorted order, or -1 if in the
+ * overflows. Uses the same bucket convention as jtr_buckets_perc_ns().
+ */
+int jtr_histo_rank_ns(int rank)
+{
+  int i = 0;
+  int tot_at_i_or_below = 0;
+
+  while (i < jtr_histo_num_buckets && tot_at_i_or_below < rank) {
+    tot_at_i_or_below += jtr_histo_buckets[i];
+    i++;
+  }
+  if (tot_at_i_or_below >= rank) {
+    return i * HISTO_GRANULARITY;
+  }
+  return -1;
+}  /* jtr_histo_rank_ns */
+
+
+/* Distribution-free 95% confidence interval of the percentile: the order
+ * statistics at ranks n*q -/+ 1.96*sqrt(n*q*(1-q)). Returns 1 when its
+ * width is within the tolerance (or within one histogram bucket).
+ */
+int jtr_converge_check(void)
+{
+  double q = jtr_converge_perc / 100.0;
+  double n, half;
+  int perc_ns, lo_rank, hi_rank;
+
+  jtr_histo_fold();
+  n = (double)jtr_histo_num_samples;
+  half = 1.96 * sqrt(n * q * (1.0 - q));
+  lo_rank = (int)floor(n * q - half);
+  hi_rank = (int)ceil(n * q + half) + 1;
+
+  jtr_converge_lo_ns = -1;
+  jtr_converge_hi_ns = -1;
+  if (lo_rank < 1 || hi_rank > jtr_histo_num_samples) {
+    return 0;  /* Not enough samples to bound this percentile. */
+  }
+  jtr_converge_lo_ns = jtr_histo_rank_ns(lo_rank);
+  jtr_converge_hi_ns = jtr_histo_rank_ns(hi_rank);
+  perc_ns = jtr_histo_perc_ns(jtr_converge_perc);
+  if (jtr_converge_lo_ns < 0 || jtr_converge_hi_ns < 0 || perc_ns < 0) {
+    return 0;  /* In the overflows. */
+  }
+
+  return (jtr_converge_hi_ns - jtr_converge_lo_ns <= HISTO_GRANULARITY
+          || (double)(jtr_converge_hi_ns - jtr_converge_lo_ns)
+             <= (double)perc_ns * jtr_converge_tol_pct / 100.0);
+}  /* jtr_converge_check */
+
+
+void jtr_converge_print(void)
+{
+  if (jtr_warmup_detected >= 0) {
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Warmup: %s after %d samples\n",
+             jtr_warmup_steady ? "steady" : "NOT steady (limit)",
+             jtr_warmup_detected);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  }
+  if (jtr_converge_perc > 0.0 && jtr_converge_batches > 0) {
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Convergence: %s, %.3lf%% 95%% CI=[%d, %d] ns (tolerance=%.2lf%%),"
+             " batches=%d, samples=%d, secs=%.1lf\n",
+             jtr_converge_done ? "converged" : "NOT converged (limit)",
+             jtr_converge_perc, jtr_converge_lo_ns, jtr_converge_hi_ns,
+             jtr_converge_tol_pct, jtr_converge_batches,
+             jtr_histo_num_samples, jtr_converge_secs);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  }
+}  /* jtr_converge_print */
+
+
+/* Phase marks. A callback can stamp intermediate points with JTR_MARK(),
+ * splitting each sample into phases (e.g. message build, library logic,
+ * syscall). Phase p runs from the previous mark (or the start of the
+ * sample) to mark p; the "rest" runs from the last mark to the end.
+ * Each phase has its own histogram, so a tail can be attributed to a
+ * phase within one run. Timebase 1 only.
+ */
+long long jtr_mark_ticks[JTR_MARK_MAX_PHASES];
+unsigned int jtr_mark_set = 0;  /* Bit per phase stamped in this sample. */
+char *jtr_mark_labels[JTR_MARK_MAX_PHASES];
+jtr_group_histo_t jtr_mark_histo;  /* Group JTR_MARK_MAX_PHASES is "rest". */
+int jtr_mark_histo_live = 0;  /* jtr_mark_histo is for the current run. */
+int jtr_mark_enabled = 0;  /* Set by jtr_mark_names(). */
+
+
+/* Name the phases in order, e.g. "build,logic". The time after the last
+ * mark is reported as "rest". Also enables marks, so call it before
+ * jtr_histo_init().
+ */
+void jtr_mark_names(char *names)
+{
+  char *copy = strdup(names);
+  char *saveptr = NULL;
+  char *name;
+  int p = 0;
+
+  SYSE(copy == NULL);
+  for (name = strtok_r(copy, ",", &saveptr);
+       name != NULL && p < JTR_MARK_MAX_PHASES;
+       name = strtok_r(NULL, ",", &saveptr)) {
+    jtr_mark_labels[p] = name;
+    p++;
+  }
+  jtr_mark_enabled = 1;
+}  /* jtr_mark_names */
+
+
+/* Called by jtr_histo_init(). The phase histograms are allocated and
+ * cleared here, before the run, and only if marks are enabled.
+ */
+void jtr_mark_histo_init(void)
+{
+  if (jtr_mark_enabled) {
+    jtr_mark_histo.num_groups = JTR_MARK_MAX_PHASES + 1;
+    jtr_group_histo_init(&jtr_mark_histo);
+    jtr_mark_histo_live = 1;
+  }
+}  /* jtr_mark_histo_init */
+
+
+/* Split a sample that had marks into phases. Each phase pays for one
+ * RDTSC, like the whole sample does.
+ */
+void jtr_mark_accum(long long start_ticks, long long end_ticks, int accum)
+{
+  long long prev_ticks = start_ticks;
+  long long diff_ns;
+  int last_phase = -1;
+  int p;
+
+  if (accum && jtr_mark_histo_live) {
+    for (p = 0; p < JTR_MARK_MAX_PHASES; p++) {
+      if (jtr_mark_set & (1u << p)) {
+        diff_ns = ((jtr_mark_ticks[p] - prev_ticks) * NANOS_PER_SEC)
+                  / jtr_ticks_per_sec - jtr_rdtsc_cost;
+        jtr_group_histo_accum(&jtr_mark_histo, p,
+                              (diff_ns < 0) ? 0 : (int)diff_ns);
+        prev_ticks = jtr_mark_ticks[p];
+        last_phase = p;
+      }
+    }
+    if (last_phase >= 0) {
+      diff_ns = ((end_ticks - prev_ticks) * NANOS_PER_SEC)
+                / jtr_ticks_per_sec - jtr_rdtsc_cost;
+      jtr_group_histo_accum(&jtr_mark_histo, JTR_MARK_MAX_PHASES,
+                            (diff_ns < 0) ? 0 : (int)diff_ns);
+    }
+  }
+  jtr_mark_set = 0;
+}  /* jtr_mark_accum */
+
+
+/* Print latency by phase, if the callback used marks. */
+void jtr_mark_print(void)
+{
+  char label[64];
+  int p;
+
+  if (! jtr_mark_histo_live
+      || jtr_mark_histo.samples[JTR_MARK_MAX_PHASES] == 0) {
+    return;
+  }
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Latency by phase (ns):\n");
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  for (p = 0; p <= JTR_MARK_MAX_PHASES; p++) {
+    if (jtr_mark_histo.samples[p] == 0) {
+      continue;
+    }
+    if (p < JTR_MARK_MAX_PHASES) {
+      if (jtr_mark_labels[p] != NULL) {
+        snprintf(label, sizeof(label), "%s", jtr_mark_labels[p]);
+      } else {
+        snprintf(label, sizeof(label), "phase %d", p);
+      }
+    } else {
+      snprintf(label, sizeof(label), "rest");
+    }
+    jtr_group_histo_print(&jtr_mark_histo, p, label);
+  }
+}  /* jtr_mark_print */
+
+
+/* TSC correction table written by jtr_tscskew. For each CPU, its TSC
+ * minus the reference CPU's TSC is offset_ticks at at_ticks, changing by
+ * drift_ppb. One-way times between CPUs subtract jtr_tscskew_ticks().
+ */
+long long jtr_tsc_offset[JTR_TSC_MAX_CPUS];
+long long jtr_tsc_at[JTR_TSC_MAX_CPUS];
+double jtr_tsc_drift_ppb[JTR_TSC_MAX_CPUS];
+char jtr_tsc_known[JTR_TSC_MAX_CPUS];
+
+
+/* Load a correction table. Returns the number of CPUs in it.
+ */
+int jtr_tscskew_load(char *table_file)
+{
+  FILE *fp;
+  char line[512];
+  long long offset, error, at;
+  long long ticks_per_sec = 0;
+  double drift;
+  int cpu;
+  int num_cpus = 0;
+
+  fp = fopen(table_file, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Can't open skew table '%s': %s\n", table_file,
+            strerror(errno));
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (sscanf(line, "ticks_per_sec=%lld", &ticks_per_sec) == 1) {
+      continue;
+    }
+    if (sscanf(line, "cpu=%d offset_ticks=%lld error_ticks=%lld"
+                     " drift_ppb=%lf at_ticks=%lld",
+               &cpu, &offset, &error, &drift, &at) == 5
+        && cpu >= 0 && cpu < JTR_TSC_MAX_CPUS) {
+      jtr_tsc_offset[cpu] = offset;
+      jtr_tsc_drift_ppb[cpu] = drift;
+      jtr_tsc_at[cpu] = at;
+      jtr_tsc_known[cpu] = 1;
+      num_cpus ++;
+    }
+  }
+  fclose(fp);
+
+  if (ticks_per_sec > 0 && jtr_ticks_per_sec < 0x7fffffffffffffff
+      && llabs(ticks_per_sec - jtr_ticks_per_sec) > jtr_ticks_per_sec / 1000) {
+    fprintf(stderr, "Warning: skew table '%s' is from a %lld ticks/sec TSC\n",
+            table_file, ticks_per_sec);
+  }
+  return num_cpus;
+}  /* jtr_tscskew_load */
+
+
+/* Returns 1 if "cpu" is in the loaded table (so it must be pinned).
+ */
+int jtr_tscskew_known(int cpu)
+{
+  return (cpu >= 0 && cpu < JTR_TSC_MAX_CPUS && jtr_tsc_known[cpu]);
+}  /* jtr_tscskew_known */
+
+
+/* TSC(to_cpu) - TSC(from_cpu) at TSC value "ticks", or 0 if either CPU is
+ * not in the table.
+ */
+long long jtr_tscskew_ticks(int from_cpu, int to_cpu, long long ticks)
+{
+  double from_off, to_off;
+
+  if (from_cpu < 0 || from_cpu >= JTR_TSC_MAX_CPUS || ! jtr_tsc_known[from_cpu]
+      || to_cpu < 0 || to_cpu >= JTR_TSC_MAX_CPUS || ! jtr_tsc_known[to_cpu]) {
+    return 0;
+  }
+  from_off = (double)jtr_tsc_offset[from_cpu] + jtr_tsc_drift_ppb[from_cpu]
+             * (double)(ticks - jtr_tsc_at[from_cpu]) / 1e9;
+  to_off = (double)jtr_tsc_offset[to_cpu] + jtr_tsc_drift_ppb[to_cpu]
+           * (double)(ticks - jtr_tsc_at[to_cpu]) / 1e9;
+  return (long long)(to_off - from_off);
+}  /* jtr_tscskew_ticks */
+
+
+/* Interference ("noise") generators. Each one is a thread, off the test's
+ * core, that runs for "intensity" percent of every millisecond while a test
+ * is measuring, so the effect of a specific kind of neighbor can be measured.
+ */
+#define JTR_NOISE_MAX_THREADS 32
+#define JTR_NOISE_PERIOD_NS 1000000ll
+#define JTR_NOISE_MEMBW_BYTES (64 * 1024 * 1024)
+#define JTR_NOISE_L3_DEFAULT_BYTES (32 * 1024 * 1024)
+
+typedef struct jtr_noise_thread_s {
+  int kind;
+  int cpu_num;
+  int intensity;  /* Percent of each period spent generating noise. */
+  char *buf;
+  size_t buf_size;
+  pthread_t thread_id;
+} jtr_noise_thread_t;
+
+char *jtr_noise_kind_names[] = { "membw", "l3", "syscall", "smt", NULL };
+jtr_noise_thread_t jtr_noise_threads[JTR_NOISE_MAX_THREADS];
+int jtr_noise_num_threads = 0;
+volatile int jtr_noise_running = 0;
+
+
+/* Return the first SMT sibling of a CPU, or -1 if it has none.
+ */
+int jtr_smt_sibling(int cpu_num)
+{
+  char path[256];
+  char list[256];
+  FILE *fp;
+  char *p;
+  int cpu;
+
+  snprintf(path, sizeof(path),
+           "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list",
+           cpu_num);
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    return -1;
+  }
+  if (fgets(list, sizeof(list), fp) == NULL) {
+    list[0] = '\0';
+  }
+  fclose(fp);
+
+  /* List looks like "5,21" or "4-5". */
+  for (p = list; *p != '\0'; ) {
+    cpu = (int)strtol(p, &p, 10);
+    if (cpu != cpu_num) {
+      return cpu;
+    }
+    if (*p == ',' || *p == '-') {
+      p++;
+    } else {
+      break;
+    }
+  }
+  return -1;
+}  /* jtr_smt_sibling */
+
+
+/* Size of the last level cache, for sizing the L3 thrasher.
+ */
+size_t jtr_l3_size(void)
+{
+  FILE *fp;
+  long kbytes = 0;
+
+  fp = fopen("/sys/devices/system/cpu/cpu0/cache/index3/size", "r");
+  if (fp != NULL) {
+    if (fscanf(fp, "%ldK", &kbytes) != 1) {
+      kbytes = 0;
+    }
+    fclose(fp);
+  }
+  return (kbytes > 0) ? (size_t)kbytes * 1024 : JTR_NOISE_L3_DEFAULT_BYTES;
+}  /* jtr_l3_size */
+
+
+/* CPU topology, for placing helper threads by their relation to the
+ * measuring CPU instead of by CPU number (numbering schemes differ).
+ * Relations, closest first: same, smt (SMT sibling), l2 (shares the L2,
+ * another core), l3 (shares the L3 or CCX), socket (same package, other
+ * L3), and remote (other package).
+ */
+char *jtr_cpu_relation_names[] = {
+  "same", "smt", "l2", "l3", "socket", "remote", NULL };
+
+
+/* Return 1 if "cpu_b" is in the list of CPUs sharing cache "level" with
+ * "cpu_a" (data or unified caches only).
+ */
+int jtr_cache_shared(int cpu_a, int cpu_b, int level)
+{
+  char path[256];
+  char buf[1024];
+  int index;
+
+  for (index = 0; index < 8; index++) {
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index%d/level",
+             cpu_a, index);
+    jtr_read_sys(path, NULL, buf, sizeof(buf));
+    if (strcmp(buf, "?") == 0) {
+      break;
+    }
+    if (atoi(buf) != level) {
+      continue;
+    }
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index%d/type",
+             cpu_a, index);
+    jtr_read_sys(path, NULL, buf, sizeof(buf));
+    if (strcmp(buf, "Instruction") == 0) {
+      continue;
+    }
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+             cpu_a, index);
+    jtr_read_sys(path, NULL, buf, sizeof(buf));
+    return jtr_cpu_in_list(buf, cpu_b);
+  }
+  return 0;
+}  /* jtr_cache_shared */
+
+
+/* Closest relation of "cpu_b" to "cpu_a"; an index into
+ * jtr_cpu_relation_names.
+ */
+int jtr_cpu_relation(int cpu_a, int cpu_b)
+{
+  char path[256];
+  char buf[1024];
+  char pkg_a[32], pkg_b[32];
+
+  if (cpu_a == cpu_b) {
+    return 0;
+  }
+  snprintf(path, sizeof(path),
+           "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list",
+           cpu_a);
+  jtr_read_sys(path, NULL, buf, sizeof(buf));
+  if (jtr_cpu_in_list(buf, cpu_b)) {
+    return 1;
+  }
+  if (jtr_cache_shared(cpu_a, cpu_b, 2)) {
+    return 2;
+  }
+  if (jtr_cache_shared(cpu_a, cpu_b, 3)) {
+    return 3;
+  }
+  snprintf(path, sizeof(path),
+           "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu_a);
+  jtr_read_sys(path, NULL, pkg_a, sizeof(pkg_a));
+  snprintf(path, sizeof(path),
+           "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu_b);
+  jtr_read_sys(path, NULL, pkg_b, sizeof(pkg_b));
+  return (strcmp(pkg_a, pkg_b) == 0) ? 4 : 5;
+}  /* jtr_cpu_relation */
+
+
+/* Find an online CPU with one of "relations" (comma-separated, tried in
+ * order, e.g. "l3,socket"; a number is taken as that CPU) to "cpu_num".
+ * CPU 0 is used only if nothing else qualifies. Returns -1 if none.
+ */
+int jtr_cpu_related(int cpu_num, char *relations)
+{
+  char *copy = strdup(relations);
+  char *save = NULL;
+  char *relation;
+  char path[256];
+  char online[16];
+  int num_cpus = (int)sysconf(_SC_NPROCESSORS_CONF);
+  int rel, cpu, pass;
+  int found = -1;
+
+  for (relation = strtok_r(copy, ",", &save);
+       relation != NULL && found < 0;
+       relation = strtok_r(NULL, ",", &save)) {
+    if (relation[0] >= '0' && relation[0] <= '9') {
+      found = atoi(relation);
+      break;
+    }
+    for (rel = 0; jtr_cpu_relation_names[rel] != NULL; rel++) {
+      if (strcmp(relation, jtr_cpu_relation_names[rel]) == 0) {
+        break;
+      }
+    }
+    if (jtr_cpu_relation_names[rel] == NULL) {
+      fprintf(stderr, "Unknown CPU relation '%s'\n", relation);
+      exit(1);
+    }
+
+    for (pass = 0; pass < 2 && found < 0; pass++) {
+      for (cpu = 0; cpu < num_cpus && found < 0; cpu++) {
+        if (cpu == 0 && pass == 0) {
+          continue;  /* Housekeeping CPU; last resort. */
+        }
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/online",
+                 cpu);
+        jtr_read_sys(path, NULL, online, sizeof(online));
+        if (strcmp(online, "0") != 0 && jtr_cpu_relation(cpu_num, cpu) == rel) {
+          found = cpu;
+        }
+      }
+    }
+  }
+  free(copy);
+  return found;
+}  /* jtr_cpu_related */
+
+
+/* One burst of noise. Each kind does a small, fixed amount of work so the
+ * duty-cycle check in the caller stays responsive.
+ */
+void jtr_noise_burst(jtr_noise_thread_t *nt, size_t *pos)
+{
+  volatile int spin;
+  size_t i, idx;
+  size_t half;
+
+  switch (nt->kind) {
+    case 0:  /* membw: stream 1MB copies across a large buffer. */
+      half = nt->buf_size / 2;
+      memcpy(&nt->buf[*pos], &nt->buf[half + *pos], 1024 * 1024);
+      *pos = (*pos + 1024 * 1024) % half;
+      break;
+    case 1:  /* l3: dirty pseudo-random cache lines across 2x the L3. */
+      idx = *pos;
+      for (i = 0; i < 4096; i++) {
+        idx = (idx * 6364136223846793005ull + 1442695040888963407ull);
+        nt->buf[((idx >> 20) % (nt->buf_size / 64)) * 64] ++;
+      }
+      *pos = idx;
+      break;
+    case 2:  /* syscall: cheap kernel entries. */
+      for (i = 0; i < 100; i++) {
+        syscall(SYS_getppid);
+      }
+      break;
+    case 3:  /* smt: keep the sibling hyperthread's pipeline busy. */
+      for (spin = 0; spin < 10000; spin++) { }
+      break;
+  }  /* switch kind */
+}  /* jtr_noise_burst */
+
+
+void *jtr_noise_thread(void *arg)
+{
+  jtr_noise_thread_t *nt = (jtr_noise_thread_t *)arg;
+  struct timespec ts;  /* tv_sec, tv_nsec */
+  struct timespec sleep_ts;
+  long long period_start_ns;
+  long long cur_ns;
+  long long busy_ns = (JTR_NOISE_PERIOD_NS * nt->intensity) / 100;
+  size_t pos = 0;
+
+  while (jtr_noise_running) {
+    SYSE(clock_gettime(CLOCK_MONOTONIC, &ts));
+    period_start_ns = ((long long)ts.tv_sec * NANOS_PER_SEC)
+                      + (long long)ts.tv_nsec;
+    do {
+      jtr_noise_burst(nt, &pos);
+      SYSE(clock_gettime(CLOCK_MONOTONIC, &ts));
+      cur_ns = ((long long)ts.tv_sec * NANOS_PER_SEC) + (long long)ts.tv_nsec;
+    } while (cur_ns - period_start_ns < busy_ns);
+
+    if (busy_ns < JTR_NOISE_PERIOD_NS) {
+      sleep_ts.tv_sec = 0;
+      sleep_ts.tv_nsec = JTR_NOISE_PERIOD_NS - (cur_ns - period_start_ns);
+      if (sleep_ts.tv_nsec > 0) {
+        nanosleep(&sleep_ts, NULL);
+      }
+    }
+  }
+
+  return NULL;
+}  /* jtr_noise_thread */
+
+
+/* Start the noise threads described by "profile", a comma-separated list of
+ * "kind[:cpu_num[:intensity]]" where kind is membw, l3, syscall, or smt.
+ * Intensity is percent (default 100). For smt, cpu_num defaults to the SMT
+ * sibling of test_cpu_num; other kinds without a cpu_num run on any online
+ * CPU except test_cpu_num. The threads never inherit the caller's CPU or
+ * real-time priority, at which a generator would starve the measurement.
+ * An empty profile or "none" starts nothing.
+ */
+void jtr_noise_start(char *profile, int test_cpu_num)
+{
+  char *copy = strdup(profile);
+  char *save_gen = NULL;
+  char *gen;
+  char *field;
+  jtr_noise_thread_t *nt;
+  pthread_attr_t attr;
+  struct sched_param sched_parameter;
+  cpu_set_t cpu_set;
+  int i, cpu;
+
+  SYSE(jtr_noise_running);  /* Already started. */
+  jtr_noise_num_threads = 0;
+
+  for (gen = strtok_r(copy, ",", &save_gen); gen != NULL;
+       gen = strtok_r(NULL, ",", &save_gen)) {
+    if (strcmp(gen, "none") == 0) {
+      continue;
+    }
+    SYSE(jtr_noise_num_threads >= JTR_NOISE_MAX_THREADS);
+    nt = &jtr_noise_threads[jtr_noise_num_threads];
+    memset(nt, 0, sizeof(*nt));
+    nt->cpu_num = -1;
+    nt->intensity = 100;
+
+    field = strchr(gen, ':');
+    if (field != NULL) {
+      *field = '\0';
+      field++;
+      nt->cpu_num = atoi(field);
+      field = strchr(field, ':');
+      if (field != NULL) {
+        nt->intensity = atoi(field + 1);
+      }
+    }
+    for (nt->kind = 0; jtr_noise_kind_names[nt->kind] != NULL; nt->kind++) {
+      if (strcmp(gen, jtr_noise_kind_names[nt->kind]) == 0) {
+        break;
+      }
+    }
+    if (jtr_noise_kind_names[nt->kind] == NULL) {
+      fprintf(stderr, "Unknown noise kind '%s'\n", gen);
+      exit(1);
+    }
+    if (nt->kind == 3 && nt->cpu_num < 0) {
+      nt->cpu_num = jtr_smt_sibling(test_cpu_num);
+      if (nt->cpu_num < 0) {
+        fprintf(stderr, "CPU %d has no SMT sibling; give smt a cpu_num\n",
+                test_cpu_num);
+        exit(1);
+      }
+    }
+    ASSRT(nt->intensity > 0 && nt->intensity <= 100);
+
+    if (nt->kind == 0) {
+      nt->buf_size = JTR_NOISE_MEMBW_BYTES;
+    } else if (nt->kind == 1) {
+      nt->buf_size = 2 * jtr_l3_size();
+    }
+    if (nt->buf_size > 0) {
+      nt->buf = (char *)malloc(nt->buf_size);
+      SYSE(nt->buf == NULL);
+      memset(nt->buf, 1, nt->buf_size);  /* Page it in before measuring. */
+    }
+    jtr_noise_num_threads ++;
+  }
+  free(copy);
+
+  jtr_noise_running = 1;
+  for (i = 0; i < jtr_noise_num_threads; i++) {
+    nt = &jtr_noise_threads[i];
+    CPU_ZERO(&cpu_set);
+    if (nt->cpu_num >= 0) {
+      CPU_SET(nt->cpu_num, &cpu_set);
+    } else {
+      for (cpu = 0; cpu < sysconf(_SC_NPROCESSORS_ONLN) && cpu < CPU_SETSIZE;
+           cpu++) {
+        CPU_SET(cpu, &cpu_set);
+      }
+      if (test_cpu_num >= 0) {
+        CPU_CLR(test_cpu_num, &cpu_set);
+      }
+      if (CPU_COUNT(&cpu_set) == 0) {
+        fprintf(stderr, "No CPU for %s noise besides the test's cpu %d\n",
+                jtr_noise_kind_names[nt->kind], test_cpu_num);
+        exit(1);
+      }
+    }
+
+    memset(&sched_parameter, 0, sizeof(sched_parameter));
+    SYSE(pthread_attr_init(&attr));
+    SYSE(pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED));
+    SYSE(pthread_attr_setschedpolicy(&attr, SCHED_OTHER));
+    SYSE(pthread_attr_setschedparam(&attr, &sched_parameter));
+    SYSE(pthread_attr_setaffinity_np(&attr, sizeof(cpu_set), &cpu_set));
+    SYSE(pthread_create(&nt->thread_id, &attr, jtr_noise_thread, nt));
+    SYSE(pthread_attr_destroy(&attr));
+  }
+}  /* jtr_noise_start */
+
+
+/* Split a slash-separated list of noise profiles (see jtr_noise_start())
+ * into "profiles". Returns the number of profiles.
+ */
+int jtr_noise_split(char *profile_list, char **profiles, int max_profiles)
+{
+  char *copy = strdup(profile_list);
+  char *save = NULL;
+  char *profile;
+  int num_profiles = 0;
+
+  for (profile = strtok_r(copy, "/", &save); profile != NULL;
+       profile = strtok_r(NULL, "/", &save)) {
+    SYSE(num_profiles >= max_profiles);
+    profiles[num_profiles] = profile;  /* Points into copy; never freed. */
+    num_profiles ++;
+  }
+  SYSE(num_profiles == 0);
+  return num_profiles;
+}  /* jtr_noise_split */
+
+
+/* Stop and clean up all noise threads.
+ */
+void jtr_noise_stop(void)
+{
+  int i;
+
+  jtr_noise_running = 0;
+  for (i = 0; i < jtr_noise_num_threads; i++) {
+    SYSE(pthread_join(jtr_noise_threads[i].thread_id, NULL));
+    free(jtr_noise_threads[i].buf);
+  }
+  jtr_noise_num_threads = 0;
+}  /* jtr_noise_stop */
+
+
+/* Probe API, for timing code paths inside an application that links
+ * libjtr. See JTR_PROBE_BEGIN()/JTR_PROBE_END() in jtr.h.
+ */
+int jtr_probe_num_probes = 0;
+int jtr_probe_histo_buckets;  /* Size of the ns histogram for snapshots. */
+int jtr_probe_num_buckets;    /* Tick buckets per probe per thread. */
+int jtr_probe_shift;
+volatile int jtr_probe_epoch = 1;  /* Bumped by jtr_probe_reset(). */
+jtr_probe_thread_t *jtr_probe_threads[JTR_PROBE_MAX_THREADS];
+int jtr_probe_num_threads = 0;
+pthread_key_t jtr_probe_key;  /* Frees the thread's slot when it exits. */
+jtr_probe_thread_t jtr_probe_discard;  /* For threads beyond the slots. */
+int jtr_probe_discard_warned = 0;
+pthread_once_t jtr_calibrate_once_control = PTHREAD_ONCE_INIT;
+JTR_TLS long long jtr_probe_start[JTR_PROBE_MAX_PROBES];
+JTR_TLS jtr_probe_thread_t *jtr_probe_self = NULL;
+
+
+void jtr_calibrate_20(void)
+{
+  int i;
+
+  for (i = 0; i < 20; i++) {
+    jtr_calibrate();
+  }
+}  /* jtr_calibrate_20 */
+
+
+/* Calibrate the first time any thread calls this; later calls return
+ * immediately (after the first one has finished).
+ */
+void jtr_calibrate_once(void)
+{
+  SYSE(pthread_once(&jtr_calibrate_once_control, jtr_calibrate_20));
+}  /* jtr_calibrate_once */
+
+
+/* Thread-exit destructor: give the slot up for the next new thread. Its
+ * counts stay in the slot, and keep being merged by snapshots; histograms
+ * add, so the next owner just counts on top of them.
+ */
+void jtr_probe_thread_exit(void *arg)
+{
+  jtr_probe_thread_t *pt = (jtr_probe_thread_t *)arg;
+
+  __atomic_store_n(&pt->in_use, 0, __ATOMIC_RELEASE);
+}  /* jtr_probe_thread_exit */
+
+
+/* Set up the probes. Call once, before any thread uses a probe.
+ * "histo_buckets" is the size of the ns histogram that jtr_probe_snapshot()
+ * fills (HISTO_GRANULARITY ns each). Probes use RDTSC, so the TSC must be
+ * invariant and synchronized across the cores the threads run on.
+ */
+void jtr_probe_init(int num_probes, int histo_buckets)
+{
+  long long ticks_per_bucket;
+  long long max_ticks;
+
+  ASSRT(jtr_probe_num_probes == 0);  /* Only once. */
+  ASSRT(num_probes > 0 && num_probes <= JTR_PROBE_MAX_PROBES);
+  jtr_calibrate_once();
+
+  /* Tick buckets no wider than an ns bucket, as a power of two. */
+  ticks_per_bucket = (HISTO_GRANULARITY * jtr_ticks_per_sec) / NANOS_PER_SEC;
+  jtr_probe_shift = 0;
+  while ((2ll << jtr_probe_shift) <= ticks_per_bucket) {
+    jtr_probe_shift ++;
+  }
+  max_ticks = ((histo_buckets * HISTO_GRANULARITY + jtr_rdtsc_cost)
+               * jtr_ticks_per_sec) / NANOS_PER_SEC + 1;
+  jtr_probe_num_buckets = (int)(max_ticks >> jtr_probe_shift) + 1;
+  jtr_probe_histo_buckets = histo_buckets;
+  jtr_probe_num_probes = num_probes;
+
+  SYSE(pthread_key_create(&jtr_probe_key, jtr_probe_thread_exit));
+  jtr_probe_discard.buckets = (int *)malloc((size_t)num_probes
+                                            * jtr_probe_num_buckets
+                                            * sizeof(int));
+  SYSE(jtr_probe_discard.buckets == NULL);
+}  /* jtr_probe_init */
+
+
+/* Find a slot for the calling thread: one freed by an exited thread, else
+ * a new one. Returns NULL if all JTR_PROBE_MAX_THREADS are taken.
+ */
+jtr_probe_thread_t *jtr_probe_thread_register(size_t buckets_size)
+{
+  jtr_probe_thread_t *pt;
+  int num_threads;
+  int free_flag;
+  int slot;
+
+  num_threads = __atomic_load_n(&jtr_probe_num_threads, __ATOMIC_ACQUIRE);
+  if (num_threads > JTR_PROBE_MAX_THREADS) {
+    num_threads = JTR_PROBE_MAX_THREADS;
+  }
+  for (slot = 0; slot < num_threads; slot++) {
+    pt = __atomic_load_n(&jtr_probe_threads[slot], __ATOMIC_ACQUIRE);
+    free_flag = 0;
+    if (pt != NULL
+        && __atomic_compare_exchange_n(&pt->in_use, &free_flag, 1, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+      return pt;
+    }
+  }
+
+  slot = __atomic_fetch_add(&jtr_probe_num_threads, 1, __ATOMIC_ACQ_REL);
+  if (slot >= JTR_PROBE_MAX_THREADS) {
+    return NULL;
+  }
+  pt = (jtr_probe_thread_t *)malloc(sizeof(jtr_probe_thread_t));
+  SYSE(pt == NULL);
+  pt->buckets = (int *)malloc(buckets_size);
+  SYSE(pt->buckets == NULL);
+  pt->epoch = 0;
+  pt->in_use = 1;
+  __atomic_store_n(&jtr_probe_threads[slot], pt, __ATOMIC_RELEASE);
+  return pt;
+}  /* jtr_probe_thread_register */
+
+
+/* Slow path of JTR_PROBE_END(): register the calling thread on its first
+ * probe, and clear its histograms after a jtr_probe_reset(). A thread that
+ * finds no free slot counts into jtr_probe_discard, which is never
+ * reported, rather than abort the process.
+ */
+void jtr_probe_thread_sync(void)
+{
+  jtr_probe_thread_t *pt = jtr_probe_self;
+  size_t buckets_size;
+  int epoch;
+
+  ASSRT(jtr_probe_num_probes > 0);  /* jtr_probe_init() not called. */
+  buckets_size = (size_t)jtr_probe_num_probes * jtr_probe_num_buckets
+                 * sizeof(int);
+  if (pt == NULL) {
+    pt = jtr_probe_thread_register(buckets_size);
+    if (pt == NULL) {
+      if (! __atomic_exchange_n(&jtr_probe_discard_warned, 1,
+                                __ATOMIC_RELAXED)) {
+        fprintf(stderr, "Warning, over %d probing threads; not probing"
+                " the rest\n", JTR_PROBE_MAX_THREADS);
+      }
+      pt = &jtr_probe_discard;
+    } else {
+      SYSE(pthread_setspecific(jtr_probe_key, pt));
+    }
+    jtr_probe_self = pt;
+  }
+  if (pt == &jtr_probe_discard) {
+    /* Shared and never read; just stop coming back here. */
+    __atomic_store_n(&pt->epoch, jtr_probe_epoch, __ATOMIC_RELAXED);
+    return;
+  }
+
+  epoch = __atomic_load_n(&jtr_probe_epoch, __ATOMIC_ACQUIRE);
+  if (pt->epoch != epoch) {
+    memset(pt->buckets, 0, buckets_size);  /* Also pages them in. */
+    memset(pt->stats, 0, sizeof(pt->stats));
+    __atomic_store_n(&pt->epoch, epoch, __ATOMIC_RELEASE);
+  }
+}  /* jtr_probe_thread_sync */
+
+
+/* Slow path of JTR_PROBE_END() for a duration beyond the tick buckets
+ * (or negative, if the thread moved to a core with a different TSC).
+ */
+void jtr_probe_overflow(int id, long long diff_ticks)
+{
+  jtr_probe_stats_t *stats = &jtr_probe_self->stats[id];
+  long long diff_ns;
+
+  diff_ns = (diff_ticks * NANOS_PER_SEC) / jtr_ticks_per_sec;
+  diff_ns -= jtr_rdtsc_cost;  /* Correct for measurement cost. */
+  if (diff_ns < 0) {
+    stats->neg_diffs ++;
+    return;
+  }
+  stats->samples ++;
+  stats->tot_time += diff_ns;
+  if (diff_ns > stats->max_time) {
+    stats->max_time = (int)diff_ns;
+  }
+}  /* jtr_probe_overflow */
+
+
+/* Merge every thread's histogram for probe "id" into the jtr_histo_*
+ * histogram, for jtr_histo_print_all(), jtr_histo_brief(), etc.
+ * Safe while the probes are running; only one thread should take
+ * snapshots. Returns the number of samples.
+ */
+int jtr_probe_snapshot(int id)
+{
+  return jtr_probe_snapshot_ids(id, 1, 1);
+}  /* jtr_probe_snapshot */
+
+
+/* Like jtr_probe_snapshot(), but merges "num_ids" probes: "id",
+ * "id+stride", "id+2*stride", ... (e.g. one probe per thread).
+ */
+int jtr_probe_snapshot_ids(int id, int num_ids, int stride)
+{
+  jtr_probe_thread_t *pt;
+  int epoch = __atomic_load_n(&jtr_probe_epoch, __ATOMIC_ACQUIRE);
+  int num_threads;
+  int t, n, p;
+
+  ASSRT(id >= 0 && id + (num_ids - 1) * stride < jtr_probe_num_probes);
+  jtr_histo_init(jtr_probe_histo_buckets);
+
+  num_threads = __atomic_load_n(&jtr_probe_num_threads, __ATOMIC_ACQUIRE);
+  if (num_threads > JTR_PROBE_MAX_THREADS) {
+    num_threads = JTR_PROBE_MAX_THREADS;
+  }
+  for (t = 0; t < num_threads; t++) {
+    pt = __atomic_load_n(&jtr_probe_threads[t], __ATOMIC_ACQUIRE);
+    /* Skip threads still registering, or not cleared since a reset. */
+    if (pt == NULL || __atomic_load_n(&pt->epoch, __ATOMIC_ACQUIRE) != epoch) {
+      continue;
+    }
+    for (n = 0, p = id; n < num_ids; n++, p += stride) {
+      jtr_histo_add_ticks(&pt->buckets[p * jtr_probe_num_buckets],
+                          jtr_probe_num_buckets, jtr_probe_shift, 0);
+
+      /* Overflows; negative diffs count as 0 ns, like jtr_measure_one(). */
+      jtr_neg_diffs += pt->stats[p].neg_diffs;
+      if (pt->stats[p].neg_diffs > 0) {
+        jtr_histo_buckets[0] += pt->stats[p].neg_diffs;
+        jtr_histo_num_samples += pt->stats[p].neg_diffs;
+        jtr_histo_min_time = 0;
+      }
+      if (pt->stats[p].samples > 0) {
+        jtr_histo_overflows += pt->stats[p].samples;
+        jtr_histo_num_samples += pt->stats[p].samples;
+        jtr_histo_tot_time += pt->stats[p].tot_time;
+        if (pt->stats[p].max_time > jtr_histo_max_time) {
+          jtr_histo_max_time = pt->stats[p].max_time;
+        }
+      }
+    }
+  }
+
+  jtr_histo_fold();  /* Average. */
+  return jtr_histo_num_samples;
+}  /* jtr_probe_snapshot_ids */
+
+
+/* Start all probe histograms over. Safe to call from any thread; each
+ * probing thread clears its own histograms at its next JTR_PROBE_END().
+ */
+void jtr_probe_reset(void)
+{
+  __atomic_add_fetch(&jtr_probe_epoch, 1, __ATOMIC_ACQ_REL);
+}  /* jtr_probe_reset */
+
+
+/* Live statistics. A publisher thread, kept off the measuring CPU, copies
+ * the histogram into a POSIX shared-memory segment every
+ * JTR_LIVE_PERIOD_NS for jtr_top. The measuring thread makes no extra
+ * syscalls and takes no locks; it only bumps jtr_histo_gen around the rare
+ * rewrites of the histogram (init and fold), and the publisher skips a
+ * period if one happened while it was copying.
+ */
+#define JTR_LIVE_PERIOD_NS 100000000ll  /* 10 per second. */
+
+jtr_live_t *jtr_live = NULL;  /* The shared segment. */
+jtr_live_t *jtr_live_stage = NULL;  /* Private copy being built. */
+char jtr_live_name[64];
+volatile int jtr_live_running = 0;
+pthread_t jtr_live_thread_id;
+
+
+/* Build a consistent copy of the current histogram in jtr_live_stage,
+ * including ticks not yet folded. Returns 0 if the histogram was rewritten
+ * while copying.
+ */
+int jtr_live_stage_histo(void)
+{
+  jtr_live_t *st = jtr_live_stage;
+  unsigned int gen;
+  long long diff_ticks;
+  long long diff_ns;
+  int num_buckets;
+  int count;
+  int bucket;
+  int i;
+
+  gen = __atomic_load_n(&jtr_histo_gen, __ATOMIC_ACQUIRE);
+  if ((gen & 1) != 0 || jtr_histo_buckets == NULL) {
+    return 0;
+  }
+
+  num_buckets = jtr_histo_num_buckets;
+  if (num_buckets > JTR_LIVE_MAX_BUCKETS) {
+    num_buckets = JTR_LIVE_MAX_BUCKETS;
+  }
+  st->histo_num_buckets = num_buckets;
+  st->run = jtr_histo_runs;
+  st->num_samples = jtr_histo_num_samples;
+  st->overflows = jtr_histo_overflows;
+  st->neg_diffs = jtr_neg_diffs;
+  st->min_time = jtr_histo_min_time;
+  st->max_time = jtr_histo_max_time;
+  st->tot_time = jtr_histo_tot_time;
+  for (i = 0; i < num_buckets; i++) {
+    st->buckets[i] = __atomic_load_n(&jtr_histo_buckets[i], __ATOMIC_RELAXED);
+  }
+  for (i = num_buckets; i < jtr_histo_num_buckets; i++) {
+    st->overflows += __atomic_load_n(&jtr_histo_buckets[i], __ATOMIC_RELAXED);
+  }
+
+  /* Timebase 1 samples not yet folded (see jtr_histo_fold()). */
+  for (i = 0; jtr_tick_buckets != NULL && i < jtr_tick_num_buckets; i++) {
+    count = __atomic_load_n(&jtr_tick_buckets[i], __ATOMIC_RELAXED);
+    if (count == 0) {
+      continue;
+    }
+    diff_ticks = ((long long)i << jtr_tick_shift)
+                 + ((1ll << jtr_tick_shift) >> 1);
+    diff_ns = (diff_ticks * NANOS_PER_SEC) / jtr_ticks_per_sec;
+    diff_ns -= jtr_rdtsc_cost;
+    if (diff_ns < 0) {
+      st->neg_diffs += count;
+      diff_ns = 0;
+    }
+    bucket = diff_ns / HISTO_GRANULARITY;
+    if (bucket < num_buckets) {
+      st->buckets[bucket] += count;
+    } else {
+      st->overflows += count;
+    }
+    if (diff_ns < st->min_time) {
+      st->min_time = diff_ns;
+    }
+    if (diff_ns > st->max_time) {
+      st->max_time = diff_ns;
+    }
+    st->tot_time += diff_ns * count;
+    st->num_samples += count;
+  }
+
+  return (__atomic_load_n(&jtr_histo_gen, __ATOMIC_ACQUIRE) == gen);
+}  /* jtr_live_stage_histo */
+
+
+/* Copy the staged statistics to the shared segment under the seqlock.
+ */
+void jtr_live_publish(void)
+{
+  jtr_live_t *st = jtr_live_stage;
+  struct timespec ts;  /* tv_sec, tv_nsec */
+
+  SYSE(clock_gettime(CLOCK_REALTIME, &ts));
+
+  __atomic_store_n(&jtr_live->seq, jtr_live->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);  /* Odd: readers retry. */
+
+  jtr_live->publish_ns = ((long long)ts.tv_sec * NANOS_PER_SEC)
+                         + (long long)ts.tv_nsec;
+  jtr_live->run = st->run;
+  jtr_live->num_samples = st->num_samples;
+  jtr_live->overflows = st->overflows;
+  jtr_live->neg_diffs = st->neg_diffs;
+  jtr_live->min_time = st->min_time;
+  jtr_live->max_time = st->max_time;
+  jtr_live->tot_time = st->tot_time;
+  jtr_live->histo_num_buckets = st->histo_num_buckets;
+  memcpy(jtr_live->buckets, st->buckets,
+         st->histo_num_buckets * sizeof(int));
+
+  __atomic_store_n(&jtr_live->seq, jtr_live->seq + 1, __ATOMIC_RELEASE);
+}  /* jtr_live_publish */
+
+
+void *jtr_live_thread(void *arg)
+{
+  struct timespec sleep_ts;
+
+  sleep_ts.tv_sec = JTR_LIVE_PERIOD_NS / NANOS_PER_SEC;
+  sleep_ts.tv_nsec = JTR_LIVE_PERIOD_NS % NANOS_PER_SEC;
+
+  while (jtr_live_running) {
+    nanosleep(&sleep_ts, NULL);
+    if (jtr_live_stage_histo()) {
+      jtr_live_publish();
+    }
+  }
+
+  return NULL;
+}  /* jtr_live_thread */
+
+
+/* Create the segment "/jtr_live.<pid>" and start publishing. The publisher
+ * runs on any online CPU except measure_cpu_num (-1 if not pinned).
+ */
+void jtr_live_start(char *tool, char *descr, int measure_cpu_num)
+{
+  cpu_set_t cpu_set;
+  int fd;
+  int i;
+
+  snprintf(jtr_live_name, sizeof(jtr_live_name), "%s.%d",
+           JTR_LIVE_PREFIX, (int)getpid());
+  fd = shm_open(jtr_live_name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+  SYSE(fd == -1);
+  SYSE(ftruncate(fd, sizeof(jtr_live_t)));
+  jtr_live = (jtr_live_t *)mmap(NULL, sizeof(jtr_live_t),
+                                PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  SYSE(jtr_live == MAP_FAILED);
+  close(fd);
+
+  jtr_live_stage = (jtr_live_t *)malloc(sizeof(jtr_live_t));
+  SYSE(jtr_live_stage == NULL);
+
+  jtr_live->seq = 0;
+  jtr_live->magic = JTR_LIVE_MAGIC;
+  jtr_live->pid = (int)getpid();
+  snprintf(jtr_live->tool, sizeof(jtr_live->tool), "%s", tool);
+  snprintf(jtr_live->descr, sizeof(jtr_live->descr), "%s", descr);
+
+  jtr_live_running = 1;
+  SYSE(pthread_create(&jtr_live_thread_id, NULL, jtr_live_thread, NULL));
+  if (measure_cpu_num >= 0) {
+    CPU_ZERO(&cpu_set);
+    for (i = 0; i < sysconf(_SC_NPROCESSORS_ONLN) && i < CPU_SETSIZE; i++) {
+      CPU_SET(i, &cpu_set);
+    }
+    CPU_CLR(measure_cpu_num, &cpu_set);
+    if (CPU_COUNT(&cpu_set) > 0) {
+      SYSE(pthread_setaffinity_np(jtr_live_thread_id, sizeof(cpu_set),
+                                  &cpu_set));
+    }
+  }
+}  /* jtr_live_start */
+
+
+/* Publish once more and remove the segment.
+ */
+void jtr_live_stop(void)
+{
+  if (jtr_live == NULL) {
+    return;
+  }
+  jtr_live_running = 0;
+  SYSE(pthread_join(jtr_live_thread_id, NULL));
+  if (jtr_live_stage_histo()) {
+    jtr_live_publish();
+  }
+  SYSE(shm_unlink(jtr_live_name));
+  munmap(jtr_live, sizeof(jtr_live_t));
+  jtr_live = NULL;
+}  /* jtr_live_stop */
+
+
+/* Results store. After jtr_store_init(), every histogram printed by
+ * jtr_histo_print_all() is also appended to "<dir>/records", with a
+ * fingerprint of the host and the calibration, and indexed by one line in
+ * "<dir>/index" for jtr_query. Both files are only ever appended to,
+ * under flock() on the records file.
+ */
+char *jtr_store_dir = NULL;  /* NULL=off. */
+jtr_finding_t jtr_store_findings[JTR_PREFLIGHT_MAX_FINDINGS];
+int jtr_store_num_findings = 0;
+
+
+/* The preflight audit sleeps and scans /proc, so it is run once here, not
+ * for each stored histogram.
+ */
+void jtr_store_init(char *store_dir, int cpu_num)
+{
+  if (store_dir == NULL || strcmp(store_dir, "none") == 0) {
+    return;
+  }
+  SYSE(mkdir(store_dir, 0775) != 0 && errno != EEXIST);
+  jtr_store_dir = store_dir;
+  jtr_store_num_findings = jtr_preflight(cpu_num, jtr_store_findings);
+}  /* jtr_store_init */
+
+
+/* Copy the first line of "path" (or the value of the first line starting
+ * with "key", after its colon) to "buf", or "?" if there is none.
+ */
+char *jtr_read_sys(char *path, char *key, char *buf, size_t buf_size)
+{
+  char line[4096];
+  char *val;
+  FILE *fp;
+
+  snprintf(buf, buf_size, "?");
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    return buf;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (key != NULL) {
+      if (strncmp(line, key, strlen(key)) != 0
+          || (val = strchr(line, ':')) == NULL) {
+        continue;
+      }
+      val ++;
+      while (*val == ' ' || *val == '\t') {
+        val ++;
+      }
+    } else {
+      val = line;
+    }
+    val[strcspn(val, "\n")] = '\0';
+    snprintf(buf, buf_size, "%s", (*val == '\0') ? "-" : val);
+    break;
+  }
+  fclose(fp);
+  return buf;
+}  /* jtr_read_sys */
+
+
+/* 16 hex digits identifying the machine (host name and CPU model), which
+ * stay the same across kernel, firmware, and tuning changes.
+ */
+void jtr_host_id(char *buf, size_t buf_size)
+{
+  struct utsname uts;
+  char model[256];
+  char ident[1024];
+  uint64_t hash = 14695981039346656037ull;  /* FNV-1a. */
+  char *p;
+
+  SYSE(uname(&uts));
+  jtr_read_sys("/proc/cpuinfo", "model name", model, sizeof(model));
+  snprintf(ident, sizeof(ident), "%s/%s", uts.nodename, model);
+  for (p = ident; *p != '\0'; p++) {
+    hash = (hash ^ (unsigned char)*p) * 1099511628211ull;
+  }
+  snprintf(buf, buf_size, "%016llx", (unsigned long long)hash);
+}  /* jtr_host_id */
+
+
+/* Write the kernel's CPU vulnerability mitigations to "buf" as
+ * "name=state | ..." in name order, from
+ * /sys/devices/system/cpu/vulnerabilities (one file per vulnerability).
+ * "Mitigation: " and "Not affected" are shortened; "?" if not available.
+ */
+char *jtr_mitigations(char *buf, size_t buf_size)
+{
+  char *dir = "/sys/devices/system/cpu/vulnerabilities";
+  char path[1024];
+  char state[256];
+  char *val;
+  struct dirent **names;
+  int num_names, i;
+
+  snprintf(buf, buf_size, "?");
+  num_names = scandir(dir, &names, NULL, alphasort);
+  if (num_names < 0) {
+    return buf;
+  }
+  buf[0] = '\0';
+  for (i = 0; i < num_names; i++) {
+    if (names[i]->d_name[0] != '.') {
+      snprintf(path, sizeof(path), "%s/%s", dir, names[i]->d_name);
+      jtr_read_sys(path, NULL, state, sizeof(state));
+      val = state;
+      if (strncmp(val, "Mitigation: ", 12) == 0) {
+        val += 12;
+      } else if (strcmp(val, "Not affected") == 0) {
+        val = "n/a";
+      }
+      snprintf(&buf[strlen(buf)], buf_size - strlen(buf), "%s%s=%s",
+               (buf[0] == '\0') ? "" : " | ", names[i]->d_name, val);
+    }
+    free(names[i]);
+  }
+  free(names);
+  return buf;
+}  /* jtr_mitigations */
+
+
+/* Append the host fingerprint, one "key=value" line each. The keys are
+ * the ones jtr_query compares between runs.
+ */
+void jtr_host_fingerprint(char *buf, size_t buf_size)
+{
+  struct utsname uts;
+  char path[256];
+  char model[256], microcode[64], bios[128], cmdline[4096];
+  char governor[64], isolated[256], nohz_full[256], thp[128], smt[16];
+  char mitigations[4096];
+  int cpu = sched_getcpu();
+
+  SYSE(uname(&uts));
+  jtr_read_sys("/proc/cpuinfo", "model name", model, sizeof(model));
+  jtr_read_sys("/proc/cpuinfo", "microcode", microcode, sizeof(microcode));
+  jtr_read_sys("/sys/class/dmi/id/bios_version", NULL, bios, sizeof(bios));
+  jtr_read_sys("/proc/cmdline", NULL, cmdline, sizeof(cmdline));
+  snprintf(path, sizeof(path),
+           "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor",
+           (cpu < 0) ? 0 : cpu);
+  jtr_read_sys(path, NULL, governor, sizeof(governor));
+  jtr_read_sys("/sys/devices/system/cpu/isolated", NULL,
+               isolated, sizeof(isolated));
+  jtr_read_sys("/sys/devices/system/cpu/nohz_full", NULL,
+               nohz_full, sizeof(nohz_full));
+  jtr_read_sys("/sys/kernel/mm/transparent_hugepage/enabled", NULL,
+               thp, sizeof(thp));
+  jtr_read_sys("/sys/devices/system/cpu/smt/active", NULL, smt, sizeof(smt));
+  jtr_mitigations(mitigations, sizeof(mitigations));
+
+  snprintf(&buf[strlen(buf)], buf_size - strlen(buf),
+           "cpu_model=%s\n"
+           "kernel=%s\n"
+           "microcode=%s\n"
+           "bios=%s\n"
+           "cmdline=%s\n"
+           "mitigations=%s\n"
+           "tuning=governor=%s isolated=%s nohz_full=%s thp=%s smt=%s\n"
+           "calib=ticks_per_sec=%lld rdtsc_cost=%lld gettime_cost=%lld"
+           " jtr_1000_loops_cost=%lld\n",
+           model, uts.release, microcode, bios, cmdline, mitigations,
+           governor, isolated, nohz_full, thp, smt,
+           jtr_ticks_per_sec, jtr_rdtsc_cost, jtr_gettime_cost,
+           jtr_1000_loops_cost);
+  SYSE(buf[buf_size-2] != '\0'); /* Don't fill. */
+}  /* jtr_host_fingerprint */
+
+
+/* Append the current (folded) histogram under "title". The test name is
+ * the title up to the first colon. Buckets are stored sparsely, as
+ * "gap:count" pairs, gap being the distance from the previous non-empty
+ * bucket.
+ */
+void jtr_store_append(char *title)
+{
+  char path[1024];
+  char host[32];
+  char kernel[256];
+  char test[256];
+  struct utsname uts;
+  size_t buf_size;
+  char *buf;
+  char *p;
+  off_t offset;
+  time_t now = time(NULL);
+  int fd, i, prev;
+  FILE *fp;
+
+  if (jtr_store_dir == NULL) {
+    return;
+  }
+  jtr_host_id(host, sizeof(host));
+  SYSE(uname(&uts));
+  snprintf(kernel, sizeof(kernel), "%s", uts.release);
+  snprintf(test, sizeof(test), "%s", title);
+  test[strcspn(test, ":\n")] = '\0';
+
+  buf_size = 16384 + strlen(title) + (size_t)jtr_histo_num_buckets * 24;
+  buf = (char *)malloc(buf_size);
+  ASSRT(buf != NULL);
+  memset(buf, 0, buf_size);
+
+  snprintf(buf, buf_size, "record time=%ld host=%s\ntest=%s\ntitle=",
+           (long)now, host, test);
+  p = &buf[strlen(buf)];
+  for (i = 0; title[i] != '\0'; i++) {
+    *p++ = (title[i] == '\n') ? ' ' : title[i];
+  }
+  *p++ = '\n';
+  jtr_host_fingerprint(buf, buf_size);
+  for (i = 0; i < jtr_store_num_findings; i++) {
+    snprintf(&buf[strlen(buf)], buf_size - strlen(buf), "preflight=%d %s\n",
+             jtr_store_findings[i].score, jtr_store_findings[i].text);
+  }
+  snprintf(&buf[strlen(buf)], buf_size - strlen(buf),
+           "summary=samples=%d min=%d max=%d avg=%d overflows=%d"
+           " neg_diffs=%d\n"
+           "histo=granularity=%d buckets=%d data=",
+           jtr_histo_num_samples, jtr_histo_min_time, jtr_histo_max_time,
+           jtr_histo_average, jtr_histo_overflows, jtr_neg_diffs,
+           HISTO_GRANULARITY, jtr_histo_num_buckets);
+  p = &buf[strlen(buf)];
+  prev = -1;
+  for (i = 0; i < jtr_histo_num_buckets; i++) {
+    if (jtr_histo_buckets[i] > 0) {
+      p += sprintf(p, "%s%d:%d", (prev < 0) ? "" : ",", i - prev,
+                   jtr_histo_buckets[i]);
+      prev = i;
+    }
+  }
+  snprintf(p, buf_size - (p - buf), "\nend\n");
+  SYSE(buf[buf_size-2] != '\0'); /* Don't fill. */
+
+  snprintf(path, sizeof(path), "%s/records", jtr_store_dir);
+  fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0664);
+  SYSE(fd < 0);
+  SYSE(flock(fd, LOCK_EX));
+  offset = lseek(fd, 0, SEEK_END);
+  SYSE(offset < 0);
+  SYSE(write(fd, buf, strlen(buf)) != (ssize_t)strlen(buf));
+
+  snprintf(path, sizeof(path), "%s/index", jtr_store_dir);
+  fp = fopen(path, "a");
+  SYSE(fp == NULL);
+  fprintf(fp, "%lld %ld %s %s %s\n", (long long)offset, (long)now, host,
+          kernel, test);
+  SYSE(fclose(fp));
+
+  SYSE(flock(fd, LOCK_UN));
+  close(fd);
+  free(buf);
+}  /* jtr_store_append */
+
+
+/* Preflight audit. Looks at how the host is set up around "cpu_num" and
+ * lists what is likely to interrupt or slow down a thread measuring there,
+ * scored 1-100 by how much jitter it usually causes, highest first. It
+ * only reads /proc and /sys; nothing is changed.
+ */
+int jtr_preflight_cmp(const void *a, const void *b)
+{
+  return ((const jtr_finding_t *)b)->score - ((const jtr_finding_t *)a)->score;
+}  /* jtr_preflight_cmp */
+
+
+/* Return 1 if "name" is in the comma-separated "list". */
+int jtr_name_in_list(char *list, char *name)
+{
+  size_t len = strlen(name);
+  char *p = list;
+
+  while ((p = strstr(p, name)) != NULL) {
+    if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) {
+      return 1;
+    }
+    p += len;
+  }
+  return 0;
+}  /* jtr_name_in_list */
+
+
+/* Parse a CPU list like "2,3,8-11" into "cpus". Returns the number of
+ * CPUs, or -1 if the list is malformed.
+ */
+int jtr_parse_cpu_list(char *cpu_list, int *cpus, int max_cpus)
+{
+  char *p = cpu_list;
+  int first, last, cpu;
+  int num_cpus = 0;
+
+  while (*p != '\0') {
+    first = (int)strtol(p, &p, 10);
+    last = first;
+    if (*p == '-') {
+      p++;
+      last = (int)strtol(p, &p, 10);
+    }
+    for (cpu = first; cpu <= last; cpu++) {
+      SYSE(num_cpus >= max_cpus);
+      cpus[num_cpus] = cpu;
+      num_cpus ++;
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p != '\0') {
+      return -1;
+    }
+  }
+  return num_cpus;
+}  /* jtr_parse_cpu_list */
+
+
+/* Return 1 if "cpu" is in a list like "2,3,8-11". */
+int jtr_cpu_in_list(char *list, int cpu)
+{
+  char *p = list;
+  int first, last;
+
+  while (*p >= '0' && *p <= '9') {
+    first = (int)strtol(p, &p, 10);
+    last = first;
+    if (*p == '-') {
+      p++;
+      last = (int)strtol(p, &p, 10);
+    }
+    if (cpu >= first && cpu <= last) {
+      return 1;
+    }
+    if (*p == ',') {
+      p++;
+    }
+  }
+  return 0;
+}  /* jtr_cpu_in_list */
+
+
+void jtr_finding_add(jtr_finding_t *findings, int *num_findings, int score,
+                     const char *fmt, ...)
+{
+  va_list ap;
+
+  if (*num_findings >= JTR_PREFLIGHT_MAX_FINDINGS) {
+    return;
+  }
+  findings[*num_findings].score = score;
+  va_start(ap, fmt);
+  vsnprintf(findings[*num_findings].text,
+            sizeof(findings[*num_findings].text), fmt, ap);
+  va_end(ap);
+  (*num_findings) ++;
+}  /* jtr_finding_add */
+
+
+/* Busy and total jiffies of "cpu" from /proc/stat. */
+void jtr_cpu_jiffies(int cpu, long long *busy, long long *total)
+{
+  char line[512];
+  char label[16];
+  long long v[8];
+  int n;
+  FILE *fp;
+
+  *busy = 0;
+  *total = 0;
+  snprintf(label, sizeof(label), "cpu%d ", cpu);
+  fp = fopen("/proc/stat", "r");
+  if (fp == NULL) {
+    return;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (strncmp(line, label, strlen(label)) == 0) {
+      memset(v, 0, sizeof(v));
+      n = sscanf(&line[strlen(label)], "%lld %lld %lld %lld %lld %lld %lld %lld",
+                 &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+      if (n >= 4) {
+        *total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+        *busy = *total - v[3] - v[4];  /* Less idle and iowait. */
+      }
+      break;
+    }
+  }
+  fclose(fp);
+}  /* jtr_cpu_jiffies */
+
+
+/* Device IRQs that have fired on "cpu" (from /proc/interrupts), listed in
+ * "irq_list", and how many device IRQs are allowed to run there.
+ */
+int jtr_preflight_irqs(int cpu, char *irq_list, size_t list_size,
+                       int *num_allowed)
+{
+  char *line = NULL;
+  size_t line_size = 0;
+  char label[16];
+  char path[256];
+  char affinity[1024];
+  int col = -1, c, num_taken = 0, irq;
+  long long count;
+  char *p, *q;
+  FILE *fp;
+
+  irq_list[0] = '\0';
+  *num_allowed = 0;
+  fp = fopen("/proc/interrupts", "r");
+  if (fp == NULL) {
+    return 0;
+  }
+  /* Header is "CPU0 CPU1 ...", one column per online CPU. */
+  if (getline(&line, &line_size, fp) > 0) {
+    snprintf(label, sizeof(label), "CPU%d", cpu);
+    for (c = 0, p = strtok(line, " \t\n"); p != NULL;
+         c++, p = strtok(NULL, " \t\n")) {
+      if (strcmp(p, label) == 0) {
+        col = c;
+      }
+    }
+  }
+  while (col >= 0 && getline(&line, &line_size, fp) > 0) {
+    irq = (int)strtol(line, &p, 10);
+    if (p == line || *p != ':') {
+      continue;  /* LOC, RES, etc. */
+    }
+    p++;
+    for (c = 0; c <= col; c++) {
+      count = strtoll(p, &q, 10);
+      if (q == p) {
+        break;
+      }
+      p = q;
+    }
+    if (c > col && count > 0) {
+      if (num_taken < 8) {
+        snprintf(&irq_list[strlen(irq_list)], list_size - strlen(irq_list),
+                 "%s%d", (num_taken == 0) ? "" : ",", irq);
+      }
+      num_taken ++;
+    }
+
+    snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", irq);
+    jtr_read_sys(path, NULL, affinity, sizeof(affinity));
+    if (jtr_cpu_in_list(affinity, cpu)) {
+      (*num_allowed) ++;
+    }
+  }
+  free(line);
+  fclose(fp);
+  return num_taken;
+}  /* jtr_preflight_irqs */
+
+
+/* Return 1 if a process named "name" is running. */
+int jtr_process_running(char *name)
+{
+  char path[300];
+  char comm[64];
+  struct dirent *ent;
+  DIR *dir;
+  int found = 0;
+
+  dir = opendir("/proc");
+  if (dir == NULL) {
+    return 0;
+  }
+  while (! found && (ent = readdir(dir)) != NULL) {
+    if (ent->d_name[0] < '0' || ent->d_name[0] > '9') {
+      continue;
+    }
+    snprintf(path, sizeof(path), "/proc/%s/comm", ent->d_name);
+    jtr_read_sys(path, NULL, comm, sizeof(comm));
+    found = (strcmp(comm, name) == 0);
+  }
+  closedir(dir);
+  return found;
+}  /* jtr_process_running */
+
+
+/* Fill "findings" for "cpu_num" (-1 = not pinned), sorted by score, and
+ * return how many there are.
+ */
+int jtr_preflight(int cpu_num, jtr_finding_t *findings)
+{
+  char buf[4096];
+  char cmdline[4096];
+  char path[256];
+  char name[64];
+  char irq_list[64];
+  char *p;
+  int n = 0;
+  int cpu, sibling, num_taken, num_allowed, state, latency;
+  long long busy0, total0, busy1, total1;
+
+  if (cpu_num < 0) {
+    jtr_finding_add(findings, &n, 90,
+                    "not pinned (-c -1); the thread can migrate");
+    cpu = sched_getcpu();  /* Check where it happens to be now. */
+  } else {
+    cpu = cpu_num;
+  }
+  jtr_read_sys("/proc/cmdline", NULL, cmdline, sizeof(cmdline));
+
+  jtr_read_sys("/sys/devices/system/cpu/isolated", NULL, buf, sizeof(buf));
+  if (! jtr_cpu_in_list(buf, cpu)) {
+    jtr_finding_add(findings, &n, 60,
+                    "cpu %d not in isolcpus (isolated=%s); other tasks can"
+                    " be scheduled there", cpu, buf);
+  }
+
+  num_taken = jtr_preflight_irqs(cpu, irq_list, sizeof(irq_list),
+                                 &num_allowed);
+  if (num_taken > 0) {
+    jtr_finding_add(findings, &n, 55,
+                    "%d device IRQs have run on cpu %d (irqs %s%s)",
+                    num_taken, cpu, irq_list, (num_taken > 8) ? ",..." : "");
+  } else if (num_allowed > 0) {
+    jtr_finding_add(findings, &n, 25,
+                    "%d device IRQs are allowed on cpu %d by smp_affinity",
+                    num_allowed, cpu);
+  }
+
+  jtr_read_sys("/sys/devices/system/clocksource/clocksource0/"
+               "current_clocksource", NULL, buf, sizeof(buf));
+  if (strcmp(buf, "tsc") != 0) {
+    jtr_finding_add(findings, &n, 50,
+                    "clocksource is %s, not tsc; clock_gettime() is slow"
+                    " (timebase 2)", buf);
+  }
+
+  sibling = jtr_smt_sibling(cpu);
+  if (sibling >= 0) {
+    jtr_cpu_jiffies(sibling, &busy0, &total0);
+    usleep(100000);
+    jtr_cpu_jiffies(sibling, &busy1, &total1);
+    if (total1 > total0 && (busy1 - busy0) * 100 > (total1 - total0) * 5) {
+      jtr_finding_add(findings, &n, 45,
+                      "SMT sibling cpu %d is %lld%% busy; it shares the core",
+                      sibling, ((busy1 - busy0) * 100) / (total1 - total0));
+    } else {
+      jtr_finding_add(findings, &n, 10,
+                      "SMT sibling cpu %d is online (idle now)", sibling);
+    }
+  }
+
+  jtr_read_sys("/sys/devices/system/cpu/nohz_full", NULL, buf, sizeof(buf));
+  if (! jtr_cpu_in_list(buf, cpu)) {
+    jtr_finding_add(findings, &n, 40,
+                    "cpu %d not in nohz_full (nohz_full=%s); the scheduler"
+                    " tick interrupts it", cpu, buf);
+  }
+
+  snprintf(path, sizeof(path),
+           "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
+  jtr_read_sys(path, NULL, buf, sizeof(buf));
+  if (strcmp(buf, "?") != 0 && strcmp(buf, "performance") != 0) {
+    jtr_finding_add(findings, &n, 40,
+                    "cpu %d frequency governor is %s, not performance",
+                    cpu, buf);
+  }
+
+  /* The first enabled idle state with a wake-up latency over 10 us. */
+  for (state = 0; state < 16; state++) {
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/latency",
+             cpu, state);
+    jtr_read_sys(path, NULL, buf, sizeof(buf));
+    if (strcmp(buf, "?") == 0) {
+      break;
+    }
+    latency = atoi(buf);
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/disable",
+             cpu, state);
+    jtr_read_sys(path, NULL, buf, sizeof(buf));
+    if (latency > 10 && strcmp(buf, "0") == 0) {
+      snprintf(path, sizeof(path),
+               "/sys/devices/system/cpu/cpu%d/cpuidle/state%d/name",
+               cpu, state);
+      jtr_read_sys(path, NULL, name, sizeof(name));
+      jtr_finding_add(findings, &n, 35,
+                      "idle state %s (exit latency %d us) is enabled on"
+                      " cpu %d", name, latency, cpu);
+      break;
+    }
+  }
+
+  p = strstr(cmdline, "rcu_nocbs=");
+  if (p == NULL || ! jtr_cpu_in_list(p + strlen("rcu_nocbs="), cpu)) {
+    jtr_finding_add(findings, &n, 30,
+                    "cpu %d not in rcu_nocbs; RCU callbacks run there", cpu);
+  }
+
+  if (jtr_process_running("irqbalance")) {
+    jtr_finding_add(findings, &n, 30,
+                    "irqbalance is running and can move IRQs onto cpu %d",
+                    cpu);
+  }
+
+  jtr_read_sys("/sys/kernel/mm/transparent_hugepage/enabled", NULL,
+               buf, sizeof(buf));
+  if (strstr(buf, "[always]") != NULL) {
+    jtr_finding_add(findings, &n, 25,
+                    "transparent huge pages are always on; khugepaged and"
+                    " compaction can stall the process");
+  }
+  jtr_read_sys("/sys/kernel/mm/transparent_hugepage/defrag", NULL,
+               buf, sizeof(buf));
+  if (strstr(buf, "[always]") != NULL) {
+    jtr_finding_add(findings, &n, 20,
+                    "transparent huge page defrag is always (direct"
+                    " compaction on page faults)");
+  }
+
+  if (cpu == 0) {
+    jtr_finding_add(findings, &n, 20,
+                    "cpu 0 does most of the host's housekeeping");
+  }
+
+  jtr_read_sys("/proc/sys/kernel/numa_balancing", NULL, buf, sizeof(buf));
+  if (strcmp(buf, "1") == 0) {
+    jtr_finding_add(findings, &n, 20,
+                    "NUMA balancing is on (periodic page-table scans)");
+  }
+
+  jtr_read_sys("/proc/sys/kernel/timer_migration", NULL, buf, sizeof(buf));
+  if (strcmp(buf, "1") == 0) {
+    jtr_finding_add(findings, &n, 15,
+                    "timer_migration is on; timers can be moved to cpu %d",
+                    cpu);
+  }
+
+  jtr_read_sys("/proc/sys/kernel/sched_rt_runtime_us", NULL,
+               buf, sizeof(buf));
+  if (strcmp(buf, "-1") != 0 && strcmp(buf, "?") != 0) {
+    jtr_finding_add(findings, &n, 15,
+                    "RT throttling is on (sched_rt_runtime_us=%s); a FIFO"
+                    " thread is stopped for part of each second", buf);
+  }
+
+  qsort(findings, n, sizeof(jtr_finding_t), jtr_preflight_cmp);
+  return n;
+}  /* jtr_preflight */
+
+
+/* Append the preflight findings for "cpu_num" to the results, and return
+ * the highest score (0 if none).
+ */
+int jtr_preflight_print(int cpu_num)
+{
+  jtr_finding_t findings[JTR_PREFLIGHT_MAX_FINDINGS];
+  int num_findings, i;
+
+  num_findings = jtr_preflight(cpu_num, findings);
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Preflight cpu_num=%d: %d likely jitter sources"
+           " (score, highest first)\n",
+           cpu_num, num_findings);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  for (i = 0; i < num_findings; i++) {
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "  %3d %s\n", findings[i].score, findings[i].text);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  }
+  return (num_findings > 0) ? findings[0].score : 0;
+}  /* jtr_preflight_print */
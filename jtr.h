@@ -24,6 +24,8 @@
 #define JTR_H
 #include <errno.h>
 #include <inttypes.h>
+#include <stddef.h>
+#include <pthread.h>
 
 #define likely(x)       __builtin_expect((x),1)
 #define unlikely(x)     __builtin_expect((x),0)
@@ -43,6 +45,11 @@
   asm volatile ("rdtsc" : "=a" (lo), "=d" (hi)); \
 } while (0)
 
+/* Macro to read a hardware performance counter (see jtr_pmu_init()). */
+#define RDPMC(counter, hi, lo) do { \
+  asm volatile ("rdpmc" : "=a" (lo), "=d" (hi) : "c" (counter)); \
+} while (0)
+
 /* Convenience constant so I don't accidentally miscount zeros. */
 #define NANOS_PER_SEC 1000000000ll  /* Long long constant for 10**9. */
 
@@ -55,6 +62,8 @@ extern long long jtr_gettime_cost;
 extern long long jtr_rdtsc_cost;
 extern long long jtr_1000_loops_cost;
 extern long long jtr_ticks_per_sec;  /* RDTSC ticks per second. */
+extern long long jtr_rdpmc_cost;
+extern long long jtr_1000_loops_cycles_cost;
 
 /* Histogram, in HISTO_GRANULARITY ns increments. */
 #define HISTO_GRANULARITY 10  /* Histogram ns per bucket. */
@@ -66,10 +75,28 @@ extern int jtr_histo_min_time;
 extern long long jtr_histo_tot_time;
 extern int jtr_histo_num_samples;
 extern int jtr_histo_average;
+extern int jtr_neg_diffs;
+extern int jtr_histo_faults_counted;
+extern long jtr_histo_minflt;
+extern long jtr_histo_majflt;
 extern int jtr_x_low;
 extern int jtr_x_high;
 extern int jtr_y_high;
 
+/* Optional per-sample hardware counters (jtr_pmu_init()). */
+#define JTR_PMU_LLC 0
+#define JTR_PMU_DTLB 1
+#define JTR_PMU_BRANCH 2
+#define JTR_PMU_INSTR 3
+#define JTR_PMU_NUM_EVENTS 4
+#define JTR_PMU_TAIL_SAMPLES 32  /* Number of slowest samples to keep. */
+typedef struct jtr_pmu_sample_s {
+  int sample_time;
+  long long deltas[JTR_PMU_NUM_EVENTS];
+} jtr_pmu_sample_t;
+extern int jtr_pmu_enabled;
+extern int jtr_cycles_enabled;  /* Timebase 3 (jtr_cycles_init()). */
+
 extern char jtr_results_buf[65536];
 extern char jtr_gnuplot_buf[65536];
 
@@ -112,20 +139,219 @@ extern char jtr_gnuplot_buf[65536];
 } while (0)
 
 void jtr_pin_cpu(int cpu_num);
+void jtr_pin_thread(pthread_t thread_id, int cpu_num);
 void jtr_set_fifo_priority(int priority);
+void jtr_mem_init(int mode);
+void *jtr_mem_alloc(size_t size);
 void jtr_spin_sleep_ns(long long sleep_ns, int timebase);
 void jtr_calibrate(void);
+void jtr_calibrate_once(void);
 void jtr_histo_init(int num_buckets);
 void jtr_histo_accum(int sample_time);
+void jtr_histo_accum_ticks(long long diff_ticks);
+void jtr_histo_add_ticks(int *tick_buckets, int num_tick_buckets, int shift,
+                         int clear);
+void jtr_histo_fold(void);
 void jtr_histo_print_summary(void);
+int jtr_histo_perc_ns(double percentile);
+int jtr_buckets_perc_ns(int *buckets, int num_samples, double percentile);
 void jtr_histo_print_perc(double percentile);
+void jtr_histo_brief(char *buf, size_t buf_size, char *label);
 void jtr_histo_print_details(void);
 void jtr_histo_print_all(int verbose, char *title);
+long long jtr_ticks_to_ns(long long ticks);
 int jtr_busy_loop_wait_count(long long wait_ns);
+int jtr_pmu_init(void);
+void jtr_pmu_histo_init(void);
+void jtr_pmu_accum(int sample_time);
+void jtr_pmu_print(int verbose);
+int jtr_cycles_init(void);
+void jtr_calibrate_cycles(void);
+void jtr_freq_histo_init(void);
+void jtr_freq_track(uint64_t cycles, uint64_t ref, int sample_time,
+                    int accum);
+void jtr_freq_print(int verbose);
 void jtr_measure_one(int timebase, int accum,
                      app_cb_t app_cb, void *clientd);
 void jtr_measure_calls(int warmup_loops, int measure_loops,
                        int post_call_wait_ns, int timebase,
                        app_cb_t app_cb, void *clientd);
+#define JTR_AB_PILOT_SAMPLES 10000  /* Real-only run to size the null loop. */
+long long jtr_time_call_ns(int timebase, app_cb_t app_cb, void *clientd);
+void jtr_measure_ab(int warmup_loops, int measure_loops,
+                    int post_call_wait_ns, int timebase, int order,
+                    app_cb_t a_cb, void *a_clientd,
+                    app_cb_t b_cb, void *b_clientd);
+void jtr_ab_histo(int which, int num_buckets);
+void jtr_ab_print_diff(void);
+#define JTR_PATTERN_MAX_POS 64  /* Burst positions reported separately. */
+#define JTR_SIZE_CLASSES 17  /* Powers of 2; the last is 64K and up. */
+extern int jtr_pattern_len;
+extern int jtr_pattern_max_size;
+extern int jtr_msg_size;
+extern int jtr_msg_next_size;  /* For APIs that size the next buffer now. */
+extern int *jtr_pattern_size;
+void jtr_pattern_init(char *pattern, char *size_dist, char *trace_file,
+                      int pause_ns);
+void jtr_pattern_histo_init(void);
+void jtr_pattern_measure_one(int k, int timebase, int accum,
+                             app_cb_t app_cb, void *clientd);
+void jtr_pattern_print(void);
+#define JTR_WARMUP_WINDOW 256  /* Samples per steady-state window. */
+#define JTR_WARMUP_STABLE_WINDOWS 3  /* Comparisons without a change. */
+#define JTR_WARMUP_MAX_LOOPS 1000000
+extern int jtr_warmup_detected;
+extern double jtr_converge_perc;  /* 0=off. */
+extern int jtr_converge_max_sec;
+extern int jtr_converge_batches;
+extern int jtr_converge_done;
+extern double jtr_converge_secs;
+void jtr_converge_init(char *converge);
+int jtr_warmup_detect(int post_call_wait_ns, int timebase,
+                      app_cb_t app_cb, void *clientd);
+int jtr_histo_rank_ns(int rank);
+int jtr_converge_check(void);
+void jtr_converge_print(void);
+
+/* Phase marks; see jtr_mark_accum(). Call jtr_mark_names() before
+ * jtr_histo_init(), then use inside an app_cb_t callback:
+ *   JTR_MARK(0); ... JTR_MARK(1); ...
+ */
+#define JTR_MARK_MAX_PHASES 8
+extern long long jtr_mark_ticks[JTR_MARK_MAX_PHASES];
+extern unsigned int jtr_mark_set;
+#define JTR_MARK(phase) do { \
+  uint32_t _hi, _lo; \
+  RDTSC(_hi, _lo); \
+  jtr_mark_ticks[phase] = ((long long)_hi << 32) + (long long)_lo; \
+  jtr_mark_set |= 1u << (phase); \
+} while (0)
+void jtr_mark_names(char *names);
+void jtr_mark_histo_init(void);
+void jtr_mark_accum(long long start_ticks, long long end_ticks, int accum);
+void jtr_mark_print(void);
+#define JTR_TSC_MAX_CPUS 1024
+int jtr_tscskew_load(char *table_file);
+int jtr_tscskew_known(int cpu);
+long long jtr_tscskew_ticks(int from_cpu, int to_cpu, long long ticks);
+int jtr_smt_sibling(int cpu_num);
+extern char *jtr_cpu_relation_names[];
+int jtr_cpu_relation(int cpu_a, int cpu_b);
+int jtr_cpu_related(int cpu_num, char *relations);
+#define JTR_NOISE_MAX_PROFILES 64
+int jtr_noise_split(char *profile_list, char **profiles, int max_profiles);
+void jtr_noise_start(char *profile, int test_cpu_num);
+void jtr_noise_stop(void);
+
+/* Live statistics in shared memory "/jtr_live.<pid>" (jtr_live_start()),
+ * for the jtr_top viewer. A writer makes "seq" odd while updating;
+ * readers copy the fields and retry if "seq" was odd or changed.
+ */
+#define JTR_LIVE_PREFIX "/jtr_live"
+#define JTR_LIVE_MAGIC 0x6a74726c  /* "jtrl" */
+#define JTR_LIVE_MAX_BUCKETS 20000  /* 200 us at HISTO_GRANULARITY. */
+typedef struct jtr_live_s {
+  volatile uint32_t seq;
+  uint32_t magic;
+  int pid;
+  char tool[32];
+  char descr[128];
+  long long publish_ns;  /* CLOCK_REALTIME of last publish. */
+  int run;  /* Increments with each jtr_histo_init(). */
+  int num_samples;
+  int overflows;
+  int neg_diffs;
+  int min_time;
+  int max_time;
+  long long tot_time;
+  int histo_num_buckets;
+  int buckets[JTR_LIVE_MAX_BUCKETS];
+} jtr_live_t;
+
+void jtr_live_start(char *tool, char *descr, int measure_cpu_num);
+void jtr_live_stop(void);
+
+/* Probes for timing code paths inside an application linked with libjtr.
+ * Call jtr_probe_init() once, then bracket code with JTR_PROBE_BEGIN(id) and
+ * JTR_PROBE_END(id), where 0 <= id < num_probes. A probe must begin and end
+ * on the same thread. Each thread counts into its own preallocated tick
+ * histograms (like timebase 1); jtr_probe_snapshot() merges them into the
+ * jtr_histo_* histogram for reporting.
+ */
+#define JTR_PROBE_MAX_PROBES 64
+#define JTR_PROBE_MAX_THREADS 256
+#define JTR_TLS __thread __attribute__((tls_model("initial-exec")))
+
+typedef struct jtr_probe_stats_s {  /* Samples beyond the tick buckets. */
+  int samples;
+  int neg_diffs;
+  int max_time;
+  long long tot_time;
+} jtr_probe_stats_t;
+
+typedef struct jtr_probe_thread_s {
+  int epoch;  /* Matches jtr_probe_epoch once cleared after a reset. */
+  int in_use;  /* Owned by a live thread; cleared when the thread exits. */
+  int *buckets;  /* [probe][tick bucket] */
+  jtr_probe_stats_t stats[JTR_PROBE_MAX_PROBES];
+} jtr_probe_thread_t;
+
+extern int jtr_probe_num_buckets;
+extern int jtr_probe_shift;
+extern volatile int jtr_probe_epoch;
+extern JTR_TLS long long jtr_probe_start[JTR_PROBE_MAX_PROBES];
+extern JTR_TLS jtr_probe_thread_t *jtr_probe_self;
+
+#define JTR_PROBE_BEGIN(id) do { \
+  uint32_t _hi, _lo; \
+  RDTSC(_hi, _lo); \
+  jtr_probe_start[id] = ((long long)_hi << 32) + (long long)_lo; \
+} while (0)
+
+#define JTR_PROBE_END(id) do { \
+  uint32_t _hi, _lo; \
+  long long _ticks; \
+  unsigned long long _bucket; \
+  RDTSC(_hi, _lo); \
+  _ticks = ((long long)_hi << 32) + (long long)_lo - jtr_probe_start[id]; \
+  if (unlikely(jtr_probe_self == NULL \
+               || jtr_probe_self->epoch != jtr_probe_epoch)) { \
+    jtr_probe_thread_sync(); \
+  } \
+  _bucket = (unsigned long long)_ticks >> jtr_probe_shift; \
+  if (likely(_bucket < (unsigned long long)jtr_probe_num_buckets)) { \
+    jtr_probe_self->buckets[(id) * jtr_probe_num_buckets + _bucket] ++; \
+  } else { \
+    jtr_probe_overflow((id), _ticks); \
+  } \
+} while (0)
+
+void jtr_probe_init(int num_probes, int histo_buckets);
+void jtr_probe_thread_sync(void);
+void jtr_probe_overflow(int id, long long diff_ticks);
+int jtr_probe_snapshot(int id);
+int jtr_probe_snapshot_ids(int id, int num_ids, int stride);
+void jtr_probe_reset(void);
+
+/* Results store; see jtr_store_append() and jtr_query.c. */
+extern char *jtr_store_dir;
+void jtr_store_init(char *store_dir, int cpu_num);
+char *jtr_read_sys(char *path, char *key, char *buf, size_t buf_size);
+void jtr_host_id(char *buf, size_t buf_size);
+char *jtr_mitigations(char *buf, size_t buf_size);
+void jtr_host_fingerprint(char *buf, size_t buf_size);
+void jtr_store_append(char *title);
+
+/* Preflight audit; see jtr_preflight(). */
+#define JTR_PREFLIGHT_MAX_FINDINGS 32
+typedef struct jtr_finding_s {
+  int score;  /* 1-100, higher is likelier to cause jitter. */
+  char text[256];
+} jtr_finding_t;
+int jtr_name_in_list(char *list, char *name);
+int jtr_parse_cpu_list(char *cpu_list, int *cpus, int max_cpus);
+int jtr_cpu_in_list(char *list, int cpu);
+int jtr_preflight(int cpu_num, jtr_finding_t *findings);
+int jtr_preflight_print(int cpu_num);
 
 #endif  /* JTR_H */
@@ -0,0 +1,505 @@
+/* jtr_alloc.c - jitter of per-message memory allocation strategies.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+
+/* Each sample allocates a message buffer, fills it, and frees it, the way
+ * an application that builds each message in fresh memory does. It is
+ * repeated for each allocator, size, and free pattern:
+ *   none   - a static buffer (fill only; the baseline).
+ *   malloc - glibc malloc()/free().
+ *   pool   - a fixed-size free list per size, with a lock-free list for
+ *            blocks returned by other threads.
+ *   arena  - a bump allocator, reset when full once every block has been
+ *            freed.
+ * "same" frees in the measuring thread, inside the sample. "cross" passes
+ * the block through a ring to a thread on another CPU, which frees it, as
+ * when a message is handed to another thread to send.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+int opt_cpu_num = 5;
+char *opt_descr = "Jitter alloc test";
+int opt_fifo_priority = -1;
+char *opt_gnuplot_file = NULL;
+int opt_histo_buckets = 2000;
+int opt_mem_mode = 0;  /* See jtr_mem_init(). */
+int opt_num_samples = 200000;
+char *opt_results_store = "none";  /* See jtr_store_append(). */
+int opt_pause = 1000;
+int opt_timebase = 1;  /* 1=RDTSC, 2=clock_gettime() */
+int opt_warmup_loops = 1500;
+int opt_verbose = 0;
+
+/* Options specific to the alloc test. */
+char *opt_Allocators = "none,malloc,pool,arena";
+char *opt_Free_placement = "l3,socket";  /* See jtr_cpu_related(). */
+char *opt_Patterns = "same,cross";
+char *opt_Sizes = "64,256,1024,4096,65536";
+
+/* Other globals. */
+#define ALLOC_MAX_SIZES 32
+#define ALLOC_RING_SIZE 256  /* Blocks in flight to the freeing thread. */
+#define ALLOC_POOL_BYTES (64 * 1024 * 1024)
+#define ALLOC_ARENA_BYTES (64 * 1024 * 1024)
+
+enum { ALLOC_NONE, ALLOC_MALLOC, ALLOC_POOL, ALLOC_ARENA, ALLOC_NUM };
+char *alloc_names[ALLOC_NUM] = { "none", "malloc", "pool", "arena" };
+
+typedef struct alloc_pool_s {
+  size_t block_size;
+  void *free_list;  /* Owner (measuring thread) only. */
+  void *remote_free;  /* Stack pushed by other threads; CAS. */
+} alloc_pool_t;
+
+typedef struct alloc_ring_s {  /* Single producer, single consumer. */
+  volatile unsigned int head __attribute__ ((aligned (64)));  /* Producer. */
+  volatile unsigned int tail __attribute__ ((aligned (64)));  /* Consumer. */
+  void *blocks[ALLOC_RING_SIZE] __attribute__ ((aligned (64)));
+} alloc_ring_t;
+
+int alloc_sizes[ALLOC_MAX_SIZES];
+int alloc_num_sizes = 0;
+alloc_pool_t alloc_pools[ALLOC_MAX_SIZES];
+char *alloc_static_buf;  /* For "none". */
+char *alloc_arena;
+size_t alloc_arena_used;
+long long alloc_arena_allocs;  /* Since the last reset. */
+long long alloc_arena_frees;  /* Atomic; the freeing thread adds too. */
+alloc_ring_t alloc_ring;
+int alloc_cur;  /* ALLOC_* of the current run. */
+int alloc_cur_size;  /* Index into alloc_sizes. */
+int alloc_cur_cross;  /* 1=free in the other thread. */
+volatile int alloc_free_running = 0;
+pthread_t alloc_free_thread_id;
+int alloc_free_cpu_num = -1;
+char alloc_summary_buf[16384];  /* Per-run one-liners, printed at end. */
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_alloc [-A allocators] [-C free_placement] [-P patterns]"
+" [-S sizes] [-c cpu_num] [-d descr] [-f fifo_priority] [-g gnuplot_file]"
+" [-h histo_buckets] [-m mem_mode] [-n num_samples] [-o results_store]"
+" [-p pause] [-t timebase] [-w warmup_loops] [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -A allocators : comma-separated list of none, malloc, pool, arena.\n"
+"                 (default=none,malloc,pool,arena)\n"
+" -C free_placement : CPU of the thread that frees in the 'cross' pattern,\n"
+"                     by its relation to cpu_num (see jtr_ss -P).\n"
+"                     (default=l3,socket)\n"
+" -P patterns : comma-separated list of same (free in the measuring\n"
+"               thread) and cross (free in another thread).\n"
+"               (default=same,cross)\n"
+" -S sizes : comma-separated list of message sizes in bytes.\n"
+"            (default=64,256,1024,4096,65536)\n"
+" -c cpu_num : integer CPU number to pin thread. Use -1 to not pin.\n"
+"              (default=5)\n"
+" -d descr : description string. (default='Jitter alloc test')\n"
+" -f fifo_priority : integer priority level to set real-time FIFO scheduling.\n"
+"                  : -1 does not set real-time. (default=-1)\n"
+" -g gnuplot_file : name of file to create containing gnuplot commands to\n"
+"                   graph the histogram data. (default=no file)\n"
+" -h histo_buckets : number of buckets for histogram. (default=2000)\n"
+" -m mem_mode : 1=mlockall and prefault the stack and buffers,\n"
+"               2=also put buffers in 2MB huge pages, 3=1GB huge pages.\n"
+"               Applies to the pools, arena and static buffer, not malloc.\n"
+"               (default=0)\n"
+" -n num_samples : number of samples in each run. (default=200,000)\n"
+" -o results_store : directory to append each histogram to, with a host\n"
+"                    fingerprint including the mitigations; see jtr_query.\n"
+"                    (default=none)\n"
+" -p pause : number of nanoseconds to pause between each sample.\n"
+"            (default=1000)\n"
+" -t timebase : integer indicating which method of time measement to use.\n"
+"               1=RDTSC, 2=clock_gettime(), 3=core cycles (RDPMC).\n"
+"               (default=1)\n"
+" -w warmup_loops : number of samples to initially take without accumulating\n"
+"                   the results. (default=1500)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet, 0=normal, 2=details. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "A:C:P:S:c:d:f:g:h:m:n:o:p:t:w:v:")) != EOF) {
+    switch (opt) {
+      case 'A': opt_Allocators = strdup(optarg); break;
+      case 'C': opt_Free_placement = strdup(optarg); break;
+      case 'P': opt_Patterns = strdup(optarg); break;
+      case 'S': opt_Sizes = strdup(optarg); break;
+      case 'c': opt_cpu_num = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'f': opt_fifo_priority = atoi(optarg); break;
+      case 'g': opt_gnuplot_file = strdup(optarg); break;
+      case 'h': opt_histo_buckets = atoi(optarg); break;
+      case 'm': opt_mem_mode = atoi(optarg); break;
+      case 'n': opt_num_samples = atoi(optarg); break;
+      case 'o': opt_results_store = strdup(optarg); break;
+      case 'p': opt_pause = atoi(optarg); break;
+      case 't': opt_timebase = atoi(optarg); break;
+      case 'w': opt_warmup_loops = atoi(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+}  /* get_options */
+
+
+/* Fixed-size pool with room for every block that can be in flight.
+ */
+void pool_init(alloc_pool_t *pool, size_t block_size)
+{
+  size_t num_blocks = ALLOC_POOL_BYTES / block_size;
+  char *mem;
+  size_t i;
+
+  if (num_blocks < 2 * ALLOC_RING_SIZE) {
+    num_blocks = 2 * ALLOC_RING_SIZE;
+  }
+  block_size = (block_size + 63) & ~(size_t)63;  /* Whole cache lines. */
+  mem = (char *)jtr_mem_alloc(num_blocks * block_size);
+  memset(mem, 0, num_blocks * block_size);  /* Page it in. */
+
+  pool->block_size = block_size;
+  pool->free_list = NULL;
+  pool->remote_free = NULL;
+  for (i = 0; i < num_blocks; i++) {
+    *(void **)&mem[i * block_size] = pool->free_list;
+    pool->free_list = &mem[i * block_size];
+  }
+}  /* pool_init */
+
+
+void *pool_alloc(alloc_pool_t *pool)
+{
+  void *block;
+
+  while (unlikely(pool->free_list == NULL)) {
+    /* Take back everything other threads have freed. */
+    pool->free_list = __atomic_exchange_n(&pool->remote_free, NULL,
+                                          __ATOMIC_ACQUIRE);
+  }
+  block = pool->free_list;
+  pool->free_list = *(void **)block;
+  return block;
+}  /* pool_alloc */
+
+
+void pool_free_local(alloc_pool_t *pool, void *block)
+{
+  *(void **)block = pool->free_list;
+  pool->free_list = block;
+}  /* pool_free_local */
+
+
+void pool_free_remote(alloc_pool_t *pool, void *block)
+{
+  void *head = __atomic_load_n(&pool->remote_free, __ATOMIC_RELAXED);
+
+  do {
+    *(void **)block = head;
+  } while (! __atomic_compare_exchange_n(&pool->remote_free, &head, block,
+                                         1, __ATOMIC_RELEASE,
+                                         __ATOMIC_RELAXED));
+}  /* pool_free_remote */
+
+
+/* Bump allocator. Blocks are not reused one by one; when the arena is
+ * full, it waits until every block has been freed and starts over.
+ */
+void *arena_alloc(size_t size)
+{
+  void *block;
+
+  size = (size + 63) & ~(size_t)63;
+  if (unlikely(alloc_arena_used + size > ALLOC_ARENA_BYTES)) {
+    while (__atomic_load_n(&alloc_arena_frees, __ATOMIC_ACQUIRE)
+           != alloc_arena_allocs) {
+    }
+    alloc_arena_used = 0;
+    alloc_arena_allocs = 0;
+    __atomic_store_n(&alloc_arena_frees, 0, __ATOMIC_RELAXED);
+  }
+  block = &alloc_arena[alloc_arena_used];
+  alloc_arena_used += size;
+  alloc_arena_allocs ++;
+  return block;
+}  /* arena_alloc */
+
+
+void arena_free(void *block)
+{
+  __atomic_add_fetch(&alloc_arena_frees, 1, __ATOMIC_RELEASE);
+}  /* arena_free */
+
+
+void alloc_free(int allocator, int size_idx, int remote, void *block)
+{
+  switch (allocator) {
+    case ALLOC_MALLOC: free(block); break;
+    case ALLOC_POOL:
+      if (remote) {
+        pool_free_remote(&alloc_pools[size_idx], block);
+      } else {
+        pool_free_local(&alloc_pools[size_idx], block);
+      }
+      break;
+    case ALLOC_ARENA: arena_free(block); break;
+    default: break;
+  }  /* switch allocator */
+}  /* alloc_free */
+
+
+/* Frees the blocks passed through alloc_ring, in the "cross" pattern.
+ */
+void *free_thread(void *arg)
+{
+  unsigned int tail;
+  void *block;
+
+  if (alloc_free_cpu_num >= 0) {
+    jtr_pin_cpu(alloc_free_cpu_num);
+  }
+
+  while (alloc_free_running) {
+    tail = alloc_ring.tail;
+    if (tail == __atomic_load_n(&alloc_ring.head, __ATOMIC_ACQUIRE)) {
+      continue;  /* Empty. */
+    }
+    block = alloc_ring.blocks[tail % ALLOC_RING_SIZE];
+    alloc_free(alloc_cur, alloc_cur_size, 1, block);
+    __atomic_store_n(&alloc_ring.tail, tail + 1, __ATOMIC_RELEASE);
+  }
+
+  return NULL;
+}  /* free_thread */
+
+
+/* One sample: allocate, fill, free (or hand off to be freed).
+ */
+void alloc_cb(void *clientd)
+{
+  int size = alloc_sizes[alloc_cur_size];
+  unsigned int head;
+  char *block;
+
+  switch (alloc_cur) {
+    case ALLOC_MALLOC: block = (char *)malloc(size); break;
+    case ALLOC_POOL: block = (char *)pool_alloc(&alloc_pools[alloc_cur_size]);
+      break;
+    case ALLOC_ARENA: block = (char *)arena_alloc(size); break;
+    default: block = alloc_static_buf; break;
+  }  /* switch alloc_cur */
+
+  memset(block, (int)(long)block, size);
+
+  if (alloc_cur_cross && alloc_cur != ALLOC_NONE) {
+    head = alloc_ring.head;
+    while (head - __atomic_load_n(&alloc_ring.tail, __ATOMIC_ACQUIRE)
+           >= ALLOC_RING_SIZE) {
+    }  /* Full; wait for the freeing thread. */
+    alloc_ring.blocks[head % ALLOC_RING_SIZE] = block;
+    __atomic_store_n(&alloc_ring.head, head + 1, __ATOMIC_RELEASE);
+  } else {
+    alloc_free(alloc_cur, alloc_cur_size, 0, block);
+  }
+}  /* alloc_cb */
+
+
+/* Wait until the freeing thread has freed every block handed to it.
+ */
+void drain_ring(void)
+{
+  while (__atomic_load_n(&alloc_ring.tail, __ATOMIC_ACQUIRE)
+         != alloc_ring.head) {
+    usleep(100);
+  }
+}  /* drain_ring */
+
+
+int main(int argc, char **argv)
+{
+  char title[1024];
+  char label[256];
+  char *p;
+  int max_size = 0;
+  int cross;
+  int i;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  jtr_y_high = opt_num_samples;
+
+  for (p = opt_Sizes; *p != '\0'; ) {
+    SYSE(alloc_num_sizes >= ALLOC_MAX_SIZES);
+    alloc_sizes[alloc_num_sizes] = (int)strtol(p, &p, 10);
+    if (alloc_sizes[alloc_num_sizes] < (int)sizeof(void *)) {
+      fprintf(stderr, "Bad size in '%s'\n", opt_Sizes);
+      usage();
+    }
+    if (alloc_sizes[alloc_num_sizes] > max_size) {
+      max_size = alloc_sizes[alloc_num_sizes];
+    }
+    alloc_num_sizes ++;
+    if (*p == ',') {
+      p++;
+    }
+  }
+
+  jtr_mem_init(opt_mem_mode);  /* Before any buffers are allocated. */
+  jtr_store_init(opt_results_store, opt_cpu_num);
+
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = '\0';
+  }
+  for (i = 0; i < sizeof(jtr_gnuplot_buf); i++) {
+    jtr_gnuplot_buf[i] = '\0';
+  }
+
+  if (opt_cpu_num >= 0) {
+    jtr_pin_cpu(opt_cpu_num);
+    alloc_free_cpu_num = jtr_cpu_related(opt_cpu_num, opt_Free_placement);
+  }
+
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+
+  if (opt_timebase == 3 && ! jtr_cycles_init()) {
+    opt_timebase = 1;  /* No usable cycle counter. */
+  }
+
+  alloc_static_buf = (char *)jtr_mem_alloc(max_size);
+  memset(alloc_static_buf, 0, max_size);
+  if (jtr_name_in_list(opt_Allocators, "pool")) {
+    for (i = 0; i < alloc_num_sizes; i++) {
+      pool_init(&alloc_pools[i], alloc_sizes[i]);
+    }
+  }
+  if (jtr_name_in_list(opt_Allocators, "arena")) {
+    alloc_arena = (char *)jtr_mem_alloc(ALLOC_ARENA_BYTES);
+    memset(alloc_arena, 0, ALLOC_ARENA_BYTES);  /* Page it in. */
+  }
+
+  if (jtr_name_in_list(opt_Patterns, "cross")) {
+    alloc_free_running = 1;
+    SYSE(pthread_create(&alloc_free_thread_id, NULL, free_thread, NULL));
+  }
+
+  /* Do 10 cycles of calibration. */
+  for (i = 0; i < 10; i++) {
+    jtr_calibrate();
+  }
+
+  /* Conduct the timing tests! */
+
+  for (alloc_cur = 0; alloc_cur < ALLOC_NUM; alloc_cur++) {
+    if (! jtr_name_in_list(opt_Allocators, alloc_names[alloc_cur])) {
+      continue;
+    }
+    for (alloc_cur_size = 0; alloc_cur_size < alloc_num_sizes;
+         alloc_cur_size++) {
+      for (cross = 0; cross < 2; cross++) {
+        if (! jtr_name_in_list(opt_Patterns, cross ? "cross" : "same")) {
+          continue;
+        }
+        alloc_cur_cross = cross;
+        jtr_histo_init(opt_histo_buckets);
+        jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
+                          opt_timebase, alloc_cb, NULL);
+        drain_ring();
+
+        snprintf(title, sizeof(title),
+                "%s: allocator=%s, size=%d, free=%s, free_cpu_num=%d,"
+                " cpu_num=%d, fifo_priority=%d, histo_buckets=%d,"
+                " num_samples=%d,\n"
+                " pause=%d timebase=%d, warmup_loops=%d, mem_mode=%d,"
+                " gettime_cost=%lld,\n"
+                " rdtsc_cost=%lld, ticks_per_sec=%lld,"
+                " jtr_1000_loops_cost=%lld",
+                opt_descr, alloc_names[alloc_cur],
+                alloc_sizes[alloc_cur_size], cross ? "cross" : "same",
+                cross ? alloc_free_cpu_num : opt_cpu_num,
+                opt_cpu_num, opt_fifo_priority, opt_histo_buckets,
+                opt_num_samples,
+                opt_pause, opt_timebase, opt_warmup_loops, opt_mem_mode,
+                jtr_gettime_cost,
+                jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
+        SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
+        snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+                 sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+                 "%s\n", title);
+        SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+        jtr_histo_print_all(opt_verbose, title);
+
+        snprintf(label, sizeof(label), "%-6s size=%-6d free=%s",
+                 alloc_names[alloc_cur], alloc_sizes[alloc_cur_size],
+                 cross ? "cross" : "same ");
+        jtr_histo_brief(alloc_summary_buf, sizeof(alloc_summary_buf), label);
+      }
+    }
+  }
+
+  if (alloc_free_running) {
+    alloc_free_running = 0;
+    SYSE(pthread_join(alloc_free_thread_id, NULL));
+  }
+
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Allocator summary (ns):\n%s", alloc_summary_buf);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+  if (opt_verbose >= 0) {
+    printf("%s", jtr_results_buf);
+
+    if (opt_gnuplot_file != NULL) {
+      FILE *gnuplot_fp = fopen(opt_gnuplot_file, "w");
+      SYSE(gnuplot_fp == NULL);
+
+      fprintf(gnuplot_fp, "%s", jtr_gnuplot_buf);
+      fclose(gnuplot_fp);
+    }
+  }
+
+  return 0;
+}  /* main */
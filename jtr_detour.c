@@ -0,0 +1,420 @@
+/* jtr_detour.c - all-core detour (hiccup) detector.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+
+/* Unlike jtr_null, which times short sampled intervals on one core, this
+ * spins reading the TSC continuously on every selected core at once. Any
+ * gap between consecutive reads longer than a threshold is time the core
+ * was taken away (interrupt, SMI, preemption, TLB shootdown, ...) and is
+ * logged with its start time. Detours that overlap across cores point to
+ * a host-wide cause.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+char *opt_descr = "Jitter detour test";
+int opt_fifo_priority = -1;
+char *opt_gnuplot_file = NULL;
+int opt_histo_buckets = 10000;
+int opt_verbose = 0;
+
+/* Options specific to the detour test. */
+char *opt_Cpu_list = "5";
+int opt_Duration_sec = 10;
+int opt_Log_size = 100000;
+int opt_Num_worst = 20;
+int opt_Threshold_ns = 500;
+
+/* Other globals. */
+#define DETOUR_MAX_CORES 256
+/* Results buffer kept free for the sections after the "-v 1" listing. */
+#define DETOUR_RESULTS_RESERVE 8192
+
+typedef struct detour_s {
+  long long start_ticks;  /* TSC just before the gap. */
+  long long gap_ticks;
+} detour_t;
+
+typedef struct detour_core_s {
+  int cpu_num;
+  pthread_t thread_id;
+  detour_t *log;     /* Preallocated, opt_Log_size entries. */
+  int num_detours;   /* May exceed opt_Log_size; later ones not logged. */
+  long long stolen_ticks;
+  long long max_gap_ticks;
+  long long min_gap_ticks;  /* Cost of one loop when undisturbed. */
+  long long num_loops;
+} detour_core_t;
+
+typedef struct detour_ref_s {  /* For sorting all logs together. */
+  int core;
+  detour_t *detour;
+} detour_ref_t;
+
+detour_core_t detour_cores[DETOUR_MAX_CORES];
+int detour_num_cores = 0;
+pthread_barrier_t detour_barrier;
+long long detour_start_ticks;
+long long detour_duration_ticks;
+long long detour_threshold_ticks;
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_detour [-C cpu_list] [-D duration_sec] [-L log_size]"
+" [-N num_worst] [-T threshold_ns]"
+" [-d descr] [-f fifo_priority] [-g gnuplot_file] [-h histo_buckets]"
+" [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -C cpu_list : CPUs to watch, e.g. '2,3,8-11'; one spinning thread is\n"
+"              pinned to each. (default=5)\n"
+" -D duration_sec : seconds to watch. (default=10)\n"
+" -L log_size : detours logged per core; more are counted but not logged.\n"
+"               (default=100000)\n"
+" -N num_worst : number of worst detours to list. (default=20)\n"
+" -T threshold_ns : a gap between TSC reads longer than this is a detour.\n"
+"                   (default=500)\n"
+" -d descr : description string. (default='Jitter detour test')\n"
+" -f fifo_priority : integer priority level to set real-time FIFO scheduling.\n"
+"                  : -1 does not set real-time. (default=-1)\n"
+" -g gnuplot_file : name of file to create containing gnuplot commands to\n"
+"                   graph the detour durations. (default=no file)\n"
+" -h histo_buckets : number of buckets for the detour duration histogram.\n"
+"                    (default=10000)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet, 0=normal, 1=also list every logged detour.\n"
+"              (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "C:D:L:N:T:d:f:g:h:v:")) != EOF) {
+    switch (opt) {
+      case 'C': opt_Cpu_list = strdup(optarg); break;
+      case 'D': opt_Duration_sec = atoi(optarg); break;
+      case 'L': opt_Log_size = atoi(optarg); break;
+      case 'N': opt_Num_worst = atoi(optarg); break;
+      case 'T': opt_Threshold_ns = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'f': opt_fifo_priority = atoi(optarg); break;
+      case 'g': opt_gnuplot_file = strdup(optarg); break;
+      case 'h': opt_histo_buckets = atoi(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+}  /* get_options */
+
+
+void *detour_thread(void *arg)
+{
+  detour_core_t *dc = (detour_core_t *)arg;
+  uint32_t ticks_hi, ticks_lo;
+  long long prev_ticks, cur_ticks, gap_ticks, end_ticks;
+  long long min_gap_ticks = 0x7fffffffffffffff;
+  long long num_loops = 0;
+
+  jtr_pin_cpu(dc->cpu_num);
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+  memset(dc->log, 0, opt_Log_size * sizeof(detour_t));  /* Page it in. */
+
+  pthread_barrier_wait(&detour_barrier);
+  end_ticks = detour_start_ticks + detour_duration_ticks;
+
+  RDTSC(ticks_hi, ticks_lo);
+  prev_ticks = ((long long)ticks_hi << 32) + (long long)ticks_lo;
+  do {
+    RDTSC(ticks_hi, ticks_lo);
+    cur_ticks = ((long long)ticks_hi << 32) + (long long)ticks_lo;
+    gap_ticks = cur_ticks - prev_ticks;
+    if (unlikely(gap_ticks > detour_threshold_ticks)) {
+      if (dc->num_detours < opt_Log_size) {
+        dc->log[dc->num_detours].start_ticks = prev_ticks;
+        dc->log[dc->num_detours].gap_ticks = gap_ticks;
+      }
+      dc->num_detours ++;
+      dc->stolen_ticks += gap_ticks;
+      if (gap_ticks > dc->max_gap_ticks) {
+        dc->max_gap_ticks = gap_ticks;
+      }
+    } else if (unlikely(gap_ticks < min_gap_ticks)) {
+      min_gap_ticks = gap_ticks;
+    }
+    num_loops ++;
+    prev_ticks = cur_ticks;
+  } while (cur_ticks < end_ticks);
+
+  dc->min_gap_ticks = min_gap_ticks;
+  dc->num_loops = num_loops;
+  return NULL;
+}  /* detour_thread */
+
+
+/* Return a list of the other cores that had a logged detour overlapping
+ * [start, start+gap), e.g. "3,7", or "-".
+ */
+void aligned_cores(int core, detour_t *det, char *buf, size_t buf_size)
+{
+  detour_core_t *dc;
+  long long end_ticks = det->start_ticks + det->gap_ticks;
+  int lo, hi, mid;
+  int num_logged;
+  int c;
+
+  buf[0] = '\0';
+  for (c = 0; c < detour_num_cores; c++) {
+    if (c == core) {
+      continue;
+    }
+    dc = &detour_cores[c];
+    num_logged = (dc->num_detours < opt_Log_size) ?
+                 dc->num_detours : opt_Log_size;
+
+    /* Log is in time order; find first detour ending after our start. */
+    lo = 0;
+    hi = num_logged;
+    while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (dc->log[mid].start_ticks + dc->log[mid].gap_ticks
+          <= det->start_ticks) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo < num_logged && dc->log[lo].start_ticks < end_ticks) {
+      snprintf(&buf[strlen(buf)], buf_size - strlen(buf), "%s%d",
+               (buf[0] == '\0') ? "" : ",", dc->cpu_num);
+    }
+  }
+  if (buf[0] == '\0') {
+    snprintf(buf, buf_size, "-");
+  }
+}  /* aligned_cores */
+
+
+int detour_ref_cmp(const void *a, const void *b)
+{
+  long long gap_a = ((detour_ref_t *)a)->detour->gap_ticks;
+  long long gap_b = ((detour_ref_t *)b)->detour->gap_ticks;
+
+  return (gap_a < gap_b) ? 1 : ((gap_a > gap_b) ? -1 : 0);
+}  /* detour_ref_cmp */
+
+
+int main(int argc, char **argv)
+{
+  uint32_t ticks_hi, ticks_lo;
+  detour_core_t *dc;
+  detour_ref_t *refs;
+  char aligned[1024];
+  char title[1024];
+  int cpus[DETOUR_MAX_CORES];
+  int num_refs;
+  int num_aligned;
+  int num_logged;
+  int c, i;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+  detour_num_cores = jtr_parse_cpu_list(opt_Cpu_list, cpus, DETOUR_MAX_CORES);
+  if (detour_num_cores <= 0) {
+    fprintf(stderr, "Bad cpu_list '%s'\n", opt_Cpu_list);
+    usage();
+  }
+  for (c = 0; c < detour_num_cores; c++) {
+    detour_cores[c].cpu_num = cpus[c];
+  }
+
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = '\0';
+  }
+  for (i = 0; i < sizeof(jtr_gnuplot_buf); i++) {
+    jtr_gnuplot_buf[i] = '\0';
+  }
+
+  /* Do 10 cycles of calibration. */
+  for (i = 0; i < 10; i++) {
+    jtr_calibrate();
+  }
+  detour_duration_ticks = (long long)opt_Duration_sec * jtr_ticks_per_sec;
+  detour_threshold_ticks = ((long long)opt_Threshold_ns * jtr_ticks_per_sec)
+                           / NANOS_PER_SEC;
+
+  SYSE(pthread_barrier_init(&detour_barrier, NULL, detour_num_cores + 1));
+  for (c = 0; c < detour_num_cores; c++) {
+    dc = &detour_cores[c];
+    dc->log = (detour_t *)malloc(opt_Log_size * sizeof(detour_t));
+    SYSE(dc->log == NULL);
+    SYSE(pthread_create(&dc->thread_id, NULL, detour_thread, dc));
+  }
+
+  RDTSC(ticks_hi, ticks_lo);
+  detour_start_ticks = ((long long)ticks_hi << 32) + (long long)ticks_lo;
+  pthread_barrier_wait(&detour_barrier);  /* Go. */
+
+  for (c = 0; c < detour_num_cores; c++) {
+    SYSE(pthread_join(detour_cores[c].thread_id, NULL));
+  }
+
+  snprintf(title, sizeof(title),
+          "%s: cpu_list=%s, duration_sec=%d, threshold_ns=%d,"
+          " fifo_priority=%d,\n"
+          " log_size=%d, histo_buckets=%d, rdtsc_cost=%lld,"
+          " ticks_per_sec=%lld",
+          opt_descr, opt_Cpu_list, opt_Duration_sec, opt_Threshold_ns,
+          opt_fifo_priority, opt_Log_size, opt_histo_buckets,
+          jtr_rdtsc_cost, jtr_ticks_per_sec);
+  SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "%s\n", title);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+  /* Per-core summary, and all detours into one histogram and list. */
+  jtr_histo_init(opt_histo_buckets);
+  num_refs = 0;
+  for (c = 0; c < detour_num_cores; c++) {
+    num_refs += (detour_cores[c].num_detours < opt_Log_size) ?
+                detour_cores[c].num_detours : opt_Log_size;
+  }
+  refs = (detour_ref_t *)malloc((num_refs + 1) * sizeof(detour_ref_t));
+  SYSE(refs == NULL);
+  num_refs = 0;
+  num_aligned = 0;
+  for (c = 0; c < detour_num_cores; c++) {
+    dc = &detour_cores[c];
+    num_logged = (dc->num_detours < opt_Log_size) ?
+                 dc->num_detours : opt_Log_size;
+    for (i = 0; i < num_logged; i++) {
+      jtr_histo_accum(jtr_ticks_to_ns(dc->log[i].gap_ticks));
+      refs[num_refs].core = c;
+      refs[num_refs].detour = &dc->log[i];
+      num_refs ++;
+      aligned_cores(c, &dc->log[i], aligned, sizeof(aligned));
+      if (strcmp(aligned, "-") != 0) {
+        num_aligned ++;
+      }
+    }
+
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Cpu %d: Detours=%d, Logged=%d, Stolen_ns=%lld, Stolen_pct=%.4lf,"
+             " Max_detour_ns=%lld, Loops=%lld, Min_loop_ns=%lld\n",
+             dc->cpu_num, dc->num_detours, num_logged,
+             jtr_ticks_to_ns(dc->stolen_ticks),
+             (100.0 * (double)dc->stolen_ticks) / (double)detour_duration_ticks,
+             jtr_ticks_to_ns(dc->max_gap_ticks), dc->num_loops,
+             jtr_ticks_to_ns(dc->min_gap_ticks));
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  }
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Logged detours overlapping a detour on another core: %d of %d\n",
+           num_aligned, num_refs);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+  /* Worst detours, with the cores that were out at the same time. */
+  qsort(refs, num_refs, sizeof(detour_ref_t), detour_ref_cmp);
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Worst detours (start_ns is from the start of the test):\n");
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  for (i = 0; i < num_refs && i < opt_Num_worst; i++) {
+    aligned_cores(refs[i].core, refs[i].detour, aligned, sizeof(aligned));
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "  cpu=%d, start_ns=%lld, duration_ns=%lld, aligned_cpus=%s\n",
+             detour_cores[refs[i].core].cpu_num,
+             jtr_ticks_to_ns(refs[i].detour->start_ticks - detour_start_ticks),
+             jtr_ticks_to_ns(refs[i].detour->gap_ticks), aligned);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  }
+
+  if (opt_verbose > 0) {
+    for (c = 0; c < detour_num_cores; c++) {
+      dc = &detour_cores[c];
+      num_logged = (dc->num_detours < opt_Log_size) ?
+                   dc->num_detours : opt_Log_size;
+      for (i = 0; i < num_logged; i++) {
+        if (strlen(jtr_results_buf) + DETOUR_RESULTS_RESERVE
+            >= sizeof(jtr_results_buf)) {
+          break;  /* Print what fits rather than abort. */
+        }
+        snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+                 sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+                 "detour cpu=%d, start_ns=%lld, duration_ns=%lld\n",
+                 dc->cpu_num,
+                 jtr_ticks_to_ns(dc->log[i].start_ticks - detour_start_ticks),
+                 jtr_ticks_to_ns(dc->log[i].gap_ticks));
+      }
+      if (i < num_logged) {
+        snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+                 sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+                 "(detour listing cut short; results buffer full)\n");
+        break;
+      }
+    }
+  }
+
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Detour durations (ns), all cores:\n");
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  if (jtr_histo_num_samples > 0) {
+    jtr_histo_print_all(0, title);
+  }
+
+  if (opt_verbose >= 0) {
+    printf("%s", jtr_results_buf);
+
+    if (opt_gnuplot_file != NULL) {
+      FILE *gnuplot_fp = fopen(opt_gnuplot_file, "w");
+      SYSE(gnuplot_fp == NULL);
+
+      fprintf(gnuplot_fp, "%s", jtr_gnuplot_buf);
+      fclose(gnuplot_fp);
+    }
+  }
+
+  return 0;
+}  /* main */
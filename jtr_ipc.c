@@ -0,0 +1,486 @@
+/* jtr_ipc.c - tool to measure local kernel IPC latency and jitter.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+/* Allow setting thread affinity. */
+#define _GNU_SOURCE
+#include <sched.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <mqueue.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+int opt_cpu_num = 5;
+char *opt_descr = "Jitter IPC test";
+int opt_fifo_priority = -1;
+char *opt_gnuplot_file = NULL;
+int opt_histo_buckets = 2000;
+int opt_loops = 3;
+int opt_num_samples = 200000;
+char *opt_results_store = "none";  /* See jtr_store_append(). */
+int opt_pause = 10000;
+int opt_timebase = 1;  /* 1=RDTSC, 2=clock_gettime() */
+int opt_warmup_loops = 1500;
+int opt_verbose = 0;
+char *opt_skew_table = NULL;  /* From jtr_tscskew. */
+
+/* Options specific to the IPC test. */
+char *opt_Primitives = "1234";
+char *opt_Peer_placement = "l3,socket";  /* See jtr_cpu_related(). */
+
+/* IPC primitives. See ipc_names[]. */
+#define IPC_PIPE 1
+#define IPC_UNIX_DGRAM 2
+#define IPC_EVENTFD 3
+#define IPC_MQUEUE 4
+char *ipc_names[] = {
+  "", "pipe", "unix datagram", "eventfd+shared slot", "POSIX mqueue"
+};
+
+/* The ping carries the sender's timestamp; the pong carries the peer's
+ * receive timestamp back so the one-way time can be computed without the
+ * peer having to do any histogramming. A negative seq terminates the peer.
+ */
+typedef struct ipc_msg_s {
+  uint64_t ticks;
+  int seq;
+  int pad;
+} ipc_msg_t;
+
+/* Channel state, created before fork() so both processes share it. */
+int ipc_prim;
+int ping_fds[2];  /* pipe or socketpair or eventfd (in [0]). */
+int pong_fds[2];
+mqd_t ping_mq, pong_mq;
+char ping_mq_name[64], pong_mq_name[64];
+volatile ipc_msg_t *ipc_slots;  /* eventfd: [0]=ping, [1]=pong. */
+pid_t peer_pid;
+int peer_cpu_num = -1;
+
+/* One-way samples are kept until the round-trip histogram is printed. */
+int *oneway_ns;
+int ipc_seq;
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_ipc [-C peer_placement] [-P primitives]"
+" [-c cpu_num] [-d descr] [-f fifo_priority] [-g gnuplot_file]"
+" [-h histo_buckets] [-l loops] [-n num_samples] [-o results_store]"
+" [-p pause] [-t timebase] [-w warmup_loops] [-k skew_table] [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -C peer_placement : CPU of the echo process, by its relation to\n"
+"                     cpu_num (see jtr_ss -P), or a CPU number (-1 to not\n"
+"                     pin). (default=l3,socket)\n"
+" -P primitives : string of IPC primitive numbers to test, in order.\n"
+"                 1=pipe, 2=unix datagram, 3=eventfd+shared slot,\n"
+"                 4=POSIX mqueue. (default=1234)\n"
+" -c cpu_num : integer CPU number to pin thread. Use -1 to not pin.\n"
+"              (default=5)\n"
+" -d descr : description string. (default='Jitter IPC test')\n"
+" -f fifo_priority : integer priority level to set real-time FIFO scheduling.\n"
+"                  : -1 does not set real-time. (default=-1)\n"
+" -g gnuplot_file : name of file to create containing gnuplot commands to\n"
+"                   graph the histogram data. (default=no file)\n"
+" -h histo_buckets : number of buckets for histogram. (default=2000)\n"
+" -k skew_table : TSC correction table written by jtr_tscskew, applied to\n"
+"                 one-way times between this thread and the peer process.\n"
+"                 (default=none)\n"
+" -l loops : number of test runs to perform. Each test run does two\n"
+"            histograms per primitive, round-trip and one-way. (default=3)\n"
+" -n num_samples : number of samples in a test. (default=200,000)\n"
+" -o results_store : directory to append each histogram to, with a host\n"
+"                    fingerprint including the mitigations; see jtr_query.\n"
+"                    (default=none)\n"
+" -p pause : number of nanoseconds to pause between each sample.\n"
+"            (default=10000)\n"
+" -t timebase : integer indicating which method of time measement to use.\n"
+"               1=RDTSC, 2=clock_gettime(), 3=core cycles (RDPMC).\n"
+"               (default=1)\n"
+"               One-way times always use RDTSC.\n"
+" -w warmup_loops : number of samples to initially take without accumulating\n"
+"                   the results. (default=1500)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet, 0=normal, 2=details. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "C:P:c:d:f:g:h:k:l:n:o:p:t:w:v:")) != EOF) {
+    switch (opt) {
+      case 'C': opt_Peer_placement = strdup(optarg); break;
+      case 'P': opt_Primitives = strdup(optarg); break;
+      case 'c': opt_cpu_num = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'f': opt_fifo_priority = atoi(optarg); break;
+      case 'g': opt_gnuplot_file = strdup(optarg); break;
+      case 'h': opt_histo_buckets = atoi(optarg); break;
+      case 'k': opt_skew_table = strdup(optarg); break;
+      case 'l': opt_loops = atoi(optarg); break;
+      case 'n': opt_num_samples = atoi(optarg); break;
+      case 'o': opt_results_store = strdup(optarg); break;
+      case 'p': opt_pause = atoi(optarg); break;
+      case 't': opt_timebase = atoi(optarg); break;
+      case 'w': opt_warmup_loops = atoi(optarg);
+        if (opt_warmup_loops < 0) usage();  /* Indexes samples by seq. */
+        break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+
+  /* A number pins the echo there even with "-c -1". */
+  if (opt_Peer_placement[0] == '-'
+      || (opt_Peer_placement[0] >= '0' && opt_Peer_placement[0] <= '9')) {
+    peer_cpu_num = atoi(opt_Peer_placement);
+  } else if (opt_cpu_num >= 0) {
+    peer_cpu_num = jtr_cpu_related(opt_cpu_num, opt_Peer_placement);
+  } else {
+    peer_cpu_num = -1;
+  }
+}  /* get_options */
+
+
+/* Create both directions of the channel for the selected primitive.
+ */
+void ipc_create(void)
+{
+  struct mq_attr attr;
+
+  switch (ipc_prim) {
+    case IPC_PIPE:
+      SYSE(pipe(ping_fds));
+      SYSE(pipe(pong_fds));
+      break;
+
+    case IPC_UNIX_DGRAM:
+      SYSE(socketpair(AF_UNIX, SOCK_DGRAM, 0, ping_fds));
+      SYSE(socketpair(AF_UNIX, SOCK_DGRAM, 0, pong_fds));
+      break;
+
+    case IPC_EVENTFD:
+      ping_fds[0] = eventfd(0, 0);
+      SYSE(ping_fds[0] == -1);
+      pong_fds[0] = eventfd(0, 0);
+      SYSE(pong_fds[0] == -1);
+      break;
+
+    case IPC_MQUEUE:
+      memset(&attr, 0, sizeof(attr));
+      attr.mq_maxmsg = 8;
+      attr.mq_msgsize = sizeof(ipc_msg_t);
+      snprintf(ping_mq_name, sizeof(ping_mq_name), "/jtr_ipc_ping.%d",
+               (int)getpid());
+      snprintf(pong_mq_name, sizeof(pong_mq_name), "/jtr_ipc_pong.%d",
+               (int)getpid());
+      ping_mq = mq_open(ping_mq_name, O_RDWR | O_CREAT | O_EXCL, 0600, &attr);
+      SYSE(ping_mq == (mqd_t)-1);
+      pong_mq = mq_open(pong_mq_name, O_RDWR | O_CREAT | O_EXCL, 0600, &attr);
+      SYSE(pong_mq == (mqd_t)-1);
+      /* Both processes already hold the descriptors after fork(). */
+      SYSE(mq_unlink(ping_mq_name));
+      SYSE(mq_unlink(pong_mq_name));
+      break;
+
+    default:
+      fprintf(stderr, "Bad primitive %d in -P\n", ipc_prim);
+      exit(1);
+  }  /* switch ipc_prim */
+}  /* ipc_create */
+
+
+void ipc_destroy(void)
+{
+  switch (ipc_prim) {
+    case IPC_PIPE:
+    case IPC_UNIX_DGRAM:
+      close(ping_fds[0]); close(ping_fds[1]);
+      close(pong_fds[0]); close(pong_fds[1]);
+      break;
+    case IPC_EVENTFD:
+      close(ping_fds[0]);
+      close(pong_fds[0]);
+      break;
+    case IPC_MQUEUE:
+      mq_close(ping_mq);
+      mq_close(pong_mq);
+      break;
+  }  /* switch ipc_prim */
+}  /* ipc_destroy */
+
+
+/* Send one message in one direction. "slot" is only used for eventfd.
+ */
+void ipc_send(int *fds, mqd_t mq, int slot, ipc_msg_t *msg)
+{
+  uint64_t one = 1;
+
+  switch (ipc_prim) {
+    case IPC_PIPE:
+    case IPC_UNIX_DGRAM:
+      SYSE(write(fds[1], msg, sizeof(*msg)) != sizeof(*msg));
+      break;
+    case IPC_EVENTFD:
+      ipc_slots[slot].ticks = msg->ticks;
+      ipc_slots[slot].seq = msg->seq;
+      SYSE(write(fds[0], &one, sizeof(one)) != sizeof(one));
+      break;
+    case IPC_MQUEUE:
+      SYSE(mq_send(mq, (char *)msg, sizeof(*msg), 0));
+      break;
+  }  /* switch ipc_prim */
+}  /* ipc_send */
+
+
+/* Block until one message arrives in one direction.
+ */
+void ipc_recv(int *fds, mqd_t mq, int slot, ipc_msg_t *msg)
+{
+  uint64_t count;
+
+  switch (ipc_prim) {
+    case IPC_PIPE:
+    case IPC_UNIX_DGRAM:
+      SYSE(read(fds[0], msg, sizeof(*msg)) != sizeof(*msg));
+      break;
+    case IPC_EVENTFD:
+      SYSE(read(fds[0], &count, sizeof(count)) != sizeof(count));
+      msg->ticks = ipc_slots[slot].ticks;
+      msg->seq = ipc_slots[slot].seq;
+      break;
+    case IPC_MQUEUE:
+      SYSE(mq_receive(mq, (char *)msg, sizeof(*msg), NULL) != sizeof(*msg));
+      break;
+  }  /* switch ipc_prim */
+}  /* ipc_recv */
+
+
+/* Echo process: stamp each ping on arrival and return the stamp.
+ */
+void ipc_peer(void)
+{
+  ipc_msg_t msg;
+  uint32_t ticks_hi, ticks_lo;
+
+  if (peer_cpu_num >= 0) {
+    jtr_pin_cpu(peer_cpu_num);
+  }
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+
+  while (1) {
+    ipc_recv(ping_fds, ping_mq, 0, &msg);
+    RDTSC(ticks_hi, ticks_lo);
+    if (msg.seq < 0) {
+      break;
+    }
+    msg.ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+    ipc_send(pong_fds, pong_mq, 1, &msg);
+  }
+  exit(0);
+}  /* ipc_peer */
+
+
+/* Timed callback: one full round trip.
+ */
+void ipc_rtt_cb(void *clientd)
+{
+  ipc_msg_t ping, pong;
+  uint32_t ticks_hi, ticks_lo;
+  long long diff_ns;
+  int idx;
+
+  RDTSC(ticks_hi, ticks_lo);
+  ping.ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+  ping.seq = ipc_seq;
+  ping.pad = 0;
+  ipc_send(ping_fds, ping_mq, 0, &ping);
+  ipc_recv(pong_fds, pong_mq, 1, &pong);
+
+  idx = ipc_seq - opt_warmup_loops;
+  if (idx >= 0) {
+    diff_ns = (((long long)pong.ticks - (long long)ping.ticks
+                - jtr_tscskew_ticks(opt_cpu_num, peer_cpu_num,
+                                    (long long)pong.ticks)) * NANOS_PER_SEC)
+              / jtr_ticks_per_sec;
+    diff_ns -= jtr_rdtsc_cost;  /* Correct for measurement cost. */
+    oneway_ns[idx] = (int)diff_ns;
+  }
+  ipc_seq ++;
+}  /* ipc_rtt_cb */
+
+
+/* Add the title for one histogram to the results and print the histogram.
+ */
+void ipc_print(char *kind)
+{
+  char title[1024];
+
+  snprintf(title, sizeof(title),
+          "%s (%s, %s): Peer_cpu_num=%d, skew_table=%s,"
+          " cpu_num=%d, fifo_priority=%d, histo_buckets=%d, num_samples=%d,\n"
+          " pause=%d timebase=%d, warmup_loops=%d, gettime_cost=%lld,\n"
+          " rdtsc_cost=%lld, ticks_per_sec=%lld, jtr_1000_loops_cost=%lld",
+          opt_descr, ipc_names[ipc_prim], kind, peer_cpu_num,
+          (opt_skew_table == NULL) ? "none" : opt_skew_table,
+          opt_cpu_num, opt_fifo_priority, opt_histo_buckets, opt_num_samples,
+          opt_pause, opt_timebase, opt_warmup_loops, jtr_gettime_cost,
+          jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
+  SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "%s\n", title);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  jtr_histo_print_all(opt_verbose, title);
+}  /* ipc_print */
+
+
+int main(int argc, char **argv)
+{
+  int i, p, s;
+  ipc_msg_t end_msg;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  jtr_y_high = opt_num_samples;
+  jtr_store_init(opt_results_store, opt_cpu_num);
+
+  oneway_ns = (int *)malloc(opt_num_samples * sizeof(int));
+  SYSE(oneway_ns == NULL);
+  ipc_slots = mmap(NULL, 2 * sizeof(ipc_msg_t), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  SYSE(ipc_slots == MAP_FAILED);
+
+  /* Empty out the results buffer (and page it in). */
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = 0;
+  }
+  for (i = 0; i < sizeof(jtr_gnuplot_buf); i++) {
+    jtr_gnuplot_buf[i] = '\0';
+  }
+  for (i = 0; i < opt_num_samples; i++) {
+    oneway_ns[i] = 0;
+  }
+
+  if (opt_cpu_num >= 0) {
+    jtr_pin_cpu(opt_cpu_num);
+  }
+
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+
+  if (opt_timebase == 3 && ! jtr_cycles_init()) {
+    opt_timebase = 1;  /* No usable cycle counter. */
+  }
+
+  for (i = 0; i < 20; i++) {
+    jtr_calibrate();
+  }
+
+  if (opt_skew_table != NULL) {
+    if (jtr_tscskew_load(opt_skew_table) == 0
+        || ! jtr_tscskew_known(opt_cpu_num)
+        || ! jtr_tscskew_known(peer_cpu_num)) {
+      fprintf(stderr, "Skew table '%s' can't correct cpu %d to %d;"
+              " both must be pinned and in jtr_tscskew's -C list\n",
+              opt_skew_table, opt_cpu_num, peer_cpu_num);
+      exit(1);
+    }
+  }
+
+  /* Conduct the timing tests! */
+
+  for (i = 0; i < opt_loops; i++) {
+    for (p = 0; opt_Primitives[p] != '\0'; p++) {
+      ipc_prim = opt_Primitives[p] - '0';
+      ipc_create();
+      fflush(stdout);
+      peer_pid = fork();
+      SYSE(peer_pid == -1);
+      if (peer_pid == 0) {
+        ipc_peer();  /* Does not return. */
+      }
+
+      ipc_seq = 0;
+      jtr_histo_init(opt_histo_buckets);
+      jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
+                        opt_timebase, ipc_rtt_cb, NULL);
+      ipc_print("round trip");
+
+      jtr_histo_init(opt_histo_buckets);
+      for (s = 0; s < opt_num_samples; s++) {
+        if (unlikely(oneway_ns[s] < 0)) {
+          jtr_neg_diffs ++;
+          oneway_ns[s] = 0;
+        }
+        jtr_histo_accum(oneway_ns[s]);
+      }
+      ipc_print("one way");
+
+      memset(&end_msg, 0, sizeof(end_msg));
+      end_msg.seq = -1;
+      ipc_send(ping_fds, ping_mq, 0, &end_msg);
+      SYSE(waitpid(peer_pid, NULL, 0) != peer_pid);
+      ipc_destroy();
+    }  /* for p */
+  }  /* for i */
+
+  if (opt_verbose >= 0) {
+    printf("%s", jtr_results_buf);
+
+    if (opt_gnuplot_file != NULL) {
+      FILE *gnuplot_fp = fopen(opt_gnuplot_file, "w");
+      SYSE(gnuplot_fp == NULL);
+
+      fprintf(gnuplot_fp, "%s", jtr_gnuplot_buf);
+      fclose(gnuplot_fp);
+    }
+  }
+
+  return 0;
+}  /* main */
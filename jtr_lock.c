@@ -0,0 +1,487 @@
+/* jtr_lock.c - jitter of several threads sending through one locked sender.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+
+/* A UM source can be shared by several application threads, and then
+ * every send goes through the source's lock. This reproduces that without
+ * UM: "-T" threads, each pinned to its own CPU, send UDP datagrams through
+ * one shared sender (a socket, a destination, and a sequence number)
+ * guarded by one of the following (the spinning ones need a CPU for
+ * each thread, which get_options() checks):
+ *   mutex  - pthread mutex (futex based; waiters sleep).
+ *   spin   - test-and-test-and-set spin lock.
+ *   ticket - ticket lock (FIFO; all waiters spin on one line).
+ *   mcs    - MCS queue lock (FIFO; each waiter spins on its own node).
+ * Each thread times, with the probe API, how long it waited for the lock
+ * and how long it held it (the sendto()), into its own histograms. The
+ * full histograms are of all threads together; each thread's own are
+ * summarized at the end.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+int opt_cpu_num = 5;
+char *opt_descr = "Jitter lock test";
+char *opt_gnuplot_file = NULL;
+int opt_histo_buckets = 2000;
+int opt_loops = 1;
+int opt_num_samples = 100000;
+char *opt_results_store = "none";  /* See jtr_store_append(). */
+int opt_pause = 2000;
+int opt_warmup_loops = 1500;
+int opt_verbose = 0;
+
+/* Options specific to the lock test. */
+unsigned short opt_Destport = 12000;
+unsigned long opt_Groupaddr = 0;  /* Destination; 0=127.0.0.1. */
+char *opt_Locks = "mutex,spin,ticket,mcs";
+int opt_Msg_len = 24;
+int opt_Threads = 4;
+
+/* Other globals. */
+#define LOCK_MAX_THREADS (JTR_PROBE_MAX_PROBES / 2)  /* Wait and hold each. */
+#define LOCK_MAX_MSG_LEN 1472
+
+enum { LOCK_MUTEX, LOCK_SPIN, LOCK_TICKET, LOCK_MCS, LOCK_NUM };
+char *lock_names[LOCK_NUM] = { "mutex", "spin", "ticket", "mcs" };
+
+#define CPU_RELAX() asm volatile ("pause" ::: "memory")
+
+typedef struct mcs_node_s {
+  struct mcs_node_s *volatile next;
+  volatile int locked;
+} mcs_node_t;
+
+/* The shared sender. The lock and the state it guards share cache lines,
+ * as they would in a real sender object.
+ */
+typedef struct lock_sender_s {
+  pthread_mutex_t mutex;
+  volatile int spin;
+  volatile unsigned int ticket_next;
+  volatile unsigned int ticket_serving;
+  mcs_node_t *volatile mcs_tail;
+  int sock_fd;
+  struct sockaddr_in dest;
+  long long seq;
+  char msg[LOCK_MAX_MSG_LEN];
+} lock_sender_t;
+
+typedef struct lock_thread_s {
+  mcs_node_t mcs_node __attribute__ ((aligned (64)));
+  int index;
+  pthread_t thread_id;
+} lock_thread_t;
+
+lock_sender_t lock_sender __attribute__ ((aligned (64)));
+lock_thread_t lock_threads[LOCK_MAX_THREADS];
+pthread_barrier_t lock_barrier;
+int lock_cur;  /* LOCK_* of the current run. */
+int lock_num_runs;  /* opt_loops per selected lock. */
+#define LOCK_SUMMARY_LINE 256  /* Bound on a jtr_histo_brief() line. */
+char *lock_summary_buf;  /* Per-thread one-liners, printed at end. */
+size_t lock_summary_size;
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_lock [-D destport] [-G dest_addr] [-L locks] [-M msg_len]"
+" [-T threads] [-c cpu_num] [-d descr] [-g gnuplot_file]"
+" [-h histo_buckets] [-l loops] [-n num_samples] [-o results_store]"
+" [-p pause] [-w warmup_loops] [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -D destport : UDP port to send to. (default=12000)\n"
+" -G dest_addr : IP address to send to. (default=127.0.0.1)\n"
+" -L locks : comma-separated list of mutex, spin, ticket, mcs.\n"
+"            (default=mutex,spin,ticket,mcs)\n"
+" -M msg_len : datagram size in bytes. (default=24)\n"
+" -T threads : number of sending threads. (default=4)\n"
+" -c cpu_num : integer CPU number to pin the first sending thread; the\n"
+"              others go on the following CPUs. Use -1 to not pin.\n"
+"              spin, ticket, and mcs need a CPU for each thread.\n"
+"              (default=5)\n"
+" -d descr : description string. (default='Jitter lock test')\n"
+" -g gnuplot_file : name of file to create containing gnuplot commands to\n"
+"                   graph the histogram data. (default=no file)\n"
+" -h histo_buckets : number of buckets for histogram. (default=2000)\n"
+" -l loops : number of test runs per lock. (default=1)\n"
+" -n num_samples : number of sends per thread in a test.\n"
+"                  (default=100,000)\n"
+" -o results_store : directory to append each histogram to, with a host\n"
+"                    fingerprint including the mitigations; see jtr_query.\n"
+"                    (default=none)\n"
+" -p pause : number of nanoseconds each thread pauses between sends.\n"
+"            (default=2000)\n"
+" -w warmup_loops : number of sends each thread initially does without\n"
+"                   accumulating the results. (default=1500)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet, 0=normal, 2=details. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int num_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+
+  while ((opt = getopt(argc, argv, "D:G:L:M:T:c:d:g:h:l:n:o:p:w:v:")) != EOF) {
+    switch (opt) {
+      case 'D': opt_Destport = atoi(optarg); break;
+      case 'G': opt_Groupaddr = inet_addr(optarg);
+        if (opt_Groupaddr == -1) {
+          fprintf(stderr, "Bad dest_addr '%s'\n", optarg);
+          usage();
+        }
+        break;
+      case 'L': opt_Locks = strdup(optarg); break;
+      case 'M': opt_Msg_len = atoi(optarg); break;
+      case 'T': opt_Threads = atoi(optarg); break;
+      case 'c': opt_cpu_num = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'g': opt_gnuplot_file = strdup(optarg); break;
+      case 'h': opt_histo_buckets = atoi(optarg); break;
+      case 'l': opt_loops = atoi(optarg); break;
+      case 'n': opt_num_samples = atoi(optarg); break;
+      case 'o': opt_results_store = strdup(optarg); break;
+      case 'p': opt_pause = atoi(optarg); break;
+      case 'w': opt_warmup_loops = atoi(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+  if (opt_Threads < 1 || opt_Threads > LOCK_MAX_THREADS) {
+    fprintf(stderr, "-T threads must be 1..%d\n", LOCK_MAX_THREADS);
+    usage();
+  }
+  if (opt_Msg_len < (int)sizeof(long long) || opt_Msg_len > LOCK_MAX_MSG_LEN) {
+    fprintf(stderr, "-M msg_len must be %d..%d\n", (int)sizeof(long long),
+            LOCK_MAX_MSG_LEN);
+    usage();
+  }
+  /* A spinning waiter that shares a CPU with the holder spins for its
+   * whole time slice; results would be of the scheduler, not the lock. */
+  if (jtr_name_in_list(opt_Locks, "spin")
+      || jtr_name_in_list(opt_Locks, "ticket")
+      || jtr_name_in_list(opt_Locks, "mcs")) {
+    if (opt_cpu_num >= 0 && opt_cpu_num + opt_Threads > num_cpus) {
+      fprintf(stderr, "spin, ticket, and mcs need a CPU per thread;"
+              " CPUs %d..%d needed, %d online\n",
+              opt_cpu_num, opt_cpu_num + opt_Threads - 1, num_cpus);
+      usage();
+    }
+    if (opt_cpu_num < 0 && opt_Threads > num_cpus) {
+      fprintf(stderr, "spin, ticket, and mcs need a CPU per thread;"
+              " %d threads but %d CPUs online\n", opt_Threads, num_cpus);
+      usage();
+    }
+  }
+}  /* get_options */
+
+
+void sender_lock(lock_sender_t *sender, mcs_node_t *node)
+{
+  unsigned int ticket;
+  mcs_node_t *pred;
+
+  switch (lock_cur) {
+    case LOCK_MUTEX:
+      SYSE(pthread_mutex_lock(&sender->mutex));
+      break;
+    case LOCK_SPIN:
+      while (__atomic_exchange_n(&sender->spin, 1, __ATOMIC_ACQUIRE)) {
+        while (sender->spin) {
+          CPU_RELAX();
+        }
+      }
+      break;
+    case LOCK_TICKET:
+      ticket = __atomic_fetch_add(&sender->ticket_next, 1, __ATOMIC_RELAXED);
+      while (__atomic_load_n(&sender->ticket_serving, __ATOMIC_ACQUIRE)
+             != ticket) {
+        CPU_RELAX();
+      }
+      break;
+    case LOCK_MCS:
+      node->next = NULL;
+      node->locked = 1;
+      pred = __atomic_exchange_n(&sender->mcs_tail, node, __ATOMIC_ACQ_REL);
+      if (pred != NULL) {
+        __atomic_store_n(&pred->next, node, __ATOMIC_RELEASE);
+        while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) {
+          CPU_RELAX();
+        }
+      }
+      break;
+  }  /* switch lock_cur */
+}  /* sender_lock */
+
+
+void sender_unlock(lock_sender_t *sender, mcs_node_t *node)
+{
+  mcs_node_t *expected;
+  mcs_node_t *next;
+
+  switch (lock_cur) {
+    case LOCK_MUTEX:
+      SYSE(pthread_mutex_unlock(&sender->mutex));
+      break;
+    case LOCK_SPIN:
+      __atomic_store_n(&sender->spin, 0, __ATOMIC_RELEASE);
+      break;
+    case LOCK_TICKET:
+      __atomic_store_n(&sender->ticket_serving, sender->ticket_serving + 1,
+                       __ATOMIC_RELEASE);
+      break;
+    case LOCK_MCS:
+      next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+      if (next == NULL) {
+        expected = node;
+        if (__atomic_compare_exchange_n(&sender->mcs_tail, &expected, NULL,
+                                        0, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+          break;  /* No waiters. */
+        }
+        /* A waiter has swapped itself in but not linked yet. */
+        while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))
+               == NULL) {
+          CPU_RELAX();
+        }
+      }
+      __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+      break;
+  }  /* switch lock_cur */
+}  /* sender_unlock */
+
+
+/* One send through the shared sender, timing the lock wait (probe 2*t)
+ * and the time the lock is held (probe 2*t+1).
+ */
+void lock_send(lock_thread_t *lt)
+{
+  lock_sender_t *sender = &lock_sender;
+
+  JTR_PROBE_BEGIN(2 * lt->index);
+  sender_lock(sender, &lt->mcs_node);
+  JTR_PROBE_END(2 * lt->index);
+
+  JTR_PROBE_BEGIN(2 * lt->index + 1);
+  sender->seq ++;
+  memcpy(sender->msg, &sender->seq, sizeof(sender->seq));
+  SYSE(sendto(sender->sock_fd, sender->msg, opt_Msg_len, 0,
+              (struct sockaddr *)&sender->dest, sizeof(sender->dest)) == -1
+       && errno != ENOBUFS && errno != EAGAIN);
+  JTR_PROBE_END(2 * lt->index + 1);
+  sender_unlock(sender, &lt->mcs_node);
+
+  jtr_spin_sleep_ns(opt_pause, 1);
+}  /* lock_send */
+
+
+/* The sending threads last for the whole program (the probe API keeps a
+ * slot per thread), and step through the runs with the main thread.
+ */
+void *lock_thread(void *arg)
+{
+  lock_thread_t *lt = (lock_thread_t *)arg;
+  int run, i;
+
+  if (opt_cpu_num >= 0) {
+    jtr_pin_cpu(opt_cpu_num + lt->index);
+  }
+
+  for (run = 0; run < lock_num_runs; run++) {
+    pthread_barrier_wait(&lock_barrier);  /* lock_cur is set. */
+
+    for (i = 0; i < opt_warmup_loops; i++) {
+      lock_send(lt);
+    }
+
+    /* Main thread resets the probes between these, dropping the warm-up. */
+    pthread_barrier_wait(&lock_barrier);
+    pthread_barrier_wait(&lock_barrier);
+
+    for (i = 0; i < opt_num_samples; i++) {
+      lock_send(lt);
+    }
+    pthread_barrier_wait(&lock_barrier);  /* Main thread reports. */
+  }
+
+  return NULL;
+}  /* lock_thread */
+
+
+/* Add the wait or hold histogram of all threads together to the results,
+ * and a one-line summary of each thread's own histogram to the summary.
+ */
+void lock_report(int run, char *kind)
+{
+  char title[1024];
+  char label[64];
+  int first_id = (strcmp(kind, "hold") == 0);
+  int t;
+
+  jtr_probe_snapshot_ids(first_id, opt_Threads, 2);
+
+  snprintf(title, sizeof(title),
+          "%s (%s, %s): threads=%d, run=%d, Msg_len=%d, Destport=%d,"
+          " cpu_num=%d, histo_buckets=%d, num_samples=%d,\n"
+          " pause=%d, warmup_loops=%d, probe_shift=%d,\n"
+          " rdtsc_cost=%lld, ticks_per_sec=%lld, jtr_1000_loops_cost=%lld",
+          opt_descr, lock_names[lock_cur], kind, opt_Threads, run,
+          opt_Msg_len, opt_Destport, opt_cpu_num,
+          opt_histo_buckets, opt_num_samples,
+          opt_pause, opt_warmup_loops, jtr_probe_shift,
+          jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
+  SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "%s\n", title);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  jtr_histo_print_all(opt_verbose, title);
+
+  snprintf(label, sizeof(label), "%-6s %-4s run=%d all      ",
+           lock_names[lock_cur], kind, run);
+  jtr_histo_brief(lock_summary_buf, lock_summary_size, label);
+  for (t = 0; t < opt_Threads; t++) {
+    jtr_probe_snapshot(2 * t + first_id);
+    snprintf(label, sizeof(label), "%-6s %-4s run=%d thread=%-2d",
+             lock_names[lock_cur], kind, run, t);
+    jtr_histo_brief(lock_summary_buf, lock_summary_size, label);
+  }
+}  /* lock_report */
+
+
+int main(int argc, char **argv)
+{
+  int run;
+  int t;
+  int i;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  jtr_y_high = opt_num_samples;
+  jtr_store_init(opt_results_store, opt_cpu_num);
+
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = '\0';
+  }
+  for (i = 0; i < sizeof(jtr_gnuplot_buf); i++) {
+    jtr_gnuplot_buf[i] = '\0';
+  }
+
+  memset(&lock_sender, 0, sizeof(lock_sender));
+  SYSE(pthread_mutex_init(&lock_sender.mutex, NULL));
+  lock_sender.sock_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  SYSE(lock_sender.sock_fd == -1);
+  lock_sender.dest.sin_family = AF_INET;
+  lock_sender.dest.sin_addr.s_addr = (opt_Groupaddr != 0)
+                                     ? opt_Groupaddr : htonl(INADDR_LOOPBACK);
+  lock_sender.dest.sin_port = htons(opt_Destport);
+
+  /* Calibrates (once per process) and sizes the per-thread histograms. */
+  jtr_probe_init(2 * opt_Threads, opt_histo_buckets);
+
+  jtr_preflight_print(opt_cpu_num);
+
+  lock_num_runs = 0;
+  for (i = 0; i < LOCK_NUM; i++) {
+    if (jtr_name_in_list(opt_Locks, lock_names[i])) {
+      lock_num_runs += opt_loops;
+    }
+  }
+  if (lock_num_runs == 0) {
+    fprintf(stderr, "No known lock in '%s'\n", opt_Locks);
+    usage();
+  }
+  /* Each run adds an "all" line and one per thread, for wait and hold. */
+  lock_summary_size = (size_t)lock_num_runs * 2 * (opt_Threads + 1)
+                      * LOCK_SUMMARY_LINE + 2;
+  lock_summary_buf = (char *)malloc(lock_summary_size);
+  ASSRT(lock_summary_buf != NULL);
+  memset(lock_summary_buf, 0, lock_summary_size);
+
+  SYSE(pthread_barrier_init(&lock_barrier, NULL, opt_Threads + 1));
+  for (t = 0; t < opt_Threads; t++) {
+    lock_threads[t].index = t;
+    SYSE(pthread_create(&lock_threads[t].thread_id, NULL,
+                        lock_thread, &lock_threads[t]));
+  }
+
+  /* Conduct the timing tests! */
+
+  for (lock_cur = 0; lock_cur < LOCK_NUM; lock_cur++) {
+    if (! jtr_name_in_list(opt_Locks, lock_names[lock_cur])) {
+      continue;
+    }
+    for (run = 1; run <= opt_loops; run++) {
+      pthread_barrier_wait(&lock_barrier);  /* Start warm-up. */
+      pthread_barrier_wait(&lock_barrier);  /* All warmed up. */
+      jtr_probe_reset();
+      pthread_barrier_wait(&lock_barrier);
+      pthread_barrier_wait(&lock_barrier);  /* All done. */
+
+      lock_report(run, "wait");
+      lock_report(run, "hold");
+    }
+  }
+
+  for (t = 0; t < opt_Threads; t++) {
+    SYSE(pthread_join(lock_threads[t].thread_id, NULL));
+  }
+  SYSE(pthread_barrier_destroy(&lock_barrier));
+  close(lock_sender.sock_fd);
+
+  if (opt_verbose >= 0) {
+    /* The summary grows with threads and runs; it isn't copied into
+     * jtr_results_buf. */
+    printf("%sLock summary (ns):\n%s", jtr_results_buf, lock_summary_buf);
+
+    if (opt_gnuplot_file != NULL) {
+      FILE *gnuplot_fp = fopen(opt_gnuplot_file, "w");
+      SYSE(gnuplot_fp == NULL);
+
+      fprintf(gnuplot_fp, "%s", jtr_gnuplot_buf);
+      fclose(gnuplot_fp);
+    }
+  }
+
+  return 0;
+}  /* main */
@@ -44,26 +44,51 @@ int opt_pause = JTR_10G_XMIT_1024_PKT_NS;
 int opt_timebase = 1;  /* 1=RDTSC, 2=clock_gettime() */
 int opt_warmup_loops = 1500;
 int opt_verbose = 0;
+int opt_live = 0;  /* 1=publish live statistics for jtr_top. */
+int opt_mem_mode = 0;  /* See jtr_mem_init(). */
+int opt_pmu = 0;  /* 1=read PMU counters around each sample. */
+char *opt_pattern = "fixed";  /* See jtr_pattern_init(). */
+char *opt_converge = "none";  /* See jtr_converge_init(). */
+char *opt_results_store = "none";  /* See jtr_store_append(). */
 
 /* Options specific to the null test. */
 int opt_Busy_spins = 100;
+char *opt_Noise_profiles = "none";
+
+/* Other globals. */
+char *noise_profiles[JTR_NOISE_MAX_PROFILES];
+int num_noise_profiles;
+char noise_summary_buf[16384];  /* Per-run one-liners, printed at end. */
 
 
 void usage()
 {
   fprintf(stderr,
-"Usage: jtr_sock [-B busy_spins]"
-" [-c cpu_num] [-d descr] [-f fifo_priority] [-g gnuplot_file]"
-" [-h histo_buckets] [-l loops] [-n num_samples] [-p pause] [-t timebase]"
+"Usage: jtr_null [-B busy_spins] [-N noise_profiles] [-b pattern]"
+" [-c cpu_num] [-d descr] [-e pmu] [-f fifo_priority] [-g gnuplot_file]"
+" [-h histo_buckets] [-l loops] [-m mem_mode] [-n num_samples]"
+" [-o results_store] [-p pause] [-s live] [-t timebase] [-u converge]"
 " [-w warmup_loops] [-v verbose]\n");
   fprintf(stderr,
 "Where:\n");
   fprintf(stderr,
 " -B busy_spins : number of cycles in 'for' loop for one timing sample.\n"
 "                 (default=100)\n"
+" -N noise_profiles : slash-separated list of interference profiles; each\n"
+"                     test run is repeated under each profile. A profile is\n"
+"                     a comma-separated list of kind[:cpu_num[:intensity]],\n"
+"                     kind=membw,l3,syscall,smt; intensity is percent.\n"
+"                     E.g. 'none/membw:7/l3:9:50,syscall:11/smt'.\n"
+"                     (default=none)\n"
+" -b pattern : traffic pattern, replacing the fixed pause (-p) between calls:\n"
+"              burst:N:gap_ns[:pause_ns], onoff:on_ns:off_ns:pause_ns, or\n"
+"              poisson:calls_per_sec. Also reports latency by position in\n"
+"              the burst. (default=fixed)\n"
 " -c cpu_num : integer CPU number to pin thread. Use -1 to not pin.\n"
 "              (default=5)\n"
 " -d descr : description string. (default='Jitter null test')\n"
+" -e pmu : 1=read LLC miss, dTLB miss, branch miss, and instruction\n"
+"          counters with RDPMC around each sample. (default=0)\n"
 " -f fifo_priority : integer priority level to set real-time FIFO scheduling.\n"
 "                  : -1 does not set real-time. (default=-1)\n"
 " -g gnuplot_file : name of file to create containing gnuplot commands to\n"
@@ -72,13 +97,26 @@ void usage()
 " -l loops : number of test runs to perform. Each test run does two tests,\n"
 "            first with the UM call, and then with an equivelent null loop.\n"
 "            (default=3)\n"
-" -n num_samples : number of samples in a test. (default=1,000,000)\n"
+" -m mem_mode : 1=mlockall and prefault the stack and buffers,\n"
+"               2=also put buffers in 2MB huge pages, 3=1GB huge pages.\n"
+"               (default=0)\n"
+" -n num_samples : number of samples in a test. (default=2,000,000)\n"
+" -o results_store : directory of an append-only results store; each\n"
+"                    histogram is added to it with a fingerprint of the\n"
+"                    host. See jtr_query. (default=none)\n"
 " -p pause : number of nanoseconds to pause between each sample, to allow\n"
 "            packet to exit NIC. (default=898)\n"
+" -s live : 1=publish live statistics in shared memory for jtr_top.\n"
+"           (default=0)\n"
 " -t timebase : integer indicating which method of time measement to use.\n"
-"               1=RDTSC, 2=clock_gettime(). (default=1)\n"
+"               1=RDTSC, 2=clock_gettime(), 3=core cycles (RDPMC).\n"
+"               (default=1)\n"
+" -u converge : keep sampling in batches of num_samples until the 95%%\n"
+"              confidence interval of a percentile is within a tolerance,\n"
+"              or a time limit: percentile:tolerance_pct:max_sec, e.g.\n"
+"              '99.99:5:60'. (default=none)\n"
 " -w warmup_loops : number of samples to initially take without accumulating\n"
-"                   the results. (default=500)\n"
+"                   the results. -1=detect steady state. (default=1500)\n"
 " -v verbose : integer indicating how much information to print.\n"
 "              -1=quiet, 0=normal, 2=details. (default=0)\n");
   exit(1);
@@ -91,18 +129,25 @@ void get_options(int argc, char **argv)
 {
   int opt;
 
-  while ((opt = getopt(argc, argv, "B:c:d:f:g:h:l:n:p:t:w:v:")) != EOF) {
+  while ((opt = getopt(argc, argv, "B:N:b:c:d:e:f:g:h:l:m:n:o:p:s:t:u:w:v:")) != EOF) {
     switch (opt) {
       case 'B': opt_Busy_spins  = atoi(optarg); break;
+      case 'N': opt_Noise_profiles = strdup(optarg); break;
+      case 'b': opt_pattern = strdup(optarg); break;
       case 'c': opt_cpu_num = atoi(optarg); break;
       case 'd': opt_descr = strdup(optarg); break;
+      case 'e': opt_pmu = atoi(optarg); break;
       case 'f': opt_fifo_priority = atoi(optarg); break;
       case 'g': opt_gnuplot_file = strdup(optarg); break;
       case 'h': opt_histo_buckets = atoi(optarg); break;
       case 'l': opt_loops = atoi(optarg); break;
+      case 'm': opt_mem_mode = atoi(optarg); break;
       case 'n': opt_num_samples = atoi(optarg); break;
+      case 'o': opt_results_store = strdup(optarg); break;
       case 'p': opt_pause = atoi(optarg); break;
+      case 's': opt_live = atoi(optarg); break;
       case 't': opt_timebase = atoi(optarg); break;
+      case 'u': opt_converge = strdup(optarg); break;
       case 'w': opt_warmup_loops = atoi(optarg); break;
       case 'v': opt_verbose = atoi(optarg); break;
       default: usage();
@@ -123,12 +168,19 @@ int main(int argc, char **argv)
 {
   int i;
   char title[1024];
+  char label[1024];
+  char *noise_profile;
 
   /* Parse command-line options. */
   get_options(argc, argv);
 
   jtr_y_high = opt_num_samples;
 
+  jtr_mem_init(opt_mem_mode);  /* Before any buffers are allocated. */
+  jtr_pattern_init(opt_pattern, NULL, NULL, opt_pause);
+  jtr_converge_init(opt_converge);
+  jtr_store_init(opt_results_store, opt_cpu_num);
+
   for (i = 0; i < sizeof(jtr_results_buf); i++) {
     jtr_results_buf[i] = '\0';
   }
@@ -144,24 +196,45 @@ int main(int argc, char **argv)
     jtr_set_fifo_priority(opt_fifo_priority);
   }
 
+  if (opt_pmu) {
+    jtr_pmu_init();  /* Counts the calling (measuring) thread only. */
+  }
+
+  if (opt_timebase == 3 && ! jtr_cycles_init()) {
+    opt_timebase = 1;  /* No usable cycle counter. */
+  }
+
+  if (opt_live) {
+    jtr_live_start("jtr_null", opt_descr, opt_cpu_num);
+  }
+
   /* Do 10 cycles of calibration. */
   for (i = 0; i < 10; i++) {
     jtr_calibrate();
   }
 
+  num_noise_profiles = jtr_noise_split(opt_Noise_profiles, noise_profiles,
+                                       JTR_NOISE_MAX_PROFILES);
+
+  jtr_preflight_print(opt_cpu_num);
+
   /* Conduct the timing tests! */
 
-  for (i = 0; i < opt_loops; i++) {
+  /* Each set of opt_loops test runs is done under one noise profile. */
+  for (i = 0; i < opt_loops * num_noise_profiles; i++) {
+    noise_profile = noise_profiles[i / opt_loops];
+    jtr_noise_start(noise_profile, opt_cpu_num);
     jtr_histo_init(opt_histo_buckets);
     jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
                       opt_timebase, null_send_cb, NULL);
+    jtr_noise_stop();
 
     snprintf(title, sizeof(title),
-            "%s: Busy_spins=%d,"
+            "%s: Busy_spins=%d, pattern=%s, converge=%s, noise=%s,"
             " cpu_num=%d, fifo_priority=%d, histo_buckets=%d, num_samples=%d,\n"
             " pause=%d timebase=%d, warmup_loops=%d, gettime_cost=%lld,\n"
             " rdtsc_cost=%lld, ticks_per_sec=%lld, jtr_1000_loops_cost=%lld",
-            opt_descr, opt_Busy_spins,
+            opt_descr, opt_Busy_spins, opt_pattern, opt_converge, noise_profile,
             opt_cpu_num, opt_fifo_priority, opt_histo_buckets, opt_num_samples,
             opt_pause, opt_timebase, opt_warmup_loops, jtr_gettime_cost,
             jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
@@ -171,6 +244,21 @@ int main(int argc, char **argv)
              "%s\n", title);
     SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
     jtr_histo_print_all(opt_verbose, title);
+
+    snprintf(label, sizeof(label), "noise=%s, run=%d",
+             noise_profile, (i % opt_loops) + 1);
+    jtr_histo_brief(noise_summary_buf, sizeof(noise_summary_buf), label);
+  }
+
+  if (num_noise_profiles > 1 || strcmp(noise_profiles[0], "none") != 0) {
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Noise profile summary (ns):\n%s", noise_summary_buf);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  }
+
+  if (opt_live) {
+    jtr_live_stop();
   }
 
   if (opt_verbose >= 0) {
@@ -0,0 +1,110 @@
+/* jtr_preflight.c - audit host tuning for the CPUs a test will use.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+
+/* Runs the same audit that the test programs put at the top of their
+ * results (see jtr_preflight()), for a list of CPUs, without measuring
+ * anything. Use it to check a host before a long test run.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+char *opt_descr = "Jitter preflight";
+int opt_verbose = 0;
+
+/* Options specific to the preflight audit. */
+char *opt_Cpu_list = "5";
+int opt_Fail_score = 0;
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_preflight [-C cpu_list] [-F fail_score] [-d descr]"
+" [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -C cpu_list : CPUs to audit, e.g. '2,3,8-11'. (default=5)\n"
+" -F fail_score : exit with status 1 if any finding scores this or more;\n"
+"                 0 never fails. (default=0)\n"
+" -d descr : description string. (default='Jitter preflight')\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet (exit status only), 0=normal. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "C:F:d:v:")) != EOF) {
+    switch (opt) {
+      case 'C': opt_Cpu_list = strdup(optarg); break;
+      case 'F': opt_Fail_score = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+}  /* get_options */
+
+
+int main(int argc, char **argv)
+{
+  int num_cpus, cpu, i;
+  int failed = 0;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = '\0';
+  }
+
+  snprintf(jtr_results_buf, sizeof(jtr_results_buf), "%s: cpu_list=%s\n",
+           opt_descr, opt_Cpu_list);
+  num_cpus = (int)sysconf(_SC_NPROCESSORS_CONF);
+  for (cpu = 0; cpu < num_cpus; cpu++) {
+    if (! jtr_cpu_in_list(opt_Cpu_list, cpu)) {
+      continue;
+    }
+    if (jtr_preflight_print(cpu) >= opt_Fail_score && opt_Fail_score > 0) {
+      failed = 1;
+    }
+  }
+
+  if (opt_verbose >= 0) {
+    printf("%s", jtr_results_buf);
+  }
+
+  return failed;
+}  /* main */
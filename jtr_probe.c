@@ -0,0 +1,297 @@
+/* jtr_probe.c - measure the cost of the libjtr probe API, and show its use.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+
+/* This is an example of timing code with JTR_PROBE_BEGIN()/JTR_PROBE_END()
+ * from several threads while another thread takes snapshots. Probe 0
+ * brackets nothing, so its histogram shows what a probe costs. Probe 1
+ * brackets a busy loop like jtr_null's.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+int opt_cpu_num = 5;
+char *opt_descr = "Jitter probe test";
+char *opt_gnuplot_file = NULL;
+int opt_histo_buckets = 200;
+int opt_loops = 3;
+int opt_num_samples = 1000000;
+int opt_pause = JTR_10G_XMIT_1024_PKT_NS;
+int opt_warmup_loops = 1500;
+int opt_verbose = 0;
+
+/* Options specific to the probe test. */
+int opt_Busy_spins = 100;
+int opt_Threads = 2;
+
+/* Other globals. */
+#define PROBE_EMPTY 0
+#define PROBE_BUSY 1
+#define PROBE_PAIR 2
+#define PROBE_NUM_PROBES 3
+#define PROBE_PAIR_LOOPS 1000
+#define PROBE_MAX_THREADS 64
+
+typedef struct probe_thread_s {
+  int index;
+  pthread_t thread_id;
+  long long pair_cost_ns;  /* Average of PROBE_PAIR_LOOPS begin/end pairs. */
+} probe_thread_t;
+
+probe_thread_t probe_threads[PROBE_MAX_THREADS];
+pthread_barrier_t probe_barrier;
+volatile int probe_threads_running;
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_probe [-B busy_spins] [-T threads]"
+" [-c cpu_num] [-d descr] [-g gnuplot_file]"
+" [-h histo_buckets] [-l loops] [-n num_samples] [-p pause]"
+" [-w warmup_loops] [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -B busy_spins : number of cycles in 'for' loop timed by probe 1.\n"
+"                 (default=100)\n"
+" -T threads : number of threads using the probes. (default=2)\n"
+" -c cpu_num : integer CPU number to pin the first probing thread; the\n"
+"              others go on the following CPUs. Use -1 to not pin.\n"
+"              (default=5)\n"
+" -d descr : description string. (default='Jitter probe test')\n"
+" -g gnuplot_file : name of file to create containing gnuplot commands to\n"
+"                   graph the histogram data. (default=no file)\n"
+" -h histo_buckets : number of buckets for histogram. (default=200)\n"
+" -l loops : number of test runs to perform. (default=3)\n"
+" -n num_samples : number of samples per thread in a test.\n"
+"                  (default=1,000,000)\n"
+" -p pause : number of nanoseconds to pause between each sample.\n"
+"            (default=898)\n"
+" -w warmup_loops : number of samples to initially take without accumulating\n"
+"                   the results. (default=1500)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet, 0=normal, 1=also show live snapshots,\n"
+"              2=details. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "B:T:c:d:g:h:l:n:p:w:v:")) != EOF) {
+    switch (opt) {
+      case 'B': opt_Busy_spins = atoi(optarg); break;
+      case 'T': opt_Threads = atoi(optarg); break;
+      case 'c': opt_cpu_num = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'g': opt_gnuplot_file = strdup(optarg); break;
+      case 'h': opt_histo_buckets = atoi(optarg); break;
+      case 'l': opt_loops = atoi(optarg); break;
+      case 'n': opt_num_samples = atoi(optarg); break;
+      case 'p': opt_pause = atoi(optarg); break;
+      case 'w': opt_warmup_loops = atoi(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+  if (opt_Threads < 1 || opt_Threads > PROBE_MAX_THREADS) {
+    fprintf(stderr, "-T threads must be 1..%d\n", PROBE_MAX_THREADS);
+    usage();
+  }
+}  /* get_options */
+
+
+/* One probe sample of each kind, then the pause.
+ */
+void probe_sample(void)
+{
+  int i;
+
+  JTR_PROBE_BEGIN(PROBE_EMPTY);
+  JTR_PROBE_END(PROBE_EMPTY);
+
+  JTR_PROBE_BEGIN(PROBE_BUSY);
+  for (i = 0; i < opt_Busy_spins; i++) { }
+  JTR_PROBE_END(PROBE_BUSY);
+
+  jtr_spin_sleep_ns(opt_pause, 1);
+}  /* probe_sample */
+
+
+void *probe_thread(void *arg)
+{
+  probe_thread_t *pt = (probe_thread_t *)arg;
+  uint32_t start_ticks_hi, start_ticks_lo;
+  uint32_t end_ticks_hi, end_ticks_lo;
+  long long diff_ticks;
+  int i;
+
+  if (opt_cpu_num >= 0) {
+    jtr_pin_cpu(opt_cpu_num + pt->index);
+  }
+
+  for (i = 0; i < opt_warmup_loops; i++) {
+    probe_sample();
+  }
+
+  /* Back-to-back probe cost, for comparison with jtr_rdtsc_cost. */
+  RDTSC(start_ticks_hi, start_ticks_lo);
+  for (i = 0; i < PROBE_PAIR_LOOPS; i++) {
+    JTR_PROBE_BEGIN(PROBE_PAIR);
+    JTR_PROBE_END(PROBE_PAIR);
+  }
+  RDTSC(end_ticks_hi, end_ticks_lo);
+  diff_ticks = (((long long)end_ticks_hi << 32) + (long long)end_ticks_lo)
+               - (((long long)start_ticks_hi << 32) + (long long)start_ticks_lo);
+  pt->pair_cost_ns = ((diff_ticks * NANOS_PER_SEC) / jtr_ticks_per_sec)
+                     / PROBE_PAIR_LOOPS;
+
+  /* Main thread resets the probes between these, dropping the warm-up. */
+  pthread_barrier_wait(&probe_barrier);
+  pthread_barrier_wait(&probe_barrier);
+
+  for (i = 0; i < opt_num_samples; i++) {
+    probe_sample();
+  }
+
+  __atomic_sub_fetch(&probe_threads_running, 1, __ATOMIC_RELEASE);
+  return NULL;
+}  /* probe_thread */
+
+
+/* Add a probe's merged histogram to the results.
+ */
+void probe_report(int run, int probe, char *probe_name)
+{
+  char title[1024];
+
+  jtr_probe_snapshot(probe);
+
+  snprintf(title, sizeof(title),
+          "%s: probe=%s, Busy_spins=%d, threads=%d, run=%d,"
+          " cpu_num=%d, histo_buckets=%d, num_samples=%d,\n"
+          " pause=%d, warmup_loops=%d, probe_shift=%d,\n"
+          " rdtsc_cost=%lld, ticks_per_sec=%lld, jtr_1000_loops_cost=%lld",
+          opt_descr, probe_name, opt_Busy_spins, opt_Threads, run,
+          opt_cpu_num, opt_histo_buckets, opt_num_samples,
+          opt_pause, opt_warmup_loops, jtr_probe_shift,
+          jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
+  SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "%s\n", title);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  jtr_histo_print_all(opt_verbose > 1, title);
+}  /* probe_report */
+
+
+int main(int argc, char **argv)
+{
+  struct timespec sleep_ts;
+  char label[64];
+  int run;
+  int t;
+  int i;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  jtr_y_high = opt_num_samples * opt_Threads;
+
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = '\0';
+  }
+  for (i = 0; i < sizeof(jtr_gnuplot_buf); i++) {
+    jtr_gnuplot_buf[i] = '\0';
+  }
+
+  /* Calibrates (once per process) and sizes the per-thread histograms. */
+  jtr_probe_init(PROBE_NUM_PROBES, opt_histo_buckets);
+
+  sleep_ts.tv_sec = 0;
+  sleep_ts.tv_nsec = 10000000;  /* Live snapshot every 10 ms. */
+
+  for (run = 1; run <= opt_loops; run++) {
+    SYSE(pthread_barrier_init(&probe_barrier, NULL, opt_Threads + 1));
+    probe_threads_running = opt_Threads;
+    for (t = 0; t < opt_Threads; t++) {
+      probe_threads[t].index = t;
+      SYSE(pthread_create(&probe_threads[t].thread_id, NULL,
+                          probe_thread, &probe_threads[t]));
+    }
+
+    pthread_barrier_wait(&probe_barrier);  /* All warmed up. */
+    jtr_probe_reset();
+    pthread_barrier_wait(&probe_barrier);
+
+    /* Snapshots are safe while the threads are probing. */
+    while (__atomic_load_n(&probe_threads_running, __ATOMIC_ACQUIRE) > 0) {
+      nanosleep(&sleep_ts, NULL);
+      if (opt_verbose > 0) {
+        jtr_probe_snapshot(PROBE_EMPTY);
+        snprintf(label, sizeof(label), "Live snapshot, run=%d", run);
+        jtr_histo_brief(jtr_results_buf, sizeof(jtr_results_buf), label);
+      }
+    }
+
+    for (t = 0; t < opt_Threads; t++) {
+      SYSE(pthread_join(probe_threads[t].thread_id, NULL));
+      snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+               sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+               "Thread %d: probe pair cost=%lld ns (rdtsc_cost=%lld)\n",
+               t, probe_threads[t].pair_cost_ns, jtr_rdtsc_cost);
+      SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+    }
+    SYSE(pthread_barrier_destroy(&probe_barrier));
+
+    probe_report(run, PROBE_EMPTY, "empty");
+    probe_report(run, PROBE_BUSY, "busy");
+  }
+
+  if (opt_verbose >= 0) {
+    printf("%s", jtr_results_buf);
+
+    if (opt_gnuplot_file != NULL) {
+      FILE *gnuplot_fp = fopen(opt_gnuplot_file, "w");
+      SYSE(gnuplot_fp == NULL);
+
+      fprintf(gnuplot_fp, "%s", jtr_gnuplot_buf);
+      fclose(gnuplot_fp);
+    }
+  }
+
+  return 0;
+}  /* main */
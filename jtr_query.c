@@ -0,0 +1,371 @@
+/* jtr_query.c - query the results store for latency trends.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+
+/* The test programs append each histogram to a results store when given
+ * "-o results_store" (see jtr_store_append()). This reads the store's
+ * index, picks the last runs of one test on one host, and prints a
+ * percentile of each run, flagging runs where the kernel, firmware, boot
+ * command line, CPU mitigations, or tuning changed from the run before.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+int opt_verbose = 0;
+
+/* Options specific to the query tool. */
+char *opt_Host = "this";
+int opt_Num_runs = 30;
+double opt_Percentile = 99.999;
+char *opt_Store_dir = "jtr_results";
+char *opt_Test = NULL;
+
+/* Other globals. */
+#define QUERY_MAX_TESTS 1024
+#define QUERY_NUM_FIELDS 6
+
+typedef struct query_run_s {
+  long long offset;  /* Of the record in "records". */
+  long run_time;
+  char host[32];
+  char test[256];
+} query_run_t;
+
+char *query_field_names[QUERY_NUM_FIELDS] = {
+  "kernel", "microcode", "bios", "cmdline", "mitigations", "tuning" };
+
+typedef struct query_record_s {
+  char *fields[QUERY_NUM_FIELDS];  /* See query_field_names. */
+  int samples;
+  int overflows;
+  int perc_ns;  /* -1=in the overflows. */
+} query_record_t;
+
+query_run_t *query_runs;  /* Last opt_Num_runs matches, circular. */
+int query_num_matches = 0;
+query_run_t query_tests[QUERY_MAX_TESTS];  /* With no -T, one per test. */
+int query_test_counts[QUERY_MAX_TESTS];
+int query_num_tests = 0;
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_query [-H host] [-N num_runs] [-P percentile] [-S store_dir]"
+" [-T test] [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -H host : host id to report, 'this' for the local host, or 'all'.\n"
+"           (default=this)\n"
+" -N num_runs : report the last this many runs. (default=30)\n"
+" -P percentile : percentile to report for each run. (default=99.999)\n"
+" -S store_dir : results store written with '-o'. (default=jtr_results)\n"
+" -T test : test to report, i.e. its '-d' description, with or without\n"
+"           '.sh'. Without -T, lists the tests in the store.\n"
+"           (default=none)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              0=normal, 1=also show the old and new value of each change.\n"
+"              (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "H:N:P:S:T:v:")) != EOF) {
+    switch (opt) {
+      case 'H': opt_Host = strdup(optarg); break;
+      case 'N': opt_Num_runs = atoi(optarg); break;
+      case 'P': opt_Percentile = atof(optarg); break;
+      case 'S': opt_Store_dir = strdup(optarg); break;
+      case 'T': opt_Test = strdup(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+
+  if (opt_Num_runs < 1 || opt_Percentile <= 0.0 || opt_Percentile > 100.0) {
+    usage();
+  }
+}  /* get_options */
+
+
+/* "tst_ss" matches "tst_ss" and "tst_ss.sh", not "tst_ss.sh (null loop)".
+ */
+int test_matches(char *test)
+{
+  size_t len = strlen(opt_Test);
+
+  return (strncmp(test, opt_Test, len) == 0
+          && (test[len] == '\0' || strcmp(&test[len], ".sh") == 0));
+}  /* test_matches */
+
+
+/* Read the index, keeping the last opt_Num_runs runs that match.
+ */
+void read_index(char *host)
+{
+  char path[1024];
+  char line[1024];
+  query_run_t run;
+  int len, t;
+  FILE *fp;
+
+  snprintf(path, sizeof(path), "%s/index", opt_Store_dir);
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Could not open '%s': %s\n", path, strerror(errno));
+    exit(1);
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    /* offset time host kernel test (the test may contain spaces). */
+    len = -1;
+    if (sscanf(line, "%lld %ld %31s %*s %n", &run.offset, &run.run_time,
+               run.host, &len) < 3 || len < 0) {
+      continue;
+    }
+    snprintf(run.test, sizeof(run.test), "%.255s", &line[len]);
+    if (strcmp(host, "all") != 0 && strcmp(host, run.host) != 0) {
+      continue;
+    }
+
+    if (opt_Test == NULL) {
+      for (t = 0; t < query_num_tests; t++) {
+        if (strcmp(query_tests[t].test, run.test) == 0
+            && strcmp(query_tests[t].host, run.host) == 0) {
+          break;
+        }
+      }
+      if (t == query_num_tests && t < QUERY_MAX_TESTS) {
+        query_tests[t] = run;
+        query_test_counts[t] = 0;
+        query_num_tests ++;
+      }
+      if (t < QUERY_MAX_TESTS) {
+        query_tests[t].run_time = run.run_time;  /* Latest. */
+        query_test_counts[t] ++;
+      }
+    }
+    else if (test_matches(run.test)) {
+      query_runs[query_num_matches % opt_Num_runs] = run;
+      query_num_matches ++;
+    }
+  }
+  fclose(fp);
+}  /* read_index */
+
+
+/* Load the fields and the percentile of the record at "offset".
+ */
+void read_record(FILE *fp, long long offset, query_record_t *rec)
+{
+  char *line = NULL;
+  size_t line_size = 0;
+  char *p;
+  int f, granularity, num_buckets, bucket, count, min_count, cum;
+
+  memset(rec, 0, sizeof(*rec));
+  rec->perc_ns = -1;
+  SYSE(fseeko(fp, (off_t)offset, SEEK_SET));
+  while (getline(&line, &line_size, fp) > 0) {
+    line[strcspn(line, "\n")] = '\0';
+    if (strcmp(line, "end") == 0) {
+      break;
+    }
+    for (f = 0; f < QUERY_NUM_FIELDS; f++) {
+      size_t len = strlen(query_field_names[f]);
+      if (strncmp(line, query_field_names[f], len) == 0 && line[len] == '=') {
+        rec->fields[f] = strdup(&line[len + 1]);
+      }
+    }
+    sscanf(line, "summary=samples=%d min=%*d max=%*d avg=%*d overflows=%d",
+           &rec->samples, &rec->overflows);
+
+    if (sscanf(line, "histo=granularity=%d buckets=%d data=",
+               &granularity, &num_buckets) == 2) {
+      /* Same rounding as jtr_buckets_perc_ns(). */
+      min_count = (int)((opt_Percentile / 100.0) * (double)rec->samples + 0.5);
+      p = strstr(line, "data=") + 5;
+      bucket = -1;
+      cum = 0;
+      while (*p != '\0' && cum < min_count) {
+        bucket += (int)strtol(p, &p, 10);
+        if (*p++ != ':') {
+          break;
+        }
+        count = (int)strtol(p, &p, 10);
+        cum += count;
+        if (cum >= min_count) {
+          rec->perc_ns = (bucket + 1) * granularity;
+        }
+        if (*p == ',') {
+          p++;
+        }
+      }
+    }
+  }
+  free(line);
+
+  for (f = 0; f < QUERY_NUM_FIELDS; f++) {
+    if (rec->fields[f] == NULL) {
+      rec->fields[f] = strdup("?");
+    }
+  }
+}  /* read_record */
+
+
+int int_cmp(const void *a, const void *b)
+{
+  return *(const int *)a - *(const int *)b;
+}  /* int_cmp */
+
+
+int main(int argc, char **argv)
+{
+  char host[32];
+  char path[1024];
+  char when[64];
+  char changed[256];
+  query_record_t prev, rec;
+  int *perc_values;
+  int num_values = 0;
+  int first, num_shown, i, f;
+  struct tm tm;
+  time_t run_time;
+  FILE *fp;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  if (strcmp(opt_Host, "this") == 0) {
+    jtr_host_id(host, sizeof(host));
+  } else {
+    snprintf(host, sizeof(host), "%s", opt_Host);
+  }
+  query_runs = (query_run_t *)malloc(opt_Num_runs * sizeof(query_run_t));
+  perc_values = (int *)malloc(opt_Num_runs * sizeof(int));
+  ASSRT(query_runs != NULL && perc_values != NULL);
+
+  read_index(host);
+
+  if (opt_Test == NULL) {
+    printf("Tests in %s (host=%s):\n", opt_Store_dir, host);
+    for (i = 0; i < query_num_tests; i++) {
+      run_time = (time_t)query_tests[i].run_time;
+      strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S",
+               localtime_r(&run_time, &tm));
+      printf("  host=%s, runs=%d, latest=%s, test=%s\n",
+             query_tests[i].host, query_test_counts[i], when,
+             query_tests[i].test);
+    }
+    return 0;
+  }
+
+  num_shown = (query_num_matches < opt_Num_runs)
+              ? query_num_matches : opt_Num_runs;
+  first = query_num_matches - num_shown;
+  printf("Results store %s: test=%s, host=%s, percentile=%.3lf, runs=%d\n",
+         opt_Store_dir, opt_Test, host, opt_Percentile, num_shown);
+  if (num_shown == 0) {
+    return 0;
+  }
+
+  snprintf(path, sizeof(path), "%s/records", opt_Store_dir);
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "Could not open '%s': %s\n", path, strerror(errno));
+    exit(1);
+  }
+
+  printf("  %-19s  %-16s  %10s  %10s  %s\n", "time", "host", "samples",
+         "perc_ns", "changed");
+  memset(&prev, 0, sizeof(prev));
+  for (i = first; i < query_num_matches; i++) {
+    query_run_t *run = &query_runs[i % opt_Num_runs];
+
+    read_record(fp, run->offset, &rec);
+    changed[0] = '\0';
+    if (i > first) {
+      for (f = 0; f < QUERY_NUM_FIELDS; f++) {
+        if (strcmp(rec.fields[f], prev.fields[f]) != 0) {
+          snprintf(&changed[strlen(changed)],
+                   sizeof(changed) - strlen(changed), "%s%s",
+                   (changed[0] == '\0') ? "" : ",", query_field_names[f]);
+        }
+      }
+    }
+
+    run_time = (time_t)run->run_time;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S",
+             localtime_r(&run_time, &tm));
+    if (rec.perc_ns >= 0) {
+      printf("  %-19s  %-16s  %10d  %10d  %s\n", when, run->host,
+             rec.samples, rec.perc_ns, changed);
+      perc_values[num_values++] = rec.perc_ns;
+    } else {
+      printf("  %-19s  %-16s  %10d  %10s  %s\n", when, run->host,
+             rec.samples, "overflow", changed);
+    }
+    if (opt_verbose > 0 && changed[0] != '\0') {
+      for (f = 0; f < QUERY_NUM_FIELDS; f++) {
+        if (strcmp(rec.fields[f], prev.fields[f]) != 0) {
+          printf("      %s: '%s' -> '%s'\n", query_field_names[f],
+                 prev.fields[f], rec.fields[f]);
+        }
+      }
+    }
+
+    if (i > first) {
+      for (f = 0; f < QUERY_NUM_FIELDS; f++) {
+        free(prev.fields[f]);
+      }
+    }
+    prev = rec;
+  }
+  fclose(fp);
+
+  if (num_values > 0) {
+    int latest = perc_values[num_values - 1];
+    qsort(perc_values, num_values, sizeof(int), int_cmp);
+    printf("Median=%d ns, Latest=%d ns (%+.1lf%%)\n",
+           perc_values[num_values / 2], latest,
+           (perc_values[num_values / 2] > 0)
+           ? 100.0 * (double)(latest - perc_values[num_values / 2])
+             / (double)perc_values[num_values / 2]
+           : 0.0);
+  }
+
+  return 0;
+}  /* main */
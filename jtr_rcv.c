@@ -0,0 +1,561 @@
+/* jtr_rcv.c - tool to measure receive-side latency and jitter.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+/* Allow setting thread affinity. */
+#define _GNU_SOURCE
+#include <sched.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "jtr.h"
+
+#ifndef SO_BUSY_POLL
+#define SO_BUSY_POLL 46
+#endif
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+/* Options and their defaults. See get_options(). */
+int opt_cpu_num = 5;
+char *opt_descr = "Jitter receive test";
+int opt_fifo_priority = -1;
+char *opt_gnuplot_file = NULL;
+int opt_histo_buckets = 2000;
+int opt_loops = 3;
+int opt_num_samples = 200000;
+char *opt_results_store = "none";  /* See jtr_store_append(). */
+int opt_pause = 10000;
+int opt_warmup_loops = 1500;
+int opt_verbose = 0;
+char *opt_skew_table = NULL;  /* From jtr_tscskew. */
+
+/* Options specific to the receive test. */
+int opt_Batch = 16;
+int opt_Busy_poll_usec = 50;
+int opt_Destport = 12001;
+int opt_Msg_size = 1024;
+char *opt_Sender_placement = "l3,socket";  /* See jtr_cpu_related(). */
+char *opt_Strategies = "12345";
+
+/* Receive strategies. See rcv_strategy_names[]. */
+#define RCV_BLOCKING 1
+#define RCV_EPOLL 2
+#define RCV_SPIN 3
+#define RCV_BUSY_POLL 4
+#define RCV_RECVMMSG 5
+char *rcv_strategy_names[] = {
+  "", "blocking recvfrom", "epoll_wait", "nonblocking spin",
+  "SO_BUSY_POLL", "recvmmsg"
+};
+
+/* Every datagram starts with this header. A negative seq marks the end. */
+typedef struct rcv_hdr_s {
+  uint64_t send_ticks;
+  int seq;
+} rcv_hdr_t;
+
+#define RCV_MAX_BATCH 64
+
+/* socket objects. */
+int rcv_sock;
+int snd_sock;
+struct sockaddr_in dest_in;
+char *message_buf;
+char *rcv_bufs;
+struct mmsghdr rcv_msgs[RCV_MAX_BATCH];
+struct iovec rcv_iovs[RCV_MAX_BATCH];
+
+/* Sender thread control. */
+pthread_t snd_thread_id;
+int sender_cpu_num = -1;
+volatile int snd_go = 0;     /* Main sets to start a run. */
+volatile int snd_exit = 0;   /* Main sets to terminate thread. */
+volatile int rcv_done = 0;   /* Main sets when it has seen the end marker. */
+
+/* Per-run receive counters. */
+int rcv_received;
+int rcv_lost;
+int rcv_next_seq;
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_rcv [-B busy_poll_usec] [-C sender_placement] [-D destport]\n"
+" [-M msg_size] [-S strategies] [-b batch]"
+" [-c cpu_num] [-d descr] [-f fifo_priority] [-g gnuplot_file]"
+" [-h histo_buckets] [-l loops] [-n num_samples] [-o results_store]"
+" [-p pause] [-w warmup_loops] [-k skew_table] [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -B busy_poll_usec : SO_BUSY_POLL value for strategy 4. (default=50)\n"
+" -C sender_placement : CPU of the sender thread, by its relation to\n"
+"                       cpu_num (see jtr_ss -P), or a CPU number (-1 to not\n"
+"                       pin). (default=l3,socket)\n"
+" -D destport : loopback UDP port. (default=12001)\n"
+" -M msg_size : number of bytes in message to send. (default=1024)\n"
+" -S strategies : string of receive strategy numbers to test, in order.\n"
+"                 1=blocking recvfrom, 2=epoll_wait, 3=nonblocking spin,\n"
+"                 4=SO_BUSY_POLL+SO_PREFER_BUSY_POLL, 5=recvmmsg.\n"
+"                 (default=12345)\n"
+" -b batch : number of messages per recvmmsg() call. (default=16)\n"
+" -c cpu_num : integer CPU number to pin receive thread. Use -1 to not pin.\n"
+"              (default=5)\n"
+" -d descr : description string. (default='Jitter receive test')\n"
+" -f fifo_priority : integer priority level to set real-time FIFO scheduling.\n"
+"                  : -1 does not set real-time. (default=-1)\n"
+" -g gnuplot_file : name of file to create containing gnuplot commands to\n"
+"                   graph the histogram data. (default=no file)\n"
+" -h histo_buckets : number of buckets for histogram. (default=2000)\n"
+" -k skew_table : TSC correction table written by jtr_tscskew, applied to\n"
+"                 one-way times between this thread and the sender thread.\n"
+"                 (default=none)\n"
+" -l loops : number of test runs to perform. Each test run does one test\n"
+"            per receive strategy. (default=3)\n"
+" -n num_samples : number of samples in a test. (default=200,000)\n"
+" -o results_store : directory to append each histogram to, with a host\n"
+"                    fingerprint including the mitigations; see jtr_query.\n"
+"                    (default=none)\n"
+" -p pause : number of nanoseconds the sender pauses between messages.\n"
+"            (default=10000)\n"
+" -w warmup_loops : number of messages to initially receive without\n"
+"                   accumulating the results. (default=1500)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet, 0=normal, 2=details. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "B:C:D:M:S:b:c:d:f:g:h:k:l:n:o:p:w:v:")) != EOF) {
+    switch (opt) {
+      case 'B': opt_Busy_poll_usec = atoi(optarg); break;
+      case 'C': opt_Sender_placement = strdup(optarg); break;
+      case 'D': opt_Destport = atoi(optarg); break;
+      case 'M': opt_Msg_size = atoi(optarg); break;
+      case 'S': opt_Strategies = strdup(optarg); break;
+      case 'b': opt_Batch = atoi(optarg); break;
+      case 'c': opt_cpu_num = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'f': opt_fifo_priority = atoi(optarg); break;
+      case 'g': opt_gnuplot_file = strdup(optarg); break;
+      case 'h': opt_histo_buckets = atoi(optarg); break;
+      case 'k': opt_skew_table = strdup(optarg); break;
+      case 'l': opt_loops = atoi(optarg); break;
+      case 'n': opt_num_samples = atoi(optarg); break;
+      case 'o': opt_results_store = strdup(optarg); break;
+      case 'p': opt_pause = atoi(optarg); break;
+      case 'w': opt_warmup_loops = atoi(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+
+  if (opt_Msg_size < sizeof(rcv_hdr_t)) {
+    fprintf(stderr, "-M must be at least %d\n", (int)sizeof(rcv_hdr_t));
+    exit(1);
+  }
+  if (opt_Batch < 1 || opt_Batch > RCV_MAX_BATCH) {
+    fprintf(stderr, "-b must be 1..%d\n", RCV_MAX_BATCH);
+    exit(1);
+  }
+  /* A number pins the sender there even with "-c -1". */
+  if (opt_Sender_placement[0] == '-'
+      || (opt_Sender_placement[0] >= '0' && opt_Sender_placement[0] <= '9')) {
+    sender_cpu_num = atoi(opt_Sender_placement);
+  } else if (opt_cpu_num >= 0) {
+    sender_cpu_num = jtr_cpu_related(opt_cpu_num, opt_Sender_placement);
+  } else {
+    sender_cpu_num = -1;
+  }
+}  /* get_options */
+
+
+/* Sender thread: for each run, send a fixed-cadence stream of timestamped
+ * datagrams, then keep sending end markers until the receiver sees one.
+ */
+void *snd_thread(void *arg)
+{
+  rcv_hdr_t *hdr = (rcv_hdr_t *)message_buf;
+  uint32_t ticks_hi, ticks_lo;
+  int seq;
+
+  if (sender_cpu_num >= 0) {
+    jtr_pin_cpu(sender_cpu_num);
+  }
+
+  while (! snd_exit) {
+    if (! snd_go) {
+      usleep(1000);
+      continue;
+    }
+
+    for (seq = 0; seq < opt_warmup_loops + opt_num_samples; seq++) {
+      hdr->seq = seq;
+      RDTSC(ticks_hi, ticks_lo);
+      hdr->send_ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+      SYSE(sendto(snd_sock, message_buf, opt_Msg_size, 0,
+                  (struct sockaddr *)&dest_in, sizeof(dest_in)) == -1);
+      jtr_spin_sleep_ns(opt_pause, 1);
+    }
+
+    /* End markers get lost just like data, so repeat until seen. */
+    hdr->seq = -1;
+    while (! rcv_done) {
+      SYSE(sendto(snd_sock, message_buf, opt_Msg_size, 0,
+                  (struct sockaddr *)&dest_in, sizeof(dest_in)) == -1);
+      usleep(1000);
+    }
+    snd_go = 0;
+  }
+
+  return NULL;
+}  /* snd_thread */
+
+
+/* Account for one received datagram. Returns 0 on end marker, else 1.
+ */
+int rcv_process(char *buf, uint64_t rcv_ticks)
+{
+  rcv_hdr_t *hdr = (rcv_hdr_t *)buf;
+  long long diff_ns;
+
+  if (unlikely(hdr->seq < 0)) {
+    return 0;
+  }
+
+  if (unlikely(hdr->seq != rcv_next_seq)) {
+    rcv_lost += hdr->seq - rcv_next_seq;
+  }
+  rcv_next_seq = hdr->seq + 1;
+  rcv_received ++;
+
+  if (hdr->seq >= opt_warmup_loops) {
+    diff_ns = (((long long)rcv_ticks - (long long)hdr->send_ticks
+               - jtr_tscskew_ticks(sender_cpu_num, opt_cpu_num,
+                                   (long long)rcv_ticks))
+               * NANOS_PER_SEC) / jtr_ticks_per_sec;
+    diff_ns -= jtr_rdtsc_cost;  /* Correct for measurement cost. */
+    if (unlikely(diff_ns < 0)) {
+      jtr_neg_diffs ++;
+      diff_ns = 0;
+    }
+    jtr_histo_accum(diff_ns);
+  }
+
+  return 1;
+}  /* rcv_process */
+
+
+/* Create the receive socket configured for the given strategy.
+ */
+int rcv_sock_create(int strategy)
+{
+  struct sockaddr_in bind_in;
+  int sock;
+  int on = 1;
+  int rcvbuf = 4 * 1024 * 1024;
+
+  sock = socket(PF_INET, SOCK_DGRAM, 0);
+  SYSE(sock == -1);
+  SYSE(setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)));
+  /* Best effort; capped by net.core.rmem_max. */
+  (void)setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  memset((char *)&bind_in, 0, sizeof(bind_in));
+  bind_in.sin_family = AF_INET;
+  bind_in.sin_port = htons(opt_Destport);
+  bind_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  SYSE(bind(sock, (struct sockaddr *)&bind_in, sizeof(bind_in)));
+
+  if (strategy == RCV_BUSY_POLL) {
+    SYSE(setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL,
+                    &opt_Busy_poll_usec, sizeof(opt_Busy_poll_usec)));
+    /* Needs kernel 5.11+; older kernels just busy poll without preference. */
+    if (setsockopt(sock, SOL_SOCKET, SO_PREFER_BUSY_POLL, &on, sizeof(on))) {
+      fprintf(stderr, "Warning, SO_PREFER_BUSY_POLL not supported\n");
+    }
+  }
+
+  return sock;
+}  /* rcv_sock_create */
+
+
+/* Receive the whole stream with one strategy.
+ */
+void rcv_run(int strategy)
+{
+  uint32_t ticks_hi, ticks_lo;
+  uint64_t rcv_ticks;
+  struct epoll_event ev;
+  int epfd = -1;
+  int running = 1;
+  int len, i;
+
+  if (strategy == RCV_EPOLL) {
+    epfd = epoll_create1(0);
+    SYSE(epfd == -1);
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    SYSE(epoll_ctl(epfd, EPOLL_CTL_ADD, rcv_sock, &ev));
+  }
+
+  while (running) {
+    switch (strategy) {
+      case RCV_BLOCKING:
+      case RCV_BUSY_POLL:
+        len = recvfrom(rcv_sock, rcv_bufs, opt_Msg_size, 0, NULL, NULL);
+        RDTSC(ticks_hi, ticks_lo);
+        SYSE(len == -1);
+        rcv_ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+        running = rcv_process(rcv_bufs, rcv_ticks);
+        break;
+
+      case RCV_EPOLL:
+        SYSE(epoll_wait(epfd, &ev, 1, -1) != 1);
+        len = recvfrom(rcv_sock, rcv_bufs, opt_Msg_size, MSG_DONTWAIT,
+                       NULL, NULL);
+        RDTSC(ticks_hi, ticks_lo);
+        if (len == -1 && errno == EAGAIN) {
+          break;
+        }
+        SYSE(len == -1);
+        rcv_ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+        running = rcv_process(rcv_bufs, rcv_ticks);
+        break;
+
+      case RCV_SPIN:
+        do {
+          len = recvfrom(rcv_sock, rcv_bufs, opt_Msg_size, MSG_DONTWAIT,
+                         NULL, NULL);
+        } while (len == -1 && errno == EAGAIN);
+        RDTSC(ticks_hi, ticks_lo);
+        SYSE(len == -1);
+        rcv_ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+        running = rcv_process(rcv_bufs, rcv_ticks);
+        break;
+
+      case RCV_RECVMMSG:
+        len = recvmmsg(rcv_sock, rcv_msgs, opt_Batch, MSG_WAITFORONE, NULL);
+        RDTSC(ticks_hi, ticks_lo);
+        SYSE(len == -1);
+        rcv_ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+        /* Whole batch is "delivered" when the call returns. */
+        for (i = 0; i < len && running; i++) {
+          running = rcv_process(rcv_iovs[i].iov_base, rcv_ticks);
+        }
+        break;
+
+      default:
+        fprintf(stderr, "Unknown strategy %d\n", strategy);
+        exit(1);
+    }  /* switch strategy */
+  }  /* while running */
+
+  if (epfd != -1) {
+    close(epfd);
+  }
+}  /* rcv_run */
+
+
+int main(int argc, char **argv)
+{
+  int i, s;
+  int strategy;
+  char title[1024];
+  struct rusage start_ru, end_ru;
+  struct timespec start_ts, end_ts;  /* tv_sec, tv_nsec */
+  long long run_ns, cpu_user_ns, cpu_sys_ns;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  jtr_y_high = opt_num_samples;
+  jtr_store_init(opt_results_store, opt_cpu_num);
+
+  message_buf = malloc(opt_Msg_size);
+  rcv_bufs = malloc(opt_Msg_size * RCV_MAX_BATCH);
+  memset(rcv_msgs, 0, sizeof(rcv_msgs));
+  for (i = 0; i < RCV_MAX_BATCH; i++) {
+    rcv_iovs[i].iov_base = &rcv_bufs[i * opt_Msg_size];
+    rcv_iovs[i].iov_len = opt_Msg_size;
+    rcv_msgs[i].msg_hdr.msg_iov = &rcv_iovs[i];
+    rcv_msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  /* Empty out the results buffer (and page it in). */
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = 0;
+  }
+  for (i = 0; i < sizeof(jtr_gnuplot_buf); i++) {
+    jtr_gnuplot_buf[i] = '\0';
+  }
+
+  if (opt_cpu_num >= 0) {
+    jtr_pin_cpu(opt_cpu_num);
+  }
+
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+
+  snd_sock = socket(PF_INET, SOCK_DGRAM, 0);
+  SYSE(snd_sock == -1);
+  memset((char *)&dest_in, 0, sizeof(dest_in));
+  dest_in.sin_family = AF_INET;
+  dest_in.sin_port = htons(opt_Destport);
+  dest_in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  /* Init message buffer into cache. */
+  for (i = 0; i < opt_Msg_size; i++) {
+    message_buf[i] = (char)i;
+  }
+
+  for (i = 0; i < 20; i++) {
+    jtr_calibrate();
+  }
+
+  if (opt_skew_table != NULL) {
+    if (jtr_tscskew_load(opt_skew_table) == 0
+        || ! jtr_tscskew_known(opt_cpu_num)
+        || ! jtr_tscskew_known(sender_cpu_num)) {
+      fprintf(stderr, "Skew table '%s' can't correct cpu %d to %d;"
+              " both must be pinned and in jtr_tscskew's -C list\n",
+              opt_skew_table, opt_cpu_num, sender_cpu_num);
+      exit(1);
+    }
+  }
+
+  SYSE(pthread_create(&snd_thread_id, NULL, snd_thread, NULL));
+
+  /* Conduct the timing tests! */
+
+  for (i = 0; i < opt_loops; i++) {
+    for (s = 0; opt_Strategies[s] != '\0'; s++) {
+      strategy = opt_Strategies[s] - '0';
+      if (strategy < RCV_BLOCKING || strategy > RCV_RECVMMSG) {
+        fprintf(stderr, "Bad strategy '%c' in -S\n", opt_Strategies[s]);
+        exit(1);
+      }
+
+      rcv_sock = rcv_sock_create(strategy);
+      rcv_received = 0;
+      rcv_lost = 0;
+      rcv_next_seq = 0;
+      rcv_done = 0;
+      jtr_histo_init(opt_histo_buckets);
+
+      SYSE(getrusage(RUSAGE_THREAD, &start_ru));
+      clock_gettime(CLOCK_MONOTONIC, &start_ts);
+      snd_go = 1;
+      rcv_run(strategy);
+      rcv_done = 1;
+      clock_gettime(CLOCK_MONOTONIC, &end_ts);
+      SYSE(getrusage(RUSAGE_THREAD, &end_ru));
+      while (snd_go) {
+        usleep(1000);
+      }
+      close(rcv_sock);
+
+      run_ns = ((long long)end_ts.tv_sec - (long long)start_ts.tv_sec)
+               * NANOS_PER_SEC
+               + ((long long)end_ts.tv_nsec - (long long)start_ts.tv_nsec);
+      cpu_user_ns =
+        ((long long)end_ru.ru_utime.tv_sec - start_ru.ru_utime.tv_sec)
+          * NANOS_PER_SEC
+        + ((long long)end_ru.ru_utime.tv_usec - start_ru.ru_utime.tv_usec)
+          * 1000;
+      cpu_sys_ns =
+        ((long long)end_ru.ru_stime.tv_sec - start_ru.ru_stime.tv_sec)
+          * NANOS_PER_SEC
+        + ((long long)end_ru.ru_stime.tv_usec - start_ru.ru_stime.tv_usec)
+          * 1000;
+
+      snprintf(title, sizeof(title),
+              "%s (%s): Msg_size=%d, Batch=%d, Busy_poll_usec=%d,"
+              " Sender_cpu_num=%d, skew_table=%s,\n"
+              " cpu_num=%d, fifo_priority=%d, histo_buckets=%d,"
+              " num_samples=%d,\n"
+              " pause=%d, warmup_loops=%d,"
+              " rdtsc_cost=%lld, ticks_per_sec=%lld",
+              opt_descr, rcv_strategy_names[strategy],
+              opt_Msg_size, opt_Batch, opt_Busy_poll_usec,
+              sender_cpu_num,
+              (opt_skew_table == NULL) ? "none" : opt_skew_table,
+              opt_cpu_num, opt_fifo_priority, opt_histo_buckets,
+              opt_num_samples,
+              opt_pause, opt_warmup_loops,
+              jtr_rdtsc_cost, jtr_ticks_per_sec);
+      SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
+      snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+               sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+               "%s\n", title);
+      SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+      jtr_histo_print_all(opt_verbose, title);
+      snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+               sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+               "Received=%d, Lost=%d, Run_ns=%lld, Cpu_user_ns=%lld,"
+               " Cpu_sys_ns=%lld, Cpu_pct=%.1lf\n",
+               rcv_received, rcv_lost, run_ns, cpu_user_ns, cpu_sys_ns,
+               (100.0 * (double)(cpu_user_ns + cpu_sys_ns)) / (double)run_ns);
+      SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+    }  /* for s */
+  }  /* for i */
+
+  snd_exit = 1;
+  SYSE(pthread_join(snd_thread_id, NULL));
+  close(snd_sock);
+
+  if (opt_verbose >= 0) {
+    printf("%s", jtr_results_buf);
+
+    if (opt_gnuplot_file != NULL) {
+      FILE *gnuplot_fp = fopen(opt_gnuplot_file, "w");
+      SYSE(gnuplot_fp == NULL);
+
+      fprintf(gnuplot_fp, "%s", jtr_gnuplot_buf);
+      fclose(gnuplot_fp);
+    }
+  }
+
+  return 0;
+}  /* main */
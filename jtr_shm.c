@@ -0,0 +1,478 @@
+/* jtr_shm.c - tool to measure a shared-memory ring transport's jitter.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+/* Allow setting thread affinity. */
+#define _GNU_SOURCE
+#include <sched.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+int opt_cpu_num = 5;
+char *opt_descr = "Jitter shared memory test";
+int opt_fifo_priority = -1;
+char *opt_gnuplot_file = NULL;
+int opt_histo_buckets = 800;
+int opt_loops = 3;
+int opt_num_samples = 2000000;
+char *opt_results_store = "none";  /* See jtr_store_append(). */
+int opt_pause = JTR_10G_XMIT_1024_PKT_NS;
+int opt_timebase = 1;  /* 1=RDTSC, 2=clock_gettime() */
+int opt_warmup_loops = 1500;
+int opt_verbose = 0;
+char *opt_skew_table = NULL;  /* From jtr_tscskew. */
+
+/* Options specific to the shared memory test. */
+char *opt_Consumer_placement = "l3,socket";  /* See jtr_cpu_related(). */
+int opt_Msg_size = 1024;
+int opt_Receiver = 0;           /* 1=run a consumer process. */
+long long opt_Window_size = 65536;
+
+/* The ring lives in one shared mapping: a header with the producer and
+ * consumer indexes on separate cache lines (so the only sharing is what a
+ * real transport would have), followed by the window of fixed-size slots.
+ * Like SMX, the sender writes the message in place in the slot it holds,
+ * then "completes" it (publishes it) and acquires the next one.
+ */
+#define SHM_CACHE_LINE 64
+typedef struct shm_ring_s {
+  volatile uint64_t prod;  /* Next slot to be completed by sender. */
+  char pad1[SHM_CACHE_LINE - sizeof(uint64_t)];
+  volatile uint64_t cons;  /* Next slot to be read by consumer. */
+  char pad2[SHM_CACHE_LINE - sizeof(uint64_t)];
+  volatile int stop;       /* Sender sets when run is over. */
+  char pad3[SHM_CACHE_LINE - sizeof(int)];
+} shm_ring_t;
+
+typedef struct shm_msg_hdr_s {
+  uint64_t send_ticks;
+  int seq;
+  int len;
+} shm_msg_hdr_t;
+
+shm_ring_t *shm_ring;
+char *shm_slots;
+int shm_slot_size;     /* Header + msg, rounded up to a cache line. */
+uint64_t shm_num_slots;
+char *shm_cur_slot;    /* Slot currently acquired by the sender. */
+int shm_seq;
+long long shm_full_waits;
+char *message_buf;
+int *oneway_ns;        /* Shared; filled in by the consumer. */
+pid_t consumer_pid;
+int consumer_cpu_num = -1;
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_shm [-C consumer_placement] [-M msg_size] [-R receiver]"
+" [-W window_size]\n"
+" [-c cpu_num] [-d descr] [-f fifo_priority] [-g gnuplot_file]"
+" [-h histo_buckets] [-l loops] [-n num_samples] [-o results_store]"
+" [-p pause] [-t timebase] [-w warmup_loops] [-k skew_table] [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -C consumer_placement : CPU of the consumer process, by its relation to\n"
+"                         cpu_num (see jtr_ss -P), or a CPU number (-1 to not\n"
+"                         pin). (default=l3,socket)\n"
+" -M msg_size : number of bytes in message to send. (default=1024)\n"
+" -R receiver : 1=run a consumer process, 0=no consumer (like\n"
+"               tst_smxnorcv.sh). (default=0)\n"
+" -W window_size : bytes of ring buffer; accepts k and m suffixes,\n"
+"                  e.g. 64k..32m. (default=64k)\n"
+" -c cpu_num : integer CPU number to pin thread. Use -1 to not pin.\n"
+"              (default=5)\n"
+" -d descr : description string. (default='Jitter shared memory test')\n"
+" -f fifo_priority : integer priority level to set real-time FIFO scheduling.\n"
+"                  : -1 does not set real-time. (default=-1)\n"
+" -g gnuplot_file : name of file to create containing gnuplot commands to\n"
+"                   graph the histogram data. (default=no file)\n"
+" -h histo_buckets : number of buckets for histogram. (default=800)\n"
+" -k skew_table : TSC correction table written by jtr_tscskew, applied to\n"
+"                 one-way times between this thread and the consumer process.\n"
+"                 (default=none)\n"
+" -l loops : number of test runs to perform. Each test run does the sender\n"
+"            histogram, plus the one-way histogram if -R 1. (default=3)\n"
+" -n num_samples : number of samples in a test. (default=2,000,000)\n"
+" -o results_store : directory to append each histogram to, with a host\n"
+"                    fingerprint including the mitigations; see jtr_query.\n"
+"                    (default=none)\n"
+" -p pause : number of nanoseconds to pause between each sample.\n"
+"            (default=898)\n"
+" -t timebase : integer indicating which method of time measement to use.\n"
+"               1=RDTSC, 2=clock_gettime(), 3=core cycles (RDPMC).\n"
+"               (default=1)\n"
+" -w warmup_loops : number of samples to initially take without accumulating\n"
+"                   the results. (default=1500)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet, 0=normal, 2=details. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse a byte count with optional k/m/g suffix.
+ */
+long long parse_size(char *str)
+{
+  char *end;
+  long long val = strtoll(str, &end, 10);
+
+  switch (*end) {
+    case 'k': case 'K': val *= 1024ll; break;
+    case 'm': case 'M': val *= 1024ll * 1024ll; break;
+    case 'g': case 'G': val *= 1024ll * 1024ll * 1024ll; break;
+    case '\0': break;
+    default:
+      fprintf(stderr, "Bad size '%s'\n", str);
+      exit(1);
+  }
+  return val;
+}  /* parse_size */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "C:M:R:W:c:d:f:g:h:k:l:n:o:p:t:w:v:")) != EOF) {
+    switch (opt) {
+      case 'C': opt_Consumer_placement = strdup(optarg); break;
+      case 'M': opt_Msg_size = atoi(optarg); break;
+      case 'R': opt_Receiver = atoi(optarg); break;
+      case 'W': opt_Window_size = parse_size(optarg); break;
+      case 'c': opt_cpu_num = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'f': opt_fifo_priority = atoi(optarg); break;
+      case 'g': opt_gnuplot_file = strdup(optarg); break;
+      case 'h': opt_histo_buckets = atoi(optarg); break;
+      case 'k': opt_skew_table = strdup(optarg); break;
+      case 'l': opt_loops = atoi(optarg); break;
+      case 'n': opt_num_samples = atoi(optarg); break;
+      case 'o': opt_results_store = strdup(optarg); break;
+      case 'p': opt_pause = atoi(optarg); break;
+      case 't': opt_timebase = atoi(optarg); break;
+      case 'w': opt_warmup_loops = atoi(optarg);
+        if (opt_warmup_loops < 0) usage();  /* Indexes samples by seq. */
+        break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+
+  /* A number pins the consumer there even with "-c -1". */
+  if (opt_Consumer_placement[0] == '-'
+      || (opt_Consumer_placement[0] >= '0'
+          && opt_Consumer_placement[0] <= '9')) {
+    consumer_cpu_num = atoi(opt_Consumer_placement);
+  } else if (opt_cpu_num >= 0) {
+    consumer_cpu_num = jtr_cpu_related(opt_cpu_num, opt_Consumer_placement);
+  } else {
+    consumer_cpu_num = -1;
+  }
+  shm_slot_size = sizeof(shm_msg_hdr_t) + opt_Msg_size;
+  shm_slot_size = (shm_slot_size + SHM_CACHE_LINE - 1)
+                  & ~(SHM_CACHE_LINE - 1);
+  shm_num_slots = opt_Window_size / shm_slot_size;
+  if (shm_num_slots < 2) {
+    fprintf(stderr, "-W %lld too small for -M %d\n",
+            opt_Window_size, opt_Msg_size);
+    exit(1);
+  }
+}  /* get_options */
+
+
+/* Acquire the next slot. With a consumer, wait for it to free one up.
+ * Without a consumer there is no flow control; the window just wraps.
+ */
+static inline void shm_acquire(void)
+{
+  uint64_t prod = shm_ring->prod;
+
+  if (opt_Receiver) {
+    if (unlikely(prod - __atomic_load_n(&shm_ring->cons, __ATOMIC_ACQUIRE)
+                 >= shm_num_slots)) {
+      shm_full_waits ++;
+      while (prod - __atomic_load_n(&shm_ring->cons, __ATOMIC_ACQUIRE)
+             >= shm_num_slots) {
+      }
+    }
+  }
+  shm_cur_slot = &shm_slots[(prod % shm_num_slots) * shm_slot_size];
+}  /* shm_acquire */
+
+
+/* Timed callback: write message in place, complete it, acquire the next.
+ */
+void shm_send_cb(void *clientd)
+{
+  shm_msg_hdr_t *hdr = (shm_msg_hdr_t *)shm_cur_slot;
+  uint32_t ticks_hi, ticks_lo;
+
+  memcpy(shm_cur_slot + sizeof(shm_msg_hdr_t), message_buf, opt_Msg_size);
+  hdr->seq = shm_seq++;
+  hdr->len = opt_Msg_size;
+  RDTSC(ticks_hi, ticks_lo);
+  hdr->send_ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+
+  __atomic_store_n(&shm_ring->prod, shm_ring->prod + 1, __ATOMIC_RELEASE);
+  shm_acquire();
+}  /* shm_send_cb */
+
+
+/* Consumer process: read every message, touching each of its cache lines
+ * the way an application would, and record the one-way time.
+ */
+void shm_consumer(void)
+{
+  uint64_t cons = 0;
+  uint32_t ticks_hi, ticks_lo;
+  uint64_t rcv_ticks;
+  shm_msg_hdr_t *hdr;
+  char *slot;
+  long long diff_ns;
+  volatile int sum = 0;
+  int idx, i;
+
+  if (consumer_cpu_num >= 0) {
+    jtr_pin_cpu(consumer_cpu_num);
+  }
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+
+  while (1) {
+    while (__atomic_load_n(&shm_ring->prod, __ATOMIC_ACQUIRE) == cons) {
+      if (shm_ring->stop) {
+        exit(0);
+      }
+    }
+    RDTSC(ticks_hi, ticks_lo);
+    rcv_ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+
+    slot = &shm_slots[(cons % shm_num_slots) * shm_slot_size];
+    hdr = (shm_msg_hdr_t *)slot;
+    for (i = 0; i < hdr->len; i += SHM_CACHE_LINE) {
+      sum += slot[sizeof(shm_msg_hdr_t) + i];
+    }
+
+    idx = hdr->seq - opt_warmup_loops;
+    if (idx >= 0 && idx < opt_num_samples) {
+      diff_ns = (((long long)rcv_ticks - (long long)hdr->send_ticks
+                 - jtr_tscskew_ticks(opt_cpu_num, consumer_cpu_num,
+                                     (long long)rcv_ticks))
+                 * NANOS_PER_SEC) / jtr_ticks_per_sec;
+      diff_ns -= jtr_rdtsc_cost;  /* Correct for measurement cost. */
+      oneway_ns[idx] = (int)diff_ns;
+    }
+
+    cons ++;
+    __atomic_store_n(&shm_ring->cons, cons, __ATOMIC_RELEASE);
+  }
+}  /* shm_consumer */
+
+
+/* Add the title for one histogram to the results and print the histogram.
+ */
+void shm_print(char *kind)
+{
+  char title[1024];
+
+  snprintf(title, sizeof(title),
+          "%s%s: Msg_size=%d, Window_size=%lld, Slots=%llu, Receiver=%d,"
+          " Consumer_cpu_num=%d, skew_table=%s,\n"
+          " cpu_num=%d, fifo_priority=%d, histo_buckets=%d, num_samples=%d,\n"
+          " pause=%d timebase=%d, warmup_loops=%d, gettime_cost=%lld,\n"
+          " rdtsc_cost=%lld, ticks_per_sec=%lld, jtr_1000_loops_cost=%lld",
+          opt_descr, kind, opt_Msg_size, opt_Window_size,
+          (unsigned long long)shm_num_slots, opt_Receiver,
+          consumer_cpu_num,
+          (opt_skew_table == NULL) ? "none" : opt_skew_table,
+          opt_cpu_num, opt_fifo_priority, opt_histo_buckets, opt_num_samples,
+          opt_pause, opt_timebase, opt_warmup_loops, jtr_gettime_cost,
+          jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
+  SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "%s\n", title);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  jtr_histo_print_all(opt_verbose, title);
+}  /* shm_print */
+
+
+int main(int argc, char **argv)
+{
+  int i, s;
+  char *shm_map;
+  size_t shm_map_size;
+  struct timespec start_ts, end_ts;  /* tv_sec, tv_nsec */
+  long long run_ns;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  jtr_y_high = opt_num_samples;
+  jtr_store_init(opt_results_store, opt_cpu_num);
+
+  message_buf = malloc(opt_Msg_size);
+
+  shm_map_size = sizeof(shm_ring_t) + shm_num_slots * shm_slot_size;
+  shm_map = mmap(NULL, shm_map_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  SYSE(shm_map == MAP_FAILED);
+  shm_ring = (shm_ring_t *)shm_map;
+  shm_slots = shm_map + sizeof(shm_ring_t);
+  oneway_ns = mmap(NULL, opt_num_samples * sizeof(int),
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  SYSE(oneway_ns == MAP_FAILED);
+
+  /* Empty out the results buffer (and page it in). */
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = 0;
+  }
+  for (i = 0; i < sizeof(jtr_gnuplot_buf); i++) {
+    jtr_gnuplot_buf[i] = '\0';
+  }
+  /* Page in the whole window and the one-way sample array. */
+  memset(shm_map, 0, shm_map_size);
+  memset(oneway_ns, 0, opt_num_samples * sizeof(int));
+
+  if (opt_cpu_num >= 0) {
+    jtr_pin_cpu(opt_cpu_num);
+  }
+
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+
+  if (opt_timebase == 3 && ! jtr_cycles_init()) {
+    opt_timebase = 1;  /* No usable cycle counter. */
+  }
+
+  /* Init message buffer into cache. */
+  for (i = 0; i < opt_Msg_size; i++) {
+    message_buf[i] = (char)i;
+  }
+
+  for (i = 0; i < 20; i++) {
+    jtr_calibrate();
+  }
+
+  if (opt_skew_table != NULL) {
+    if (jtr_tscskew_load(opt_skew_table) == 0
+        || ! jtr_tscskew_known(opt_cpu_num)
+        || ! jtr_tscskew_known(consumer_cpu_num)) {
+      fprintf(stderr, "Skew table '%s' can't correct cpu %d to %d;"
+              " both must be pinned and in jtr_tscskew's -C list\n",
+              opt_skew_table, opt_cpu_num, consumer_cpu_num);
+      exit(1);
+    }
+  }
+
+  /* Conduct the timing tests! */
+
+  for (i = 0; i < opt_loops; i++) {
+    shm_ring->prod = 0;
+    shm_ring->cons = 0;
+    shm_ring->stop = 0;
+    shm_seq = 0;
+    shm_full_waits = 0;
+    if (opt_Receiver) {
+      fflush(stdout);
+      consumer_pid = fork();
+      SYSE(consumer_pid == -1);
+      if (consumer_pid == 0) {
+        shm_consumer();  /* Does not return. */
+      }
+    }
+    shm_acquire();
+
+    jtr_histo_init(opt_histo_buckets);
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
+                      opt_timebase, shm_send_cb, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    run_ns = ((long long)end_ts.tv_sec - (long long)start_ts.tv_sec)
+             * NANOS_PER_SEC
+             + ((long long)end_ts.tv_nsec - (long long)start_ts.tv_nsec);
+
+    if (opt_Receiver) {
+      /* Let the consumer drain, then stop it. */
+      while (__atomic_load_n(&shm_ring->cons, __ATOMIC_ACQUIRE)
+             != shm_ring->prod) {
+      }
+      shm_ring->stop = 1;
+      SYSE(waitpid(consumer_pid, NULL, 0) != consumer_pid);
+    }
+
+    shm_print("");
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Sends=%d, Run_ns=%lld, Rate=%lld msgs/sec, Full_waits=%lld\n",
+             opt_warmup_loops + opt_num_samples, run_ns,
+             ((long long)(opt_warmup_loops + opt_num_samples) * NANOS_PER_SEC)
+               / run_ns,
+             shm_full_waits);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+    if (opt_Receiver) {
+      jtr_histo_init(opt_histo_buckets);
+      for (s = 0; s < opt_num_samples; s++) {
+        if (unlikely(oneway_ns[s] < 0)) {
+          jtr_neg_diffs ++;
+          oneway_ns[s] = 0;
+        }
+        jtr_histo_accum(oneway_ns[s]);
+      }
+      shm_print(" (one way)");
+    }
+  }
+
+  if (opt_verbose >= 0) {
+    printf("%s", jtr_results_buf);
+
+    if (opt_gnuplot_file != NULL) {
+      FILE *gnuplot_fp = fopen(opt_gnuplot_file, "w");
+      SYSE(gnuplot_fp == NULL);
+
+      fprintf(gnuplot_fp, "%s", jtr_gnuplot_buf);
+      fclose(gnuplot_fp);
+    }
+  }
+
+  return 0;
+}  /* main */
@@ -34,8 +34,19 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <linux/if_xdp.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
 
 #include "jtr.h"
 
@@ -51,6 +62,14 @@ int opt_pause = JTR_10G_XMIT_1024_PKT_NS;
 int opt_timebase = 1;  /* 1=RDTSC, 2=clock_gettime() */
 int opt_warmup_loops = 1500;
 int opt_verbose = 0;
+int opt_live = 0;  /* 1=publish live statistics for jtr_top. */
+int opt_mem_mode = 0;  /* See jtr_mem_init(). */
+int opt_pmu = 0;  /* 1=read PMU counters around each sample. */
+char *opt_pattern = "fixed";  /* See jtr_pattern_init(). */
+char *opt_converge = "none";  /* See jtr_converge_init(). */
+char *opt_results_store = "none";  /* See jtr_store_append(). */
+char *opt_size_dist = NULL;  /* NULL=every message is -M bytes. */
+char *opt_trace_file = NULL;  /* pcap file to replay. */
 
 /* Options specific to the sock test. */
 unsigned short opt_Destport = 0;  /* Required "option". */
@@ -58,6 +77,9 @@ unsigned long opt_Groupaddr = 0;  /* Required "option". */
 unsigned long opt_Interface = 0;  /* Required "option". */
 char opt_Ttl = -1;                /* Required "option". */
 int opt_Msg_size = 1024;
+char *opt_Xdp_ifname = NULL;  /* Non-NULL selects AF_XDP instead of UDP. */
+int opt_Zero_copy = 0;        /* AF_XDP: 0=copy (generic/skb), 1=zero-copy. */
+char *opt_Noise_profiles = "none";
 
 /* socket object. */
 int mcast_sock;
@@ -65,7 +87,32 @@ struct sockaddr_in dest_in;
 struct in_addr interface_in;
 char *message_buf;
 
+/* AF_XDP objects. The UMEM holds XDP_NUM_FRAMES complete Ethernet frames,
+ * all pre-built from message_buf, so a send only has to post a descriptor.
+ * The TX and completion rings are the same size as the UMEM, so a frame's
+ * index is simply the TX producer index modulo the ring size.
+ */
+#define XDP_NUM_FRAMES 2048  /* Must be power of 2. */
+#define XDP_FRAME_SIZE 2048
+#define XDP_HDRS_LEN (14 + 20 + 8)  /* Ethernet + IPv4 + UDP. */
+int xdp_sock = -1;
+char *xdp_umem;
+struct xdp_ring_s {
+  uint32_t *producer;
+  uint32_t *consumer;
+  uint32_t *flags;
+  void *descs;
+  uint32_t cached_prod;
+  uint32_t cached_cons;
+} xdp_tx, xdp_cq, xdp_fq;
+int xdp_outstanding = 0;  /* Frames posted but not yet completed. */
+long long xdp_wakeups = 0;
+long long xdp_full_spins = 0;
+
 /* Other globals. */
+char *noise_profiles[JTR_NOISE_MAX_PROFILES];
+int num_noise_profiles;
+char noise_summary_buf[16384];  /* Per-run one-liners, printed at end. */
 int jtr_no_send_spin = 0;
 
 
@@ -73,9 +120,11 @@ void usage()
 {
   fprintf(stderr,
 "Usage: jtr_sock -D destport -G groupaddr -I interface -T ttl [-M msg_size]\n"
-" [-c cpu_num] [-d descr] [-f fifo_priority] [-g gnuplot_file]"
-" [-h histo_buckets] [-l loops] [-n num_samples] [-p pause] [-t timebase]"
-" [-w warmup_loops] [-v verbose]\n");
+" [-N noise_profiles] [-X xdp_ifname] [-Z] [-b pattern]"
+" [-c cpu_num] [-d descr] [-e pmu] [-f fifo_priority] [-g gnuplot_file]"
+" [-h histo_buckets] [-l loops] [-m mem_mode] [-n num_samples]"
+" [-o results_store] [-p pause] [-r trace_file] [-s live] [-t timebase]"
+" [-u converge] [-w warmup_loops] [-z size_dist] [-v verbose]\n");
   fprintf(stderr,
 "Where:\n");
   fprintf(stderr,
@@ -84,9 +133,25 @@ void usage()
 " -I interface : required network interface address to send multicast.\n"
 " -T ttl : required multicast time-to-live.\n"
 " -M msg_size : number of bytes in message to send. (default=1024)\n"
+" -X xdp_ifname : send with an AF_XDP socket bound to queue 0 of this\n"
+"                 interface instead of a UDP socket. Requires root.\n"
+"                 (default=UDP socket)\n"
+" -Z : with -X, request zero-copy mode. (default=copy (generic/skb) mode)\n"
+" -N noise_profiles : slash-separated list of interference profiles; each\n"
+"                     test run is repeated under each profile. A profile is\n"
+"                     a comma-separated list of kind[:cpu_num[:intensity]],\n"
+"                     kind=membw,l3,syscall,smt; intensity is percent.\n"
+"                     E.g. 'none/membw:7/l3:9:50,syscall:11/smt'.\n"
+"                     (default=none)\n"
+" -b pattern : traffic pattern, replacing the fixed pause (-p) between calls:\n"
+"              burst:N:gap_ns[:pause_ns], onoff:on_ns:off_ns:pause_ns, or\n"
+"              poisson:calls_per_sec. Also reports latency by position in\n"
+"              the burst. (default=fixed)\n"
 " -c cpu_num : integer CPU number to pin thread. Use -1 to not pin.\n"
 "               (default=5)\n"
 " -d descr : description string. (default='Jitter socket test')\n"
+" -e pmu : 1=read LLC miss, dTLB miss, branch miss, and instruction\n"
+"          counters with RDPMC around each sample. (default=0)\n"
 " -f fifo_priority : integer priority level to set real-time FIFO scheduling.\n"
 "                  : -1 does not set real-time. (default=-1)\n"
 " -g gnuplot_file : name of file to create containing gnuplot commands to\n"
@@ -95,13 +160,32 @@ void usage()
 " -l loops : number of test runs to perform. Each test run does two tests,\n"
 "            first with the UM call, and then with an equivelent null loop.\n"
 "            (default=3)\n"
-" -n num_samples : number of samples in a test. (default=1,000,000)\n"
+" -m mem_mode : 1=mlockall and prefault the stack and buffers,\n"
+"               2=also put buffers in 2MB huge pages, 3=1GB huge pages.\n"
+"               (default=0)\n"
+" -n num_samples : number of samples in a test. (default=2,000,000)\n"
+" -o results_store : directory of an append-only results store; each\n"
+"                    histogram is added to it with a fingerprint of the\n"
+"                    host. See jtr_query. (default=none)\n"
 " -p pause : number of nanoseconds to pause between each sample, to allow\n"
 "            packet to exit NIC. (default=898)\n"
+" -r trace_file : pcap file whose UDP payload sizes and arrival gaps are\n"
+"                replayed (repeating), replacing -M, -b, -p and -z.\n"
+"                (default=none)\n"
+" -s live : 1=publish live statistics in shared memory for jtr_top.\n"
+"           (default=0)\n"
 " -t timebase : integer indicating which method of time measement to use.\n"
-"               1=RDTSC, 2=clock_gettime(). (default=1)\n"
+"               1=RDTSC, 2=clock_gettime(), 3=core cycles (RDPMC).\n"
+"               (default=1)\n"
+" -u converge : keep sampling in batches of num_samples until the 95%%\n"
+"              confidence interval of a percentile is within a tolerance,\n"
+"              or a time limit: percentile:tolerance_pct:max_sec, e.g.\n"
+"              '99.99:5:60'. (default=none)\n"
 " -w warmup_loops : number of samples to initially take without accumulating\n"
-"                   the results. (default=500)\n"
+"                   the results. -1=detect steady state. (default=1500)\n"
+" -z size_dist : message sizes and weights, e.g. '40:70,1024:25,8192:5',\n"
+"               replacing -M. Also reports latency by size class.\n"
+"               (default=none)\n"
 " -v verbose : integer indicating how much information to print.\n"
 "              -1=quiet, 0=normal, 2=details. (default=0)\n");
   exit(1);
@@ -114,7 +198,7 @@ void get_options(int argc, char **argv)
 {
   int opt;
 
-  while ((opt = getopt(argc, argv, "D:G:I:T:M:c:d:f:g:h:l:n:p:t:w:v")) != EOF) {
+  while ((opt = getopt(argc, argv, "D:G:I:T:M:N:X:Zb:c:d:e:f:g:h:l:m:n:o:p:r:s:t:u:w:z:v:")) != EOF) {
     switch (opt) {
       case 'D': opt_Destport = atoi(optarg); break;
       case 'G': opt_Groupaddr = inet_addr(optarg);
@@ -131,17 +215,28 @@ void get_options(int argc, char **argv)
         break;
       case 'M': opt_Msg_size = atoi(optarg); break;
       case 'T': opt_Ttl = atoi(optarg); break;
+      case 'N': opt_Noise_profiles = strdup(optarg); break;
+      case 'X': opt_Xdp_ifname = strdup(optarg); break;
+      case 'Z': opt_Zero_copy = 1; break;
+      case 'b': opt_pattern = strdup(optarg); break;
       case 'c': opt_cpu_num = atoi(optarg); break;
       case 'd': opt_descr = strdup(optarg); break;
+      case 'e': opt_pmu = atoi(optarg); break;
       case 'f': opt_fifo_priority = atoi(optarg); break;
       case 'g': opt_gnuplot_file = strdup(optarg); break;
       case 'h': opt_histo_buckets = atoi(optarg); break;
       case 'l': opt_loops = atoi(optarg); break;
+      case 'm': opt_mem_mode = atoi(optarg); break;
       case 'n': opt_num_samples = atoi(optarg); break;
+      case 'o': opt_results_store = strdup(optarg); break;
       case 'p': opt_pause = atoi(optarg); break;
+      case 'r': opt_trace_file = strdup(optarg); break;
+      case 's': opt_live = atoi(optarg); break;
       case 't': opt_timebase = atoi(optarg); break;
+      case 'u': opt_converge = strdup(optarg); break;
       case 'w': opt_warmup_loops = atoi(optarg); break;
-      case 'v': opt_verbose = 1; break;
+      case 'z': opt_size_dist = strdup(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
       default: usage();
     }  /* switch opt */
   }  /* while getopt */
@@ -150,12 +245,214 @@ void get_options(int argc, char **argv)
   if (opt_Groupaddr == 0) { fprintf(stderr, "Missing -G groupaddr\n"); exit(1); }
   if (opt_Interface == 0) { fprintf(stderr, "Missing -I interface\n"); exit(1); }
   if (opt_Ttl == -1) { fprintf(stderr, "Missing -T ttl\n"); exit(1); }
+  if (opt_Xdp_ifname != NULL && opt_Msg_size > XDP_FRAME_SIZE - XDP_HDRS_LEN) {
+    fprintf(stderr, "-M %d too big for AF_XDP frame\n", opt_Msg_size);
+    exit(1);
+  }
 }  /* get_options */
 
 
+/* Standard ones-complement checksum, used for the pre-built IPv4 header.
+ */
+uint16_t xdp_ip_csum(uint8_t *hdr, int len)
+{
+  uint32_t sum = 0;
+  int i;
+
+  for (i = 0; i < len; i += 2) {
+    sum += (hdr[i] << 8) | hdr[i+1];
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return (uint16_t)~sum;
+}  /* xdp_ip_csum */
+
+
+/* Build one complete multicast UDP frame (Ethernet + IPv4 + UDP + payload).
+ * Returns the frame length.
+ */
+int xdp_build_frame(uint8_t *frame, uint8_t *src_mac)
+{
+  uint8_t *ip = &frame[14];
+  uint8_t *udp = &frame[14 + 20];
+  uint32_t group = ntohl(opt_Groupaddr);
+  int ip_len = 20 + 8 + opt_Msg_size;
+  uint16_t csum;
+
+  /* Ethernet: IPv4 multicast MAC is 01:00:5e + low 23 bits of group. */
+  frame[0] = 0x01; frame[1] = 0x00; frame[2] = 0x5e;
+  frame[3] = (group >> 16) & 0x7f;
+  frame[4] = (group >> 8) & 0xff;
+  frame[5] = group & 0xff;
+  memcpy(&frame[6], src_mac, 6);
+  frame[12] = 0x08; frame[13] = 0x00;  /* ETH_P_IP */
+
+  /* IPv4 header, no options, don't fragment. */
+  memset(ip, 0, 20);
+  ip[0] = 0x45;
+  ip[2] = ip_len >> 8; ip[3] = ip_len & 0xff;
+  ip[6] = 0x40;
+  ip[8] = (uint8_t)opt_Ttl;
+  ip[9] = IPPROTO_UDP;
+  memcpy(&ip[12], &opt_Interface, 4);  /* Already network order. */
+  memcpy(&ip[16], &opt_Groupaddr, 4);
+  csum = xdp_ip_csum(ip, 20);
+  ip[10] = csum >> 8; ip[11] = csum & 0xff;
+
+  /* UDP header; checksum 0 (not used) is legal for IPv4. */
+  udp[0] = opt_Destport >> 8; udp[1] = opt_Destport & 0xff;
+  udp[2] = opt_Destport >> 8; udp[3] = opt_Destport & 0xff;
+  udp[4] = (8 + opt_Msg_size) >> 8; udp[5] = (8 + opt_Msg_size) & 0xff;
+  udp[6] = 0; udp[7] = 0;
+
+  memcpy(&frame[XDP_HDRS_LEN], message_buf, opt_Msg_size);
+
+  return XDP_HDRS_LEN + opt_Msg_size;
+}  /* xdp_build_frame */
+
+
+/* Map one of the AF_XDP rings into our address space.
+ */
+void xdp_map_ring(struct xdp_ring_s *ring, struct xdp_ring_offset *off,
+                  size_t desc_size, off_t pgoff)
+{
+  char *map;
+
+  map = mmap(NULL, off->desc + XDP_NUM_FRAMES * desc_size,
+             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+             xdp_sock, pgoff);
+  SYSE(map == MAP_FAILED);
+  ring->producer = (uint32_t *)(map + off->producer);
+  ring->consumer = (uint32_t *)(map + off->consumer);
+  ring->flags = (uint32_t *)(map + off->flags);
+  ring->descs = map + off->desc;
+  ring->cached_prod = *ring->producer;
+  ring->cached_cons = *ring->consumer;
+}  /* xdp_map_ring */
+
+
+/* Create the AF_XDP socket, register the UMEM, create the rings, pre-build
+ * every frame, and bind to queue 0 of the interface. No XDP program is
+ * needed since we only transmit.
+ */
+void xdp_init(void)
+{
+  struct xdp_umem_reg umem_reg;
+  struct xdp_mmap_offsets off;
+  struct sockaddr_xdp sxdp;
+  struct ifreq ifr;
+  socklen_t optlen;
+  int ring_size = XDP_NUM_FRAMES;
+  int frame_len = 0;
+  int i;
+
+  xdp_sock = socket(AF_XDP, SOCK_RAW, 0);
+  SYSE(xdp_sock == -1);
+
+  /* Source MAC comes from the interface. */
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, opt_Xdp_ifname, IFNAMSIZ - 1);
+  SYSE(ioctl(mcast_sock, SIOCGIFHWADDR, &ifr));
+
+  xdp_umem = mmap(NULL, XDP_NUM_FRAMES * XDP_FRAME_SIZE,
+                  PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  SYSE(xdp_umem == MAP_FAILED);
+  for (i = 0; i < XDP_NUM_FRAMES; i++) {
+    frame_len = xdp_build_frame((uint8_t *)&xdp_umem[i * XDP_FRAME_SIZE],
+                                (uint8_t *)ifr.ifr_hwaddr.sa_data);
+  }
+
+  memset(&umem_reg, 0, sizeof(umem_reg));
+  umem_reg.addr = (uint64_t)(uintptr_t)xdp_umem;
+  umem_reg.len = XDP_NUM_FRAMES * XDP_FRAME_SIZE;
+  umem_reg.chunk_size = XDP_FRAME_SIZE;
+  SYSE(setsockopt(xdp_sock, SOL_XDP, XDP_UMEM_REG,
+                  &umem_reg, sizeof(umem_reg)));
+  /* The kernel insists on a fill ring even though we never receive. */
+  SYSE(setsockopt(xdp_sock, SOL_XDP, XDP_UMEM_FILL_RING,
+                  &ring_size, sizeof(ring_size)));
+  SYSE(setsockopt(xdp_sock, SOL_XDP, XDP_UMEM_COMPLETION_RING,
+                  &ring_size, sizeof(ring_size)));
+  SYSE(setsockopt(xdp_sock, SOL_XDP, XDP_TX_RING,
+                  &ring_size, sizeof(ring_size)));
+
+  optlen = sizeof(off);
+  SYSE(getsockopt(xdp_sock, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen));
+  xdp_map_ring(&xdp_tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING);
+  xdp_map_ring(&xdp_cq, &off.cr, sizeof(uint64_t),
+               XDP_UMEM_PGOFF_COMPLETION_RING);
+  xdp_map_ring(&xdp_fq, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING);
+
+  /* Every TX descriptor permanently points at "its" frame. */
+  for (i = 0; i < XDP_NUM_FRAMES; i++) {
+    struct xdp_desc *desc = &((struct xdp_desc *)xdp_tx.descs)[i];
+    desc->addr = (uint64_t)i * XDP_FRAME_SIZE;
+    desc->len = frame_len;
+    desc->options = 0;
+  }
+
+  memset(&sxdp, 0, sizeof(sxdp));
+  sxdp.sxdp_family = AF_XDP;
+  sxdp.sxdp_ifindex = if_nametoindex(opt_Xdp_ifname);
+  SYSE(sxdp.sxdp_ifindex == 0);
+  sxdp.sxdp_queue_id = 0;
+  sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP |
+                    (opt_Zero_copy ? XDP_ZEROCOPY : XDP_COPY);
+  SYSE(bind(xdp_sock, (struct sockaddr *)&sxdp, sizeof(sxdp)));
+}  /* xdp_init */
+
+
+/* Return completed frames to the free pool. Completions can arrive in any
+ * batch size, but always in order, so only the count matters.
+ */
+static inline void xdp_reclaim(void)
+{
+  uint32_t prod = __atomic_load_n(xdp_cq.producer, __ATOMIC_ACQUIRE);
+  uint32_t done = prod - xdp_cq.cached_cons;
+
+  if (done > 0) {
+    xdp_cq.cached_cons = prod;
+    __atomic_store_n(xdp_cq.consumer, prod, __ATOMIC_RELEASE);
+    xdp_outstanding -= done;
+  }
+}  /* xdp_reclaim */
+
+
+/* Kick the kernel if it asked to be woken (always true in copy mode).
+ */
+static inline void xdp_kick(void)
+{
+  if (__atomic_load_n(xdp_tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP) {
+    xdp_wakeups ++;
+    sendto(xdp_sock, NULL, 0, MSG_DONTWAIT, NULL, 0);
+  }
+}  /* xdp_kick */
+
+
+void xdp_send_cb(void *clientd)
+{
+  xdp_reclaim();
+  while (unlikely(xdp_outstanding >= XDP_NUM_FRAMES)) {
+    xdp_full_spins ++;
+    xdp_kick();
+    xdp_reclaim();
+  }
+  JTR_MARK(0);
+
+  /* Descriptor for this slot is pre-built; just publish it. */
+  xdp_tx.cached_prod ++;
+  xdp_outstanding ++;
+  __atomic_store_n(xdp_tx.producer, xdp_tx.cached_prod, __ATOMIC_RELEASE);
+  JTR_MARK(1);
+  xdp_kick();  /* Reported as the "rest" phase. */
+}  /* xdp_send_cb */
+
+
 void sock_send_cb(void *clientd)
 {
-  int send_rtn = sendto(mcast_sock, message_buf, opt_Msg_size, 0,
+  int msg_size = (jtr_msg_size > 0) ? jtr_msg_size : opt_Msg_size;
+  int send_rtn = sendto(mcast_sock, message_buf, msg_size, 0,
                         (struct sockaddr *)&dest_in, sizeof(dest_in));
   SYSE(send_rtn == -1);
 }  /* sock_send_cb */
@@ -173,13 +470,31 @@ int main(int argc, char **argv)
 {
   int i;
   char title[1024];
+  char label[1024];
+  char *noise_profile;
+  app_cb_t send_cb = sock_send_cb;
+  struct timespec start_ts;  /* tv_sec, tv_nsec */
+  struct timespec end_ts;  /* tv_sec, tv_nsec */
+  long long run_ns;
 
   /* Parse command-line options. */
   get_options(argc, argv);
 
   jtr_y_high = opt_num_samples;
 
-  message_buf = malloc(opt_Msg_size);
+  jtr_mem_init(opt_mem_mode);  /* Before any buffers are allocated. */
+  jtr_pattern_init(opt_pattern, opt_size_dist, opt_trace_file, opt_pause);
+  jtr_converge_init(opt_converge);
+  jtr_store_init(opt_results_store, opt_cpu_num);
+  if (jtr_pattern_max_size > opt_Msg_size) {
+    opt_Msg_size = jtr_pattern_max_size;  /* Buffer must fit the largest. */
+  }
+  if (opt_Xdp_ifname != NULL && jtr_pattern_max_size > 0) {
+    fprintf(stderr, "-z and -r can't be used with -X (frames are pre-built)\n");
+    exit(1);
+  }
+
+  message_buf = jtr_mem_alloc(opt_Msg_size);
 
   /* Empty out the results buffer (and page it in). */
   for (i = 0; i < sizeof(jtr_results_buf); i++) {
@@ -197,6 +512,18 @@ int main(int argc, char **argv)
     jtr_set_fifo_priority(opt_fifo_priority);
   }
 
+  if (opt_pmu) {
+    jtr_pmu_init();  /* Counts the calling (measuring) thread only. */
+  }
+
+  if (opt_timebase == 3 && ! jtr_cycles_init()) {
+    opt_timebase = 1;  /* No usable cycle counter. */
+  }
+
+  if (opt_live) {
+    jtr_live_start("jtr_sock", opt_descr, opt_cpu_num);
+  }
+
   mcast_sock = socket(PF_INET, SOCK_DGRAM, 0);
   SYSE(mcast_sock == -1);
   memset((char *)&dest_in, 0, sizeof(dest_in));
@@ -217,24 +544,43 @@ int main(int argc, char **argv)
     message_buf[i] = (char)i;
   }
 
+  if (opt_Xdp_ifname != NULL) {
+    xdp_init();
+    send_cb = xdp_send_cb;
+    jtr_mark_names("reclaim,publish");
+  }
+
   for (i = 0; i < 20; i++) {
     jtr_calibrate();
   }
 
+  num_noise_profiles = jtr_noise_split(opt_Noise_profiles, noise_profiles,
+                                       JTR_NOISE_MAX_PROFILES);
+
+  jtr_preflight_print(opt_cpu_num);
+
   /* Conduct the timing tests! */
 
-  for (i = 0; i < opt_loops; i++) {
+  /* Each set of opt_loops test runs is done under one noise profile. */
+  for (i = 0; i < opt_loops * num_noise_profiles; i++) {
+    noise_profile = noise_profiles[i / opt_loops];
+    jtr_noise_start(noise_profile, opt_cpu_num);
     jtr_no_send_spin = 0;
     jtr_histo_init(opt_histo_buckets);
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
     jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
-                      opt_timebase, sock_send_cb, NULL);
+                      opt_timebase, send_cb, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end_ts);
+    run_ns = ((long long)end_ts.tv_sec - (long long)start_ts.tv_sec)
+             * NANOS_PER_SEC
+             + ((long long)end_ts.tv_nsec - (long long)start_ts.tv_nsec);
 
     snprintf(title, sizeof(title),
-            "%s: Msg_size=%d,"
+            "%s: Msg_size=%d, pattern=%s, converge=%s, noise=%s,"
             " cpu_num=%d, fifo_priority=%d, histo_buckets=%d, num_samples=%d,\n"
             " pause=%d timebase=%d, warmup_loops=%d, gettime_cost=%lld,\n"
             " rdtsc_cost=%lld, ticks_per_sec=%lld, jtr_1000_loops_cost=%lld",
-            opt_descr, opt_Msg_size,
+            opt_descr, opt_Msg_size, opt_pattern, opt_converge, noise_profile,
             opt_cpu_num, opt_fifo_priority, opt_histo_buckets, opt_num_samples,
             opt_pause, opt_timebase, opt_warmup_loops, jtr_gettime_cost,
             jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
@@ -244,6 +590,22 @@ int main(int argc, char **argv)
              "%s\n", title);
     SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
     jtr_histo_print_all(opt_verbose, title);
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Sends=%d, Run_ns=%lld, Sustained_rate=%lld pkts/sec,"
+             " Xdp=%s, Xdp_wakeups=%lld, Xdp_full_spins=%lld\n",
+             opt_warmup_loops + opt_num_samples, run_ns,
+             ((long long)(opt_warmup_loops + opt_num_samples) * NANOS_PER_SEC)
+               / run_ns,
+             (opt_Xdp_ifname == NULL) ? "none" :
+               (opt_Zero_copy ? "zerocopy" : "copy"),
+             xdp_wakeups, xdp_full_spins);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+    xdp_wakeups = 0;
+    xdp_full_spins = 0;
+    snprintf(label, sizeof(label), "noise=%s, run=%d",
+             noise_profile, (i % opt_loops) + 1);
+    jtr_histo_brief(noise_summary_buf, sizeof(noise_summary_buf), label);
 
     jtr_no_send_spin = jtr_busy_loop_wait_count(jtr_histo_average);
     jtr_histo_init(opt_histo_buckets);
@@ -251,11 +613,11 @@ int main(int argc, char **argv)
                       opt_timebase, null_send_cb, NULL);
 
     snprintf(title, sizeof(title),
-            "%s (null loop): no_send_spin=%d,"
+            "%s (null loop): no_send_spin=%d, noise=%s,"
             " cpu_num=%d, fifo_priority=%d, histo_buckets=%d, num_samples=%d,\n"
             " pause=%d timebase=%d, warmup_loops=%d, gettime_cost=%lld,\n"
             " rdtsc_cost=%lld, ticks_per_sec=%lld, jtr_1000_loops_cost=%lld",
-            opt_descr, jtr_no_send_spin,
+            opt_descr, jtr_no_send_spin, noise_profile,
             opt_cpu_num, opt_fifo_priority, opt_histo_buckets, opt_num_samples,
             opt_pause, opt_timebase, opt_warmup_loops, jtr_gettime_cost,
             jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
@@ -265,6 +627,18 @@ int main(int argc, char **argv)
              "%s\n", title);
     SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
     jtr_histo_print_all(opt_verbose, title);
+    jtr_noise_stop();
+  }
+
+  if (num_noise_profiles > 1 || strcmp(noise_profiles[0], "none") != 0) {
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Noise profile summary (ns):\n%s", noise_summary_buf);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  }
+
+  if (opt_live) {
+    jtr_live_stop();
   }
 
   if (opt_verbose >= 0) {
@@ -280,6 +654,9 @@ int main(int argc, char **argv)
   }
 
   close(mcast_sock);
+  if (xdp_sock != -1) {
+    close(xdp_sock);
+  }
 
   return 0;
 }  /* main */
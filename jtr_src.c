@@ -49,9 +49,19 @@ int opt_pause = JTR_10G_XMIT_1024_PKT_NS;
 int opt_timebase = 1;  /* 1=RDTSC, 2=clock_gettime() */
 int opt_warmup_loops = 1500;
 int opt_verbose = 0;
+int opt_live = 0;  /* 1=publish live statistics for jtr_top. */
+int opt_mem_mode = 0;  /* See jtr_mem_init(). */
+int opt_pmu = 0;  /* 1=read PMU counters around each sample. */
+char *opt_pattern = "fixed";  /* See jtr_pattern_init(). */
+char *opt_converge = "none";  /* See jtr_converge_init(). */
+char *opt_results_store = "none";  /* See jtr_store_append(). */
+char *opt_size_dist = NULL;  /* NULL=every message is -M bytes. */
+char *opt_trace_file = NULL;  /* pcap file to replay. */
+int opt_ab_order = 0;  /* 0=separate runs, 1=alternate, 2=random. */
 
 /* Options specific to the UM test. */
 int opt_Msg_size = 1024;
+char *opt_Ctx_placement = "l3,socket";  /* See jtr_cpu_related(). */
 
 /* UM objects. */
 lbm_context_t *jtr_ctx;     /* Handle for context object. */
@@ -62,22 +72,43 @@ char *message_buf;
 pthread_t jtr_ctx_thread_id;
 int jtr_ctx_running = 0;
 int jtr_no_send_spin = 0;
+int ctx_cpu_num = -1;  /* -1=not pinned. */
+char *placements[JTR_NOISE_MAX_PROFILES];
+int num_placements;
+char placement_summary_buf[16384];  /* Per-run one-liners, printed at end. */
 
 
 void usage()
 {
   fprintf(stderr,
-"Usage: jtr_sock [-M msg_size]"
-" [-c cpu_num] [-d descr] [-f fifo_priority] [-g gnuplot_file]"
-" [-h histo_buckets] [-l loops] [-n num_samples] [-p pause] [-t timebase]"
-" [-w warmup_loops] [-v verbose]\n");
+"Usage: jtr_src [-M msg_size] [-P ctx_placement] [-a ab_order]"
+" [-b pattern] [-c cpu_num] [-d descr] [-e pmu] [-f fifo_priority]"
+" [-g gnuplot_file] [-h histo_buckets] [-l loops] [-m mem_mode]"
+" [-n num_samples] [-o results_store] [-p pause] [-r trace_file] [-s live]"
+" [-t timebase] [-u converge] [-w warmup_loops] [-z size_dist] [-v verbose]\n");
   fprintf(stderr,
 "Where:\n");
   fprintf(stderr,
 " -M msg_size : number of bytes in message to send. (default=1024)\n"
+" -P ctx_placement : CPU for the UM context thread, by its relation to\n"
+"                    cpu_num: same, smt, l2, l3, socket, remote, or a CPU\n"
+"                    number. A comma-separated list is tried in order.\n"
+"                    Slash-separated placements are each tested in turn;\n"
+"                    'sweep' is smt/l2/l3/socket/remote.\n"
+"                    (default=l3,socket)\n"
+" -a ab_order : 0=time all UM calls, then all null loops. 1=alternate UM\n"
+"              and null calls sample by sample, swapping which goes first,\n"
+"              2=same but in random order; also prints the paired\n"
+"              difference. (default=0)\n"
+" -b pattern : traffic pattern, replacing the fixed pause (-p) between calls:\n"
+"              burst:N:gap_ns[:pause_ns], onoff:on_ns:off_ns:pause_ns, or\n"
+"              poisson:calls_per_sec. Also reports latency by position in\n"
+"              the burst. (default=fixed)\n"
 " -c cpu_num : integer CPU number to pin thread. Use -1 to not pin.\n"
 "              (default=5)\n"
 " -d descr : description string. (default='Jitter lbm test')\n"
+" -e pmu : 1=read LLC miss, dTLB miss, branch miss, and instruction\n"
+"          counters with RDPMC around each sample. (default=0)\n"
 " -f fifo_priority : integer priority level to set real-time FIFO scheduling.\n"
 "                  : -1 does not set real-time. (default=-1)\n"
 " -g gnuplot_file : name of file to create containing gnuplot commands to\n"
@@ -86,13 +117,32 @@ void usage()
 " -l loops : number of test runs to perform. Each test run does two tests,\n"
 "            first with the UM call, and then with an equivelent null loop.\n"
 "            (default=3)\n"
-" -n num_samples : number of samples in a test. (default=1,000,000)\n"
+" -m mem_mode : 1=mlockall and prefault the stack and buffers,\n"
+"               2=also put buffers in 2MB huge pages, 3=1GB huge pages.\n"
+"               (default=0)\n"
+" -n num_samples : number of samples in a test. (default=2,000,000)\n"
+" -o results_store : directory of an append-only results store; each\n"
+"                    histogram is added to it with a fingerprint of the\n"
+"                    host. See jtr_query. (default=none)\n"
 " -p pause : number of nanoseconds to pause between each sample, to allow\n"
 "            packet to exit NIC. (default=898)\n"
+" -r trace_file : pcap file whose UDP payload sizes and arrival gaps are\n"
+"                replayed (repeating), replacing -M, -b, -p and -z.\n"
+"                (default=none)\n"
+" -s live : 1=publish live statistics in shared memory for jtr_top.\n"
+"           (default=0)\n"
 " -t timebase : integer indicating which method of time measement to use.\n"
-"               1=RDTSC, 2=clock_gettime(). (default=1)\n"
+"               1=RDTSC, 2=clock_gettime(), 3=core cycles (RDPMC).\n"
+"               (default=1)\n"
+" -u converge : keep sampling in batches of num_samples until the 95%%\n"
+"              confidence interval of a percentile is within a tolerance,\n"
+"              or a time limit: percentile:tolerance_pct:max_sec, e.g.\n"
+"              '99.99:5:60'. (default=none)\n"
 " -w warmup_loops : number of samples to initially take without accumulating\n"
-"                   the results. (default=500)\n"
+"                   the results. -1=detect steady state. (default=1500)\n"
+" -z size_dist : message sizes and weights, e.g. '40:70,1024:25,8192:5',\n"
+"               replacing -M. Also reports latency by size class.\n"
+"               (default=none)\n"
 " -v verbose : integer indicating how much information to print.\n"
 "              -1=quiet, 0=normal, 2=details. (default=0)\n");
   exit(1);
@@ -105,19 +155,29 @@ void get_options(int argc, char **argv)
 {
   int opt;
 
-  while ((opt = getopt(argc, argv, "M:c:d:f:g:h:l:n:p:t:w:v:")) != EOF) {
+  while ((opt = getopt(argc, argv, "M:P:a:b:c:d:e:f:g:h:l:m:n:o:p:r:s:t:u:w:z:v:")) != EOF) {
     switch (opt) {
       case 'M': opt_Msg_size = atoi(optarg); break;
+      case 'P': opt_Ctx_placement = strdup(optarg); break;
+      case 'a': opt_ab_order = atoi(optarg); break;
+      case 'b': opt_pattern = strdup(optarg); break;
       case 'c': opt_cpu_num = atoi(optarg); break;
       case 'd': opt_descr = strdup(optarg); break;
+      case 'e': opt_pmu = atoi(optarg); break;
       case 'f': opt_fifo_priority = atoi(optarg); break;
       case 'g': opt_gnuplot_file = strdup(optarg); break;
       case 'h': opt_histo_buckets = atoi(optarg); break;
       case 'l': opt_loops = atoi(optarg); break;
+      case 'm': opt_mem_mode = atoi(optarg); break;
       case 'n': opt_num_samples = atoi(optarg); break;
+      case 'o': opt_results_store = strdup(optarg); break;
       case 'p': opt_pause = atoi(optarg); break;
+      case 'r': opt_trace_file = strdup(optarg); break;
+      case 's': opt_live = atoi(optarg); break;
       case 't': opt_timebase = atoi(optarg); break;
+      case 'u': opt_converge = strdup(optarg); break;
       case 'w': opt_warmup_loops = atoi(optarg); break;
+      case 'z': opt_size_dist = strdup(optarg); break;
       case 'v': opt_verbose = atoi(optarg); break;
       default: usage();
     }  /* switch opt */
@@ -128,8 +188,8 @@ void get_options(int argc, char **argv)
 /* Run context thread on a different core. */
 void *my_ctx_thread(void *arg)
 {
-  if (opt_cpu_num >= 0) {
-    jtr_pin_cpu(opt_cpu_num+2);  /* +2 keeps it on the same CPU chip. */
+  if (ctx_cpu_num >= 0) {
+    jtr_pin_cpu(ctx_cpu_num);
   }
 
   while (jtr_ctx_running) {
@@ -142,7 +202,9 @@ void *my_ctx_thread(void *arg)
 
 void lbm_send_cb(void *clientd)
 {
-  LBME(lbm_src_send(jtr_src, message_buf, opt_Msg_size, LBM_MSG_FLUSH));
+  int msg_size = (jtr_msg_size > 0) ? jtr_msg_size : opt_Msg_size;
+
+  LBME(lbm_src_send(jtr_src, message_buf, msg_size, LBM_MSG_FLUSH));
 }  /* lbm_send_cb */
 
 
@@ -161,12 +223,24 @@ int main(int argc, char **argv)
   lbm_topic_t *topic_obj; /* Handle for topic object. */
   int i;
   char title[1024];
+  char label[1024];
+  char *placement;
 
   /* Parse command-line options. */
   get_options(argc, argv);
 
   jtr_y_high = opt_num_samples;
 
+  jtr_mem_init(opt_mem_mode);  /* Before any buffers are allocated. */
+  jtr_pattern_init(opt_pattern, opt_size_dist, opt_trace_file, opt_pause);
+  if (opt_ab_order == 0) {  /* A/B samples are a fixed pairing. */
+    jtr_converge_init(opt_converge);
+  }
+  jtr_store_init(opt_results_store, opt_cpu_num);
+  if (jtr_pattern_max_size > opt_Msg_size) {
+    opt_Msg_size = jtr_pattern_max_size;  /* Buffer must fit the largest. */
+  }
+
   /* Empty out the results buffer (and page it in). */
   for (i = 0; i < sizeof(jtr_results_buf); i++) {
     jtr_results_buf[i] = 0;
@@ -183,12 +257,31 @@ int main(int argc, char **argv)
     jtr_set_fifo_priority(opt_fifo_priority);
   }
 
+  if (opt_pmu) {
+    jtr_pmu_init();  /* Counts the calling (measuring) thread only. */
+  }
+
+  if (opt_timebase == 3 && ! jtr_cycles_init()) {
+    opt_timebase = 1;  /* No usable cycle counter. */
+  }
+
+  if (opt_live) {
+    jtr_live_start("jtr_src", opt_descr, opt_cpu_num);
+  }
+
   LBME(lbm_config(JTR_CFG_FILE));
 
   LBME(lbm_context_attr_create(&ctx_attr));
   LBME(lbm_context_attr_str_setopt(ctx_attr, "operational_mode", "sequential"));
   LBME(lbm_context_create(&jtr_ctx, ctx_attr, NULL, NULL));
   LBME(lbm_context_attr_delete(ctx_attr));
+  num_placements = jtr_noise_split((strcmp(opt_Ctx_placement, "sweep") == 0)
+                                   ? "smt/l2/l3/socket/remote"
+                                   : opt_Ctx_placement,
+                                   placements, JTR_NOISE_MAX_PROFILES);
+  if (opt_cpu_num >= 0) {
+    ctx_cpu_num = jtr_cpu_related(opt_cpu_num, placements[0]);
+  }
   jtr_ctx_running = 1;
   SYSE(pthread_create(&jtr_ctx_thread_id, NULL, my_ctx_thread, NULL));
 
@@ -201,7 +294,7 @@ int main(int argc, char **argv)
   jtr_spin_sleep_ns(NANOS_PER_SEC/10, 2);  /* Use clock_gettime() timebase. */
 
   /* Init message buffer into cache. */
-  message_buf = malloc(opt_Msg_size);
+  message_buf = jtr_mem_alloc(opt_Msg_size);
   for (i = 0; i < opt_Msg_size; i++) {
     message_buf[i] = (char)i;
   }
@@ -210,21 +303,53 @@ int main(int argc, char **argv)
     jtr_calibrate();
   }
 
+  jtr_preflight_print(opt_cpu_num);
+
   /* Conduct the timing tests! */
 
-  for (i = 0; i < opt_loops; i++) {
+  /* Each set of opt_loops test runs is done with the context thread in one
+   * placement. */
+  for (i = 0; i < opt_loops * num_placements; i++) {
+    placement = placements[i / opt_loops];
+    if (i % opt_loops == 0 && opt_cpu_num >= 0) {
+      ctx_cpu_num = jtr_cpu_related(opt_cpu_num, placement);
+      if (ctx_cpu_num >= 0) {
+        jtr_pin_thread(jtr_ctx_thread_id, ctx_cpu_num);
+      } else if (num_placements > 1) {
+        snprintf(&placement_summary_buf[strlen(placement_summary_buf)],
+                 sizeof(placement_summary_buf)
+                 - strlen(placement_summary_buf),
+                 "ctx=%s: no such CPU, skipped\n", placement);
+        i += opt_loops - 1;
+        continue;
+      }
+    }
     jtr_no_send_spin = 0;
     jtr_histo_init(opt_histo_buckets);
-    jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
-                      opt_timebase, lbm_send_cb, NULL);
+    if (opt_ab_order == 0) {
+      jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
+                        opt_timebase, lbm_send_cb, NULL);
+    } else {
+      /* Short UM-only run to size the null loop, then one interleaved run
+       * for both. */
+      jtr_measure_calls(opt_warmup_loops, JTR_AB_PILOT_SAMPLES, opt_pause,
+                        opt_timebase, lbm_send_cb, NULL);
+      jtr_no_send_spin = jtr_busy_loop_wait_count(jtr_histo_average);
+      jtr_measure_ab(opt_warmup_loops, opt_num_samples, opt_pause,
+                     opt_timebase, opt_ab_order,
+                     lbm_send_cb, NULL, null_send_cb, NULL);
+      jtr_ab_histo(0, opt_histo_buckets);
+    }
 
     snprintf(title, sizeof(title),
-            "%s: Msg_size=%d,"
-            " cpu_num=%d, fifo_priority=%d, histo_buckets=%d, num_samples=%d,\n"
+            "%s: Msg_size=%d, pattern=%s, ab_order=%d, converge=%s,"
+            " cpu_num=%d, ctx=%s:%d, fifo_priority=%d, histo_buckets=%d,"
+            " num_samples=%d,\n"
             " pause=%d timebase=%d, warmup_loops=%d, gettime_cost=%lld,\n"
             " rdtsc_cost=%lld, ticks_per_sec=%lld, jtr_1000_loops_cost=%lld",
-            opt_descr, opt_Msg_size,
-            opt_cpu_num, opt_fifo_priority, opt_histo_buckets, opt_num_samples,
+            opt_descr, opt_Msg_size, opt_pattern, opt_ab_order, opt_converge,
+            opt_cpu_num, placement, ctx_cpu_num, opt_fifo_priority,
+            opt_histo_buckets, opt_num_samples,
             opt_pause, opt_timebase, opt_warmup_loops, jtr_gettime_cost,
             jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
     SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
@@ -234,18 +359,29 @@ int main(int argc, char **argv)
     SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
     jtr_histo_print_all(opt_verbose, title);
 
-    jtr_no_send_spin = jtr_busy_loop_wait_count(jtr_histo_average);
-    jtr_histo_init(opt_histo_buckets);
-    jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
-                      opt_timebase, null_send_cb, NULL);
+    snprintf(label, sizeof(label), "ctx=%s:%d, run=%d",
+             placement, ctx_cpu_num, (i % opt_loops) + 1);
+    jtr_histo_brief(placement_summary_buf, sizeof(placement_summary_buf),
+                    label);
+
+    if (opt_ab_order == 0) {
+      jtr_no_send_spin = jtr_busy_loop_wait_count(jtr_histo_average);
+      jtr_histo_init(opt_histo_buckets);
+      jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
+                        opt_timebase, null_send_cb, NULL);
+    } else {
+      jtr_ab_histo(1, opt_histo_buckets);
+    }
 
     snprintf(title, sizeof(title),
             "%s (null loop): no_send_spin=%d,"
-            " cpu_num=%d, fifo_priority=%d, histo_buckets=%d, num_samples=%d,\n"
+            " cpu_num=%d, ctx=%s:%d, fifo_priority=%d, histo_buckets=%d,"
+            " num_samples=%d,\n"
             " pause=%d timebase=%d, warmup_loops=%d, gettime_cost=%lld,\n"
             " rdtsc_cost=%lld, ticks_per_sec=%lld, jtr_1000_loops_cost=%lld",
             opt_descr, jtr_no_send_spin,
-            opt_cpu_num, opt_fifo_priority, opt_histo_buckets, opt_num_samples,
+            opt_cpu_num, placement, ctx_cpu_num, opt_fifo_priority,
+            opt_histo_buckets, opt_num_samples,
             opt_pause, opt_timebase, opt_warmup_loops, jtr_gettime_cost,
             jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
     SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
@@ -254,6 +390,21 @@ int main(int argc, char **argv)
              "%s\n", title);
     SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
     jtr_histo_print_all(opt_verbose, title);
+    if (opt_ab_order > 0) {
+      jtr_ab_print_diff();
+    }
+  }
+
+  if (num_placements > 1) {
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Context thread placement summary (ns):\n%s",
+             placement_summary_buf);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  }
+
+  if (opt_live) {
+    jtr_live_stop();
   }
 
   if (opt_verbose >= 0) {
@@ -0,0 +1,317 @@
+/* jtr_syscall.c - jitter of entering the kernel.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+
+/* Part of every socket send is the cost of getting into and out of the
+ * kernel, which depends on the kernel version and on the CPU vulnerability
+ * mitigations in effect (KPTI, retpoline, IBRS, ...). This times a few
+ * syscalls that do almost no work once inside:
+ *   getppid      - the minimal syscall.
+ *   gettime_vdso - clock_gettime() through the vDSO (no kernel entry).
+ *   gettime_sys  - clock_gettime() forced through syscall().
+ *   write_null   - a 1-byte write() to /dev/null.
+ *   futex_wake   - FUTEX_WAKE on a futex with no waiters.
+ * The mitigation state is printed with the results, and is part of the
+ * host fingerprint in the results store, so runs before and after a kernel
+ * or boot-option change can be compared with jtr_query.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/utsname.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+int opt_cpu_num = 5;
+char *opt_descr = "Jitter syscall test";
+int opt_fifo_priority = -1;
+char *opt_gnuplot_file = NULL;
+int opt_histo_buckets = 2000;
+int opt_mem_mode = 0;  /* See jtr_mem_init(). */
+int opt_num_samples = 200000;
+char *opt_results_store = "none";  /* See jtr_store_append(). */
+int opt_pause = 1000;
+int opt_timebase = 1;  /* 1=RDTSC, 2=clock_gettime() */
+int opt_warmup_loops = 1500;
+int opt_verbose = 0;
+
+/* Options specific to the syscall test. */
+char *opt_Syscalls = "getppid,gettime_vdso,gettime_sys,write_null,futex_wake";
+
+/* Other globals. */
+int null_fd = -1;
+int futex_word = 0;
+char write_byte = 'x';
+char syscall_summary_buf[4096];  /* Per-call one-liners, printed at end. */
+
+
+void getppid_cb(void *clientd)
+{
+  syscall(SYS_getppid);  /* Not cached by the C library. */
+}  /* getppid_cb */
+
+
+void gettime_vdso_cb(void *clientd)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+}  /* gettime_vdso_cb */
+
+
+void gettime_sys_cb(void *clientd)
+{
+  struct timespec ts;
+
+  syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &ts);
+}  /* gettime_sys_cb */
+
+
+void write_null_cb(void *clientd)
+{
+  SYSE(write(null_fd, &write_byte, 1) != 1);
+}  /* write_null_cb */
+
+
+void futex_wake_cb(void *clientd)
+{
+  syscall(SYS_futex, &futex_word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}  /* futex_wake_cb */
+
+
+typedef struct syscall_test_s {
+  char *name;
+  void (*cb)(void *clientd);
+} syscall_test_t;
+
+syscall_test_t syscall_tests[] = {
+  { "getppid", getppid_cb },
+  { "gettime_vdso", gettime_vdso_cb },
+  { "gettime_sys", gettime_sys_cb },
+  { "write_null", write_null_cb },
+  { "futex_wake", futex_wake_cb },
+  { NULL, NULL } };
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_syscall [-S syscalls] [-c cpu_num] [-d descr] [-f fifo_priority]"
+" [-g gnuplot_file] [-h histo_buckets] [-m mem_mode] [-n num_samples]"
+" [-o results_store] [-p pause] [-t timebase] [-w warmup_loops]"
+" [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -S syscalls : comma-separated list of getppid, gettime_vdso, gettime_sys,\n"
+"               write_null, futex_wake.\n"
+"               (default=getppid,gettime_vdso,gettime_sys,write_null,"
+"futex_wake)\n"
+" -c cpu_num : integer CPU number to pin thread. Use -1 to not pin.\n"
+"              (default=5)\n"
+" -d descr : description string. (default='Jitter syscall test')\n"
+" -f fifo_priority : integer priority level to set real-time FIFO scheduling.\n"
+"                  : -1 does not set real-time. (default=-1)\n"
+" -g gnuplot_file : name of file to create containing gnuplot commands to\n"
+"                   graph the histogram data. (default=no file)\n"
+" -h histo_buckets : number of buckets for histogram. (default=2000)\n"
+" -m mem_mode : 1=mlockall and prefault the stack and buffers,\n"
+"               2=also put buffers in 2MB huge pages, 3=1GB huge pages.\n"
+"               (default=0)\n"
+" -n num_samples : number of samples for each syscall. (default=200,000)\n"
+" -o results_store : directory to append each histogram to, with a host\n"
+"                    fingerprint including the mitigations; see jtr_query.\n"
+"                    (default=none)\n"
+" -p pause : number of nanoseconds to pause between each sample.\n"
+"            (default=1000)\n"
+" -t timebase : integer indicating which method of time measement to use.\n"
+"               1=RDTSC, 2=clock_gettime(), 3=core cycles (RDPMC).\n"
+"               (default=1)\n"
+" -w warmup_loops : number of samples to initially take without accumulating\n"
+"                   the results. (default=1500)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet, 0=normal, 2=details. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "S:c:d:f:g:h:m:n:o:p:t:w:v:")) != EOF) {
+    switch (opt) {
+      case 'S': opt_Syscalls = strdup(optarg); break;
+      case 'c': opt_cpu_num = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'f': opt_fifo_priority = atoi(optarg); break;
+      case 'g': opt_gnuplot_file = strdup(optarg); break;
+      case 'h': opt_histo_buckets = atoi(optarg); break;
+      case 'm': opt_mem_mode = atoi(optarg); break;
+      case 'n': opt_num_samples = atoi(optarg); break;
+      case 'o': opt_results_store = strdup(optarg); break;
+      case 'p': opt_pause = atoi(optarg); break;
+      case 't': opt_timebase = atoi(optarg); break;
+      case 'w': opt_warmup_loops = atoi(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+}  /* get_options */
+
+
+int main(int argc, char **argv)
+{
+  char title[1024];
+  char mitigations[4096];
+  char *syscalls[16];
+  int num_syscalls = 0;
+  char *save = NULL;
+  char *name;
+  syscall_test_t *test;
+  struct utsname uts;
+  int i, s;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  jtr_y_high = opt_num_samples;
+
+  for (name = strtok_r(strdup(opt_Syscalls), ",", &save); name != NULL;
+       name = strtok_r(NULL, ",", &save)) {
+    SYSE(num_syscalls >= 16);
+    syscalls[num_syscalls++] = name;
+  }
+  for (s = 0; s < num_syscalls; s++) {
+    for (test = syscall_tests; test->name != NULL; test++) {
+      if (strcmp(test->name, syscalls[s]) == 0) {
+        break;
+      }
+    }
+    if (test->name == NULL) {
+      fprintf(stderr, "Unknown syscall '%s'\n", syscalls[s]);
+      usage();
+    }
+  }
+
+  jtr_mem_init(opt_mem_mode);  /* Before any buffers are allocated. */
+  jtr_store_init(opt_results_store, opt_cpu_num);
+
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = '\0';
+  }
+  for (i = 0; i < sizeof(jtr_gnuplot_buf); i++) {
+    jtr_gnuplot_buf[i] = '\0';
+  }
+
+  null_fd = open("/dev/null", O_WRONLY);
+  SYSE(null_fd < 0);
+
+  if (opt_cpu_num >= 0) {
+    jtr_pin_cpu(opt_cpu_num);
+  }
+
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+
+  if (opt_timebase == 3 && ! jtr_cycles_init()) {
+    opt_timebase = 1;  /* No usable cycle counter. */
+  }
+
+  /* Do 10 cycles of calibration. */
+  for (i = 0; i < 10; i++) {
+    jtr_calibrate();
+  }
+
+  SYSE(uname(&uts));
+  jtr_mitigations(mitigations, sizeof(mitigations));
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "kernel=%s, mitigations: %s\n", uts.release, mitigations);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+  jtr_preflight_print(opt_cpu_num);
+
+  /* Conduct the timing tests! */
+
+  for (s = 0; s < num_syscalls; s++) {
+    for (test = syscall_tests; strcmp(test->name, syscalls[s]) != 0; test++) {
+    }
+    jtr_histo_init(opt_histo_buckets);
+    jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
+                      opt_timebase, test->cb, NULL);
+
+    /* The call name is part of the test name, for jtr_query. */
+    snprintf(title, sizeof(title),
+            "%s (%s): kernel=%s, cpu_num=%d, fifo_priority=%d,"
+            " histo_buckets=%d, num_samples=%d,\n"
+            " pause=%d timebase=%d, warmup_loops=%d, mem_mode=%d,"
+            " gettime_cost=%lld,\n"
+            " rdtsc_cost=%lld, ticks_per_sec=%lld, jtr_1000_loops_cost=%lld",
+            opt_descr, test->name, uts.release, opt_cpu_num,
+            opt_fifo_priority, opt_histo_buckets, opt_num_samples,
+            opt_pause, opt_timebase, opt_warmup_loops, opt_mem_mode,
+            jtr_gettime_cost,
+            jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
+    SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "%s\n", title);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+    jtr_histo_print_all(opt_verbose, title);
+
+    jtr_histo_brief(syscall_summary_buf, sizeof(syscall_summary_buf),
+                    test->name);
+  }
+
+  close(null_fd);
+
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Syscall summary (ns):\n%s", syscall_summary_buf);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+  if (opt_verbose >= 0) {
+    printf("%s", jtr_results_buf);
+
+    if (opt_gnuplot_file != NULL) {
+      FILE *gnuplot_fp = fopen(opt_gnuplot_file, "w");
+      SYSE(gnuplot_fp == NULL);
+
+      fprintf(gnuplot_fp, "%s", jtr_gnuplot_buf);
+      fclose(gnuplot_fp);
+    }
+  }
+
+  return 0;
+}  /* main */
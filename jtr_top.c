@@ -0,0 +1,332 @@
+/* jtr_top.c - live view of running jtr tools.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+
+/* Attaches read-only to the "/jtr_live.<pid>" shared-memory segments that
+ * jtr tools publish with "-s 1" (see jtr_live_start()), and prints rolling
+ * percentiles, rates, overflows and neg_diffs for each one.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+int opt_interval_ms = 1000;
+int opt_num_refreshes = 0;  /* 0=forever. */
+int opt_verbose = 0;
+
+/* Other globals. */
+#define TOP_MAX_PROCS 64
+#define TOP_READ_RETRIES 1000
+
+typedef struct top_proc_s {
+  int pid;
+  jtr_live_t *live;  /* Read-only mapping. */
+  jtr_live_t *cur;   /* Consistent copies. */
+  jtr_live_t *prev;
+  int have_prev;
+  int seen;  /* Segment still present this refresh. */
+} top_proc_t;
+
+top_proc_t top_procs[TOP_MAX_PROCS];
+int top_num_procs = 0;
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_top [-i interval_ms] [-n num_refreshes] [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -i interval_ms : milliseconds between refreshes. (default=1000)\n"
+" -n num_refreshes : number of refreshes, then exit; 0=forever.\n"
+"                    (default=0)\n"
+" -v verbose : 1=print each refresh below the last instead of clearing\n"
+"              the screen. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:n:v:")) != EOF) {
+    switch (opt) {
+      case 'i': opt_interval_ms = atoi(optarg); break;
+      case 'n': opt_num_refreshes = atoi(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+}  /* get_options */
+
+
+/* Seqlock read of a segment into "copy". Returns 0 if the writer was busy
+ * for every retry.
+ */
+int top_read(jtr_live_t *live, jtr_live_t *copy)
+{
+  uint32_t seq1, seq2;
+  int num_buckets;
+  int retry;
+
+  for (retry = 0; retry < TOP_READ_RETRIES; retry++) {
+    seq1 = __atomic_load_n(&live->seq, __ATOMIC_ACQUIRE);
+    if ((seq1 & 1) != 0) {
+      continue;  /* Writer in progress. */
+    }
+    num_buckets = live->histo_num_buckets;
+    if (num_buckets < 0 || num_buckets > JTR_LIVE_MAX_BUCKETS) {
+      continue;
+    }
+    memcpy(copy, live, offsetof(jtr_live_t, buckets)
+                       + num_buckets * sizeof(int));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    seq2 = __atomic_load_n(&live->seq, __ATOMIC_RELAXED);
+    if (seq1 == seq2) {
+      copy->histo_num_buckets = num_buckets;
+      return 1;
+    }
+  }
+  return 0;
+}  /* top_read */
+
+
+/* Percentile (ns) of a histogram, -1 if in the overflows.
+ */
+int top_perc_ns(int *buckets, int num_buckets, int num_samples,
+                double percentile)
+{
+  int i = 0;
+  int tot_at_i_or_below = 0;
+  int min_count;
+
+  min_count = (int)((percentile / 100.0) * (double)num_samples + 0.5);
+  while (i < num_buckets && tot_at_i_or_below < min_count) {
+    tot_at_i_or_below += buckets[i];
+    i++;
+  }
+  if (tot_at_i_or_below >= min_count) {
+    return i * HISTO_GRANULARITY;
+  }
+  return -1;
+}  /* top_perc_ns */
+
+
+/* Attach to any new segments and mark the ones that are present.
+ */
+void top_scan(void)
+{
+  DIR *dir;
+  struct dirent *ent;
+  struct stat st;
+  char name[300];
+  top_proc_t *tp;
+  top_proc_t gone;
+  int pid;
+  int fd;
+  int i;
+
+  for (i = 0; i < top_num_procs; i++) {
+    top_procs[i].seen = 0;
+  }
+
+  dir = opendir("/dev/shm");
+  SYSE(dir == NULL);
+  while ((ent = readdir(dir)) != NULL) {
+    if (strncmp(ent->d_name, JTR_LIVE_PREFIX + 1,
+                strlen(JTR_LIVE_PREFIX) - 1) != 0
+        || ent->d_name[strlen(JTR_LIVE_PREFIX) - 1] != '.') {
+      continue;
+    }
+    pid = atoi(&ent->d_name[strlen(JTR_LIVE_PREFIX)]);
+    if (kill(pid, 0) == -1 && errno == ESRCH) {
+      continue;  /* Left behind by a process that crashed. */
+    }
+    for (i = 0; i < top_num_procs; i++) {
+      if (top_procs[i].pid == pid) {
+        top_procs[i].seen = 1;
+        break;
+      }
+    }
+    if (i < top_num_procs || top_num_procs >= TOP_MAX_PROCS) {
+      continue;
+    }
+
+    snprintf(name, sizeof(name), "/%s", ent->d_name);
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+      continue;  /* Just exited. */
+    }
+    if (fstat(fd, &st) == -1 || st.st_size != sizeof(jtr_live_t)) {
+      close(fd);
+      continue;  /* Different version, or still being created. */
+    }
+    tp = &top_procs[top_num_procs];
+    tp->live = (jtr_live_t *)mmap(NULL, sizeof(jtr_live_t), PROT_READ,
+                                  MAP_SHARED, fd, 0);
+    close(fd);
+    if (tp->live == MAP_FAILED) {
+      continue;
+    }
+    if (tp->live->magic != JTR_LIVE_MAGIC) {
+      munmap(tp->live, sizeof(jtr_live_t));  /* Retried on the next scan. */
+      continue;
+    }
+    tp->pid = pid;
+    if (tp->cur == NULL) {
+      tp->cur = (jtr_live_t *)malloc(sizeof(jtr_live_t));
+      tp->prev = (jtr_live_t *)malloc(sizeof(jtr_live_t));
+      SYSE(tp->cur == NULL || tp->prev == NULL);
+    }
+    tp->have_prev = 0;
+    tp->seen = 1;
+    top_num_procs ++;
+  }
+  closedir(dir);
+
+  /* Drop the ones that went away. */
+  for (i = 0; i < top_num_procs; ) {
+    if (top_procs[i].seen) {
+      i++;
+      continue;
+    }
+    munmap(top_procs[i].live, sizeof(jtr_live_t));
+    top_num_procs --;
+    gone = top_procs[i];  /* Swap with last, keeping its copy buffers. */
+    top_procs[i] = top_procs[top_num_procs];
+    top_procs[top_num_procs] = gone;
+  }
+}  /* top_scan */
+
+
+/* Print one line per process. "last" columns cover the samples since the
+ * previous refresh; "run" columns cover the current test run.
+ */
+void top_print(void)
+{
+  static int delta_buckets[JTR_LIVE_MAX_BUCKETS];
+  jtr_live_t *cur, *prev, *swap;
+  top_proc_t *tp;
+  double rate;
+  int delta_samples;
+  int i, p;
+
+  printf("%7s %-10s %4s %10s %9s | %6s %6s %6s | %6s %6s %8s %5s %5s  %s\n",
+         "PID", "TOOL", "RUN", "SAMPLES", "RATE/s",
+         "P50", "P99", "P99.9", "AVG", "P99.99", "MAX", "OVFL", "NEG",
+         "DESCR");
+
+  for (p = 0; p < top_num_procs; p++) {
+    tp = &top_procs[p];
+    if (! top_read(tp->live, tp->cur)) {
+      continue;
+    }
+    cur = tp->cur;
+    prev = tp->prev;
+
+    rate = 0.0;
+    delta_samples = 0;
+    if (tp->have_prev && prev->run == cur->run
+        && cur->num_samples >= prev->num_samples
+        && prev->histo_num_buckets == cur->histo_num_buckets) {
+      delta_samples = cur->num_samples - prev->num_samples;
+      for (i = 0; i < cur->histo_num_buckets; i++) {
+        delta_buckets[i] = cur->buckets[i] - prev->buckets[i];
+      }
+      if (cur->publish_ns > prev->publish_ns) {
+        rate = (double)delta_samples * (double)NANOS_PER_SEC
+               / (double)(cur->publish_ns - prev->publish_ns);
+      }
+    }
+
+    printf("%7d %-10.10s %4d %10d %9.0lf |",
+           cur->pid, cur->tool, cur->run, cur->num_samples, rate);
+    if (delta_samples > 0) {
+      printf(" %6d %6d %6d |",
+             top_perc_ns(delta_buckets, cur->histo_num_buckets,
+                         delta_samples, 50.0),
+             top_perc_ns(delta_buckets, cur->histo_num_buckets,
+                         delta_samples, 99.0),
+             top_perc_ns(delta_buckets, cur->histo_num_buckets,
+                         delta_samples, 99.9));
+    } else {
+      printf(" %6s %6s %6s |", "-", "-", "-");
+    }
+    printf(" %6lld %6d %8d %5d %5d  %s\n",
+           (cur->num_samples > 0) ?
+             cur->tot_time / (long long)cur->num_samples : 0ll,
+           top_perc_ns(cur->buckets, cur->histo_num_buckets,
+                       cur->num_samples, 99.99),
+           cur->max_time, cur->overflows, cur->neg_diffs, cur->descr);
+
+    swap = tp->prev;
+    tp->prev = tp->cur;
+    tp->cur = swap;
+    tp->have_prev = 1;
+  }
+  if (top_num_procs == 0) {
+    printf("(no jtr processes publishing; run a jtr tool with '-s 1')\n");
+  }
+  fflush(stdout);
+}  /* top_print */
+
+
+int main(int argc, char **argv)
+{
+  struct timespec sleep_ts;
+  int refresh;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  sleep_ts.tv_sec = opt_interval_ms / 1000;
+  sleep_ts.tv_nsec = (opt_interval_ms % 1000) * 1000000;
+
+  for (refresh = 0; opt_num_refreshes == 0 || refresh < opt_num_refreshes;
+       refresh++) {
+    if (refresh > 0) {
+      nanosleep(&sleep_ts, NULL);
+    }
+    top_scan();
+    if (opt_verbose == 0 && isatty(1)) {
+      printf("\033[H\033[2J");  /* Home and clear. */
+    }
+    top_print();
+  }
+
+  return 0;
+}  /* main */
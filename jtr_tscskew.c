@@ -0,0 +1,439 @@
+/* jtr_tscskew.c - measure TSC offset and drift between CPUs.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+
+/* One-way times between threads on different CPUs subtract a TSC read on
+ * one CPU from a TSC read on another, so they are only as good as the
+ * synchronization of the two TSCs. This estimates the offset between
+ * CPUs with a ping-pong handshake that bounds the error, watches it drift
+ * over time, and writes a correction table that jtr_tscskew_load() reads.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+char *opt_descr = "TSC skew test";
+int opt_fifo_priority = -1;
+int opt_verbose = 0;
+
+/* Options specific to the skew test. */
+char *opt_Cpu_list = "5,7";
+int opt_Duration_sec = 10;
+int opt_Interval_ms = 1000;
+char *opt_Output_file = "jtr_tscskew.tbl";
+int opt_Rounds = 10000;
+
+/* Other globals. */
+#define SKEW_MAX_CPUS 256
+
+/* Serialized TSC read, so the read can't drift into the handshake. */
+#define RDTSC_FENCED(hi, lo) do { \
+  asm volatile ("lfence; rdtsc; lfence" : "=a" (lo), "=d" (hi) : : "memory"); \
+} while (0)
+
+typedef struct skew_line_s {  /* One cache line per direction. */
+  volatile uint64_t seq;
+  volatile uint64_t ticks;
+  char pad[48];
+} __attribute__((aligned(64))) skew_line_t;
+
+typedef struct skew_est_s {
+  long long lower;  /* TSC(b) - TSC(a) is within [lower, upper]. */
+  long long upper;
+  long long min_rtt;
+  long long at_ticks;  /* TSC(a) at the end of the estimate. */
+} skew_est_t;
+
+int skew_cpus[SKEW_MAX_CPUS];
+int skew_num_cpus = 0;
+skew_line_t skew_ping;
+skew_line_t skew_pong;
+pthread_barrier_t skew_barrier;
+int skew_pair_cpus[2];
+skew_est_t skew_pair_est;
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_tscskew [-C cpu_list] [-D duration_sec] [-I interval_ms]"
+" [-O output_file]\n"
+" [-R rounds] [-d descr] [-f fifo_priority] [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -C cpu_list : CPUs to compare, e.g. '0,2,4-7'. The first is the\n"
+"              reference. (default=5,7)\n"
+" -D duration_sec : seconds to watch for drift; 0 skips it. (default=10)\n"
+" -I interval_ms : time between drift estimates. (default=1000)\n"
+" -O output_file : correction table to write; '-' for none.\n"
+"                 (default=jtr_tscskew.tbl)\n"
+" -R rounds : handshakes per estimate. (default=10000)\n"
+" -d descr : description string. (default='TSC skew test')\n"
+" -f fifo_priority : integer priority level to set real-time FIFO scheduling.\n"
+"                  : -1 does not set real-time. (default=-1)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet, 0=normal, 1=also each drift estimate. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "C:D:I:O:R:d:f:v:")) != EOF) {
+    switch (opt) {
+      case 'C': opt_Cpu_list = strdup(optarg); break;
+      case 'D': opt_Duration_sec = atoi(optarg); break;
+      case 'I': opt_Interval_ms = atoi(optarg); break;
+      case 'O': opt_Output_file = strdup(optarg); break;
+      case 'R': opt_Rounds = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'f': opt_fifo_priority = atoi(optarg); break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+
+  if (opt_Rounds <= 0 || opt_Interval_ms <= 0) {
+    usage();
+  }
+}  /* get_options */
+
+
+/* Side "a": sends a ping stamped t0, gets back the responder's stamp t1,
+ * and stamps the pong's arrival t2. Since t0 <= t1 - skew <= t2 on one
+ * clock, skew is within [t1 - t2, t1 - t0]; the bounds from all rounds
+ * are intersected.
+ */
+void *skew_initiator(void *arg)
+{
+  uint32_t ticks_hi, ticks_lo;
+  long long t0, t1, t2;
+  skew_est_t est;
+  uint64_t r;
+
+  jtr_pin_cpu(skew_pair_cpus[0]);
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+  est.lower = -0x7fffffffffffffff;
+  est.upper = 0x7fffffffffffffff;
+  est.min_rtt = 0x7fffffffffffffff;
+
+  pthread_barrier_wait(&skew_barrier);
+  for (r = 1; r <= (uint64_t)opt_Rounds; r++) {
+    RDTSC_FENCED(ticks_hi, ticks_lo);
+    t0 = ((long long)ticks_hi << 32) + (long long)ticks_lo;
+    __atomic_store_n(&skew_ping.seq, r, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&skew_pong.seq, __ATOMIC_ACQUIRE) != r) {
+    }
+    RDTSC_FENCED(ticks_hi, ticks_lo);
+    t2 = ((long long)ticks_hi << 32) + (long long)ticks_lo;
+    t1 = (long long)skew_pong.ticks;
+
+    if (t1 - t2 > est.lower) {
+      est.lower = t1 - t2;
+    }
+    if (t1 - t0 < est.upper) {
+      est.upper = t1 - t0;
+    }
+    if (t2 - t0 < est.min_rtt) {
+      est.min_rtt = t2 - t0;
+    }
+  }
+  est.at_ticks = t2;
+  skew_pair_est = est;
+  return NULL;
+}  /* skew_initiator */
+
+
+/* Side "b": stamps each ping on arrival and returns the stamp.
+ */
+void *skew_responder(void *arg)
+{
+  uint32_t ticks_hi, ticks_lo;
+  uint64_t r;
+
+  jtr_pin_cpu(skew_pair_cpus[1]);
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+
+  pthread_barrier_wait(&skew_barrier);
+  for (r = 1; r <= (uint64_t)opt_Rounds; r++) {
+    while (__atomic_load_n(&skew_ping.seq, __ATOMIC_ACQUIRE) != r) {
+    }
+    RDTSC_FENCED(ticks_hi, ticks_lo);
+    skew_pong.ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+    __atomic_store_n(&skew_pong.seq, r, __ATOMIC_RELEASE);
+  }
+  return NULL;
+}  /* skew_responder */
+
+
+/* Estimate TSC(cpu_b) - TSC(cpu_a).
+ */
+skew_est_t skew_measure_pair(int cpu_a, int cpu_b)
+{
+  pthread_t a_id, b_id;
+
+  skew_pair_cpus[0] = cpu_a;
+  skew_pair_cpus[1] = cpu_b;
+  skew_ping.seq = 0;
+  skew_pong.seq = 0;
+  SYSE(pthread_barrier_init(&skew_barrier, NULL, 2));
+  SYSE(pthread_create(&b_id, NULL, skew_responder, NULL));
+  SYSE(pthread_create(&a_id, NULL, skew_initiator, NULL));
+  SYSE(pthread_join(a_id, NULL));
+  SYSE(pthread_join(b_id, NULL));
+  SYSE(pthread_barrier_destroy(&skew_barrier));
+
+  return skew_pair_est;
+}  /* skew_measure_pair */
+
+
+int main(int argc, char **argv)
+{
+  skew_est_t *pair_est;  /* [i * skew_num_cpus + j], i < j. */
+  skew_est_t *drift_est;  /* [interval * skew_num_cpus + j] */
+  skew_est_t est, est_i, est_j;
+  long long offset_ticks[SKEW_MAX_CPUS];
+  long long error_ticks[SKEW_MAX_CPUS];
+  double drift_ppb[SKEW_MAX_CPUS];
+  long long at_ticks[SKEW_MAX_CPUS];
+  long long mid, closure, max_closure_ticks = 0;
+  long long max_error_ticks = 0;
+  long long min_mid, max_mid;
+  int num_inconsistent = 0;
+  int num_intervals = 0;
+  int max_intervals;
+  struct timespec start_ts, cur_ts;
+  long long elapsed_ns;
+  double sx, sy, sxx, sxy, x, y, n;
+  char title[1024];
+  FILE *fp;
+  int i, j, k;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+  skew_num_cpus = jtr_parse_cpu_list(opt_Cpu_list, skew_cpus, SKEW_MAX_CPUS);
+  if (skew_num_cpus < 2) {
+    fprintf(stderr, "Bad cpu_list '%s' (needs at least 2 CPUs)\n",
+            opt_Cpu_list);
+    usage();
+  }
+
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = '\0';
+  }
+
+  /* Do 10 cycles of calibration. */
+  for (i = 0; i < 10; i++) {
+    jtr_calibrate();
+  }
+
+  snprintf(title, sizeof(title),
+          "%s: cpu_list=%s, rounds=%d, duration_sec=%d, interval_ms=%d,"
+          " fifo_priority=%d,\n"
+          " rdtsc_cost=%lld, ticks_per_sec=%lld",
+          opt_descr, opt_Cpu_list, opt_Rounds, opt_Duration_sec,
+          opt_Interval_ms, opt_fifo_priority, jtr_rdtsc_cost,
+          jtr_ticks_per_sec);
+  SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "%s\n", title);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+  /* Every pair, directly. */
+  pair_est = (skew_est_t *)malloc(skew_num_cpus * skew_num_cpus
+                                  * sizeof(skew_est_t));
+  SYSE(pair_est == NULL);
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Pair skew, TSC(b)-TSC(a) in ns (+/- error bound):\n");
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  for (i = 0; i < skew_num_cpus; i++) {
+    for (j = i + 1; j < skew_num_cpus; j++) {
+      est = skew_measure_pair(skew_cpus[i], skew_cpus[j]);
+      pair_est[i * skew_num_cpus + j] = est;
+      if (est.lower > est.upper) {
+        num_inconsistent ++;
+      }
+      if ((est.upper - est.lower) / 2 > max_error_ticks) {
+        max_error_ticks = (est.upper - est.lower) / 2;
+      }
+      snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+               sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+               "  a=%d, b=%d: skew_ns=%lld +/- %lld, min_rtt_ns=%lld%s\n",
+               skew_cpus[i], skew_cpus[j],
+               jtr_ticks_to_ns((est.lower + est.upper) / 2),
+               jtr_ticks_to_ns((est.upper - est.lower) / 2),
+               jtr_ticks_to_ns(est.min_rtt),
+               (est.lower > est.upper) ? " INCONSISTENT" : "");
+      SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+    }
+  }
+
+  /* Skews measured directly should agree with the ones via the
+   * reference: skew(i,j) = skew(0,j) - skew(0,i).
+   */
+  for (i = 1; i < skew_num_cpus; i++) {
+    for (j = i + 1; j < skew_num_cpus; j++) {
+      est = pair_est[i * skew_num_cpus + j];
+      est_i = pair_est[i];
+      est_j = pair_est[j];
+      closure = (est.lower + est.upper) / 2
+        - ((est_j.lower + est_j.upper) / 2 - (est_i.lower + est_i.upper) / 2);
+      if (llabs(closure) > max_closure_ticks) {
+        max_closure_ticks = llabs(closure);
+      }
+    }
+  }
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Max_error_ns=%lld, Max_closure_ns=%lld, Inconsistent_pairs=%d\n",
+           jtr_ticks_to_ns(max_error_ticks), jtr_ticks_to_ns(max_closure_ticks),
+           num_inconsistent);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+  for (j = 0; j < skew_num_cpus; j++) {
+    est = (j == 0) ? pair_est[1] : pair_est[j];
+    offset_ticks[j] = (j == 0) ? 0 : (est.lower + est.upper) / 2;
+    error_ticks[j] = (j == 0) ? 0 : (est.upper - est.lower) / 2;
+    at_ticks[j] = est.at_ticks;
+    drift_ppb[j] = 0.0;
+  }
+
+  /* Drift: re-estimate each CPU against the reference every interval, and
+   * fit a line through the estimates.
+   */
+  if (opt_Duration_sec > 0) {
+    /* Each interval takes at least interval_ms. */
+    max_intervals = (int)(((long long)opt_Duration_sec * 1000)
+                          / opt_Interval_ms) + 1;
+    drift_est = (skew_est_t *)malloc((size_t)max_intervals * skew_num_cpus
+                                     * sizeof(skew_est_t));
+    SYSE(drift_est == NULL);
+    SYSE(clock_gettime(CLOCK_MONOTONIC, &start_ts));
+    do {
+      for (j = 1; j < skew_num_cpus; j++) {
+        drift_est[num_intervals * skew_num_cpus + j] =
+          skew_measure_pair(skew_cpus[0], skew_cpus[j]);
+      }
+      num_intervals ++;
+      usleep(opt_Interval_ms * 1000);
+      SYSE(clock_gettime(CLOCK_MONOTONIC, &cur_ts));
+      elapsed_ns = ((long long)cur_ts.tv_sec - (long long)start_ts.tv_sec)
+                   * NANOS_PER_SEC
+                   + ((long long)cur_ts.tv_nsec - (long long)start_ts.tv_nsec);
+    } while (elapsed_ns < (long long)opt_Duration_sec * NANOS_PER_SEC
+             && num_intervals < max_intervals);
+
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Drift against cpu %d over %d estimates:\n",
+             skew_cpus[0], num_intervals);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+    for (j = 1; j < skew_num_cpus; j++) {
+      sx = sy = sxx = sxy = 0.0;
+      n = (double)num_intervals;
+      min_mid = 0x7fffffffffffffff;
+      max_mid = -0x7fffffffffffffff;
+      for (k = 0; k < num_intervals; k++) {
+        est = drift_est[k * skew_num_cpus + j];
+        mid = (est.lower + est.upper) / 2;
+        x = (double)(est.at_ticks - drift_est[j].at_ticks);
+        y = (double)mid;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        min_mid = (mid < min_mid) ? mid : min_mid;
+        max_mid = (mid > max_mid) ? mid : max_mid;
+        if (opt_verbose > 0) {
+          snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+                   sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+                   "  cpu=%d, at_ms=%lld, skew_ns=%lld +/- %lld\n",
+                   skew_cpus[j], jtr_ticks_to_ns((long long)x) / 1000000,
+                   jtr_ticks_to_ns(mid),
+                   jtr_ticks_to_ns((est.upper - est.lower) / 2));
+          SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+        }
+      }
+      if (num_intervals > 1 && n * sxx - sx * sx > 0.0) {
+        drift_ppb[j] = 1e9 * (n * sxy - sx * sy) / (n * sxx - sx * sx);
+      }
+      /* Table entry: the line's value at the first estimate. */
+      est = drift_est[j];
+      offset_ticks[j] = (long long)((sy - (drift_ppb[j] / 1e9) * sx) / n);
+      error_ticks[j] = (est.upper - est.lower) / 2;
+      at_ticks[j] = est.at_ticks;
+
+      snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+               sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+               "  cpu=%d: drift_ppb=%.3lf, skew_range_ns=%lld..%lld\n",
+               skew_cpus[j], drift_ppb[j], jtr_ticks_to_ns(min_mid),
+               jtr_ticks_to_ns(max_mid));
+      SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+    }
+  }
+
+  if (strcmp(opt_Output_file, "-") != 0) {
+    fp = fopen(opt_Output_file, "w");
+    SYSE(fp == NULL);
+    fprintf(fp, "# %s\n", opt_descr);
+    fprintf(fp, "# TSC(cpu) = TSC(ref_cpu) + offset_ticks"
+                " + drift_ppb * (TSC(ref_cpu) - at_ticks) / 1e9\n");
+    fprintf(fp, "ticks_per_sec=%lld\n", jtr_ticks_per_sec);
+    fprintf(fp, "ref_cpu=%d\n", skew_cpus[0]);
+    for (j = 0; j < skew_num_cpus; j++) {
+      fprintf(fp, "cpu=%d offset_ticks=%lld error_ticks=%lld"
+                  " drift_ppb=%.3lf at_ticks=%lld\n",
+              skew_cpus[j], offset_ticks[j], error_ticks[j], drift_ppb[j],
+              at_ticks[j]);
+    }
+    fclose(fp);
+    snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+             sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+             "Wrote correction table %s\n", opt_Output_file);
+    SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+  }
+
+  if (opt_verbose >= 0) {
+    printf("%s", jtr_results_buf);
+  }
+
+  return 0;
+}  /* main */
@@ -0,0 +1,494 @@
+/* jtr_wake.c - latency of waking another thread, by wait strategy.
+ * see https://github.com/UltraMessaging/jtr
+ *
+ * Copyright (c) 2005-2019 Informatica Corporation. All Rights Reserved.
+ * Permission is granted to licensees to use or alter this software for
+ * any purpose, including commercial applications, according to the terms
+ * laid out in the Software License Agreement.
+ *
+ * This source code example is provided by Informatica for educational
+ * and evaluation purposes only.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND INFORMATICA DISCLAIMS ALL WARRANTIES
+ * EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION, ANY IMPLIED WARRANTIES OF
+ * NON-INFRINGEMENT, MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+ * INFORMATICA DOES NOT WARRANT THAT USE OF THE SOFTWARE WILL BE UNINTERRUPTED
+ * OR ERROR-FREE.  INFORMATICA SHALL NOT, UNDER ANY CIRCUMSTANCES, BE
+ * LIABLE TO LICENSEE FOR LOST PROFITS, CONSEQUENTIAL, INCIDENTAL, SPECIAL OR
+ * INDIRECT DAMAGES ARISING OUT OF OR RELATED TO THIS AGREEMENT OR THE
+ * TRANSACTIONS CONTEMPLATED HEREUNDER, EVEN IF INFORMATICA HAS BEEN APPRISED
+ * OF THE LIKELIHOOD OF SUCH DAMAGES.
+ */
+
+
+/* A thread handing work to another has to choose how the other thread
+ * waits: spinning costs a whole CPU but reacts at once, and sleeping in
+ * the kernel is free until it has to be woken. Each sample here signals a
+ * peer thread pinned to another CPU and measures, by TSC, the time from
+ * just before the signal until the peer is running again. Strategies:
+ *   spin      - the peer spins on a shared sequence number.
+ *   spinyield - the peer spins for Yield_spin_ns, then calls sched_yield()
+ *               between checks.
+ *   futex     - the peer sleeps in FUTEX_WAIT; the signal is FUTEX_WAKE.
+ *   condvar   - pthread_cond_wait() / pthread_cond_signal().
+ *   eventfd   - the peer sleeps in epoll_wait() on an eventfd; the signal
+ *               is a write() to it.
+ * The peer thread's CPU time over each run (warmup included) is reported
+ * next to the latency percentiles, as the percentage of one CPU it burned.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/syscall.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <linux/futex.h>
+
+#include "jtr.h"
+
+/* Options and their defaults. See get_options(). */
+int opt_cpu_num = 5;
+char *opt_descr = "Jitter wake test";
+int opt_fifo_priority = -1;
+char *opt_gnuplot_file = NULL;
+int opt_histo_buckets = 2000;
+int opt_loops = 1;
+int opt_num_samples = 100000;
+char *opt_results_store = "none";  /* See jtr_store_append(). */
+int opt_pause = 10000;
+int opt_timebase = 1;  /* 1=RDTSC, 2=clock_gettime() */
+int opt_warmup_loops = 1500;
+int opt_verbose = 0;
+char *opt_skew_table = NULL;  /* From jtr_tscskew. */
+
+/* Options specific to the wake test. */
+char *opt_Peer_placement = "l3,socket";  /* See jtr_cpu_related(). */
+char *opt_Strategies = "spin,spinyield,futex,condvar,eventfd";
+int opt_Yield_spin_ns = 20000;
+
+/* Wait strategies. See wake_names[]. */
+#define WAKE_SPIN 0
+#define WAKE_SPINYIELD 1
+#define WAKE_FUTEX 2
+#define WAKE_CONDVAR 3
+#define WAKE_EVENTFD 4
+#define WAKE_NUM 5
+char *wake_names[WAKE_NUM] = {
+  "spin", "spinyield", "futex", "condvar", "eventfd" };
+
+/* Shared with the peer. The measuring thread bumps wake_seq to signal;
+ * the peer stamps wake_ticks on waking and then sets ack_seq to match.
+ * wake_seq == -1 tells the peer to exit.
+ */
+volatile int wake_seq __attribute__ ((aligned (64)));
+volatile uint64_t wake_ticks __attribute__ ((aligned (64)));
+volatile int ack_seq;
+int wake_strategy;
+int peer_cpu_num = -1;
+pthread_t peer_thread_id;
+pthread_mutex_t wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t wake_cond = PTHREAD_COND_INITIALIZER;
+int wake_efd;
+int wake_epfd;
+
+/* Wake-up samples are kept until the run is over. */
+int *wake_ns;
+int wake_sample;
+char wake_summary_buf[8192];  /* Per-run one-liners, printed at end. */
+
+
+void usage()
+{
+  fprintf(stderr,
+"Usage: jtr_wake [-C peer_placement] [-S strategies] [-Y yield_spin_ns]"
+" [-c cpu_num] [-d descr] [-f fifo_priority] [-g gnuplot_file]"
+" [-h histo_buckets] [-k skew_table] [-l loops] [-n num_samples]"
+" [-o results_store] [-p pause] [-t timebase] [-w warmup_loops] [-v verbose]\n");
+  fprintf(stderr,
+"Where:\n");
+  fprintf(stderr,
+" -C peer_placement : CPU of the woken thread, by its relation to cpu_num\n"
+"                     (see jtr_ss -P), or a CPU number. (default=l3,socket)\n"
+" -S strategies : comma-separated list of spin, spinyield, futex, condvar,\n"
+"                 eventfd. (default=spin,spinyield,futex,condvar,eventfd)\n"
+" -Y yield_spin_ns : spinyield spins this long before it starts to yield.\n"
+"                    (default=20000)\n"
+" -c cpu_num : integer CPU number to pin thread. Use -1 to not pin.\n"
+"              (default=5)\n"
+" -d descr : description string. (default='Jitter wake test')\n"
+" -f fifo_priority : integer priority level to set real-time FIFO scheduling\n"
+"                   of both threads. -1 does not set real-time. (default=-1)\n"
+" -g gnuplot_file : name of file to create containing gnuplot commands to\n"
+"                   graph the histogram data. (default=no file)\n"
+" -h histo_buckets : number of buckets for histogram. (default=2000)\n"
+" -k skew_table : TSC correction table written by jtr_tscskew, applied to\n"
+"                 the wake-up times. (default=none)\n"
+" -l loops : number of test runs per strategy. (default=1)\n"
+" -n num_samples : number of samples in a test. (default=100,000)\n"
+" -o results_store : directory to append each histogram to, with a host\n"
+"                    fingerprint including the mitigations; see jtr_query.\n"
+"                    (default=none)\n"
+" -p pause : number of nanoseconds to pause between each sample, which\n"
+"            gives the peer time to go back to sleep. (default=10000)\n"
+" -t timebase : integer indicating which method of time measement to use.\n"
+"               1=RDTSC, 2=clock_gettime(), 3=core cycles (RDPMC).\n"
+"               (default=1)\n"
+"               Wake-up times always use RDTSC.\n"
+" -w warmup_loops : number of samples to initially take without accumulating\n"
+"                   the results. (default=1500)\n"
+" -v verbose : integer indicating how much information to print.\n"
+"              -1=quiet, 0=normal, 2=details. (default=0)\n");
+  exit(1);
+}  /* usage */
+
+
+/* Parse command-line options.
+ */
+void get_options(int argc, char **argv)
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "C:S:Y:c:d:f:g:h:k:l:n:o:p:t:w:v:")) != EOF) {
+    switch (opt) {
+      case 'C': opt_Peer_placement = strdup(optarg); break;
+      case 'S': opt_Strategies = strdup(optarg); break;
+      case 'Y': opt_Yield_spin_ns = atoi(optarg); break;
+      case 'c': opt_cpu_num = atoi(optarg); break;
+      case 'd': opt_descr = strdup(optarg); break;
+      case 'f': opt_fifo_priority = atoi(optarg); break;
+      case 'g': opt_gnuplot_file = strdup(optarg); break;
+      case 'h': opt_histo_buckets = atoi(optarg); break;
+      case 'k': opt_skew_table = strdup(optarg); break;
+      case 'l': opt_loops = atoi(optarg); break;
+      case 'n': opt_num_samples = atoi(optarg); break;
+      case 'o': opt_results_store = strdup(optarg); break;
+      case 'p': opt_pause = atoi(optarg); break;
+      case 't': opt_timebase = atoi(optarg); break;
+      case 'w': opt_warmup_loops = atoi(optarg);
+        if (opt_warmup_loops < 0) usage();  /* Indexes samples by seq. */
+        break;
+      case 'v': opt_verbose = atoi(optarg); break;
+      default: usage();
+    }  /* switch opt */
+  }  /* while getopt */
+}  /* get_options */
+
+
+/* Block (or spin) until wake_seq is no longer "last_seq".
+ */
+void peer_wait(int last_seq)
+{
+  uint32_t ticks_hi, ticks_lo;
+  uint64_t spin_until;
+  uint64_t eventfd_val;
+  struct epoll_event event;
+
+  switch (wake_strategy) {
+    case WAKE_SPIN:
+      while (wake_seq == last_seq) {
+      }
+      break;
+    case WAKE_SPINYIELD:
+      RDTSC(ticks_hi, ticks_lo);
+      spin_until = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo
+                   + (opt_Yield_spin_ns * jtr_ticks_per_sec) / NANOS_PER_SEC;
+      while (wake_seq == last_seq) {
+        RDTSC(ticks_hi, ticks_lo);
+        if (((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo > spin_until) {
+          sched_yield();
+        }
+      }
+      break;
+    case WAKE_FUTEX:
+      while (wake_seq == last_seq) {
+        syscall(SYS_futex, (int *)&wake_seq, FUTEX_WAIT_PRIVATE, last_seq,
+                NULL, NULL, 0);
+      }
+      break;
+    case WAKE_CONDVAR:
+      SYSE(pthread_mutex_lock(&wake_mutex));
+      while (wake_seq == last_seq) {
+        SYSE(pthread_cond_wait(&wake_cond, &wake_mutex));
+      }
+      SYSE(pthread_mutex_unlock(&wake_mutex));
+      break;
+    case WAKE_EVENTFD:
+      while (wake_seq == last_seq) {
+        if (epoll_wait(wake_epfd, &event, 1, -1) == 1) {
+          SYSE(read(wake_efd, &eventfd_val, sizeof(eventfd_val))
+               != sizeof(eventfd_val));
+        }
+      }
+      break;
+  }  /* switch wake_strategy */
+}  /* peer_wait */
+
+
+/* Measuring thread: make wake_seq "seq" and wake the peer.
+ */
+void wake_signal(int seq)
+{
+  uint64_t eventfd_val = 1;
+
+  switch (wake_strategy) {
+    case WAKE_SPIN:
+    case WAKE_SPINYIELD:
+      wake_seq = seq;
+      break;
+    case WAKE_FUTEX:
+      __atomic_store_n(&wake_seq, seq, __ATOMIC_RELEASE);
+      syscall(SYS_futex, (int *)&wake_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+      break;
+    case WAKE_CONDVAR:
+      SYSE(pthread_mutex_lock(&wake_mutex));
+      wake_seq = seq;
+      SYSE(pthread_cond_signal(&wake_cond));
+      SYSE(pthread_mutex_unlock(&wake_mutex));
+      break;
+    case WAKE_EVENTFD:
+      __atomic_store_n(&wake_seq, seq, __ATOMIC_RELEASE);
+      SYSE(write(wake_efd, &eventfd_val, sizeof(eventfd_val))
+           != sizeof(eventfd_val));
+      break;
+  }  /* switch wake_strategy */
+}  /* wake_signal */
+
+
+/* Woken thread: stamp each wake-up and acknowledge it.
+ */
+void *peer_thread(void *arg)
+{
+  uint32_t ticks_hi, ticks_lo;
+  int last_seq = 0;
+
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+
+  while (1) {
+    peer_wait(last_seq);
+    RDTSC(ticks_hi, ticks_lo);
+    last_seq = wake_seq;
+    if (last_seq < 0) {
+      break;
+    }
+    wake_ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+    __atomic_store_n(&ack_seq, last_seq, __ATOMIC_RELEASE);
+  }
+
+  return NULL;
+}  /* peer_thread */
+
+
+/* Timed callback: one wake-up. The measuring thread spins for the
+ * acknowledgement, so that samples do not overlap.
+ */
+void wake_cb(void *clientd)
+{
+  uint32_t ticks_hi, ticks_lo;
+  uint64_t start_ticks;
+  long long diff_ns;
+  int idx;
+
+  wake_sample ++;
+  RDTSC(ticks_hi, ticks_lo);
+  start_ticks = ((uint64_t)ticks_hi << 32) + (uint64_t)ticks_lo;
+  wake_signal(wake_sample);
+  while (__atomic_load_n(&ack_seq, __ATOMIC_ACQUIRE) != wake_sample) {
+  }
+
+  idx = wake_sample - 1 - opt_warmup_loops;
+  if (idx >= 0) {
+    diff_ns = (((long long)wake_ticks - (long long)start_ticks
+                - jtr_tscskew_ticks(opt_cpu_num, peer_cpu_num,
+                                    (long long)wake_ticks)) * NANOS_PER_SEC)
+              / jtr_ticks_per_sec;
+    diff_ns -= jtr_rdtsc_cost;  /* Correct for measurement cost. */
+    wake_ns[idx] = (int)diff_ns;
+  }
+}  /* wake_cb */
+
+
+/* CPU time used so far by the peer thread, in nanoseconds. */
+long long peer_cpu_ns(void)
+{
+  clockid_t clock_id;
+  struct timespec ts;
+
+  SYSE(pthread_getcpuclockid(peer_thread_id, &clock_id));
+  SYSE(clock_gettime(clock_id, &ts));
+  return (long long)ts.tv_sec * NANOS_PER_SEC + ts.tv_nsec;
+}  /* peer_cpu_ns */
+
+
+int main(int argc, char **argv)
+{
+  char title[1024];
+  char label[256];
+  struct timespec wall_start, wall_end;
+  long long cpu_start_ns, cpu_ns, wall_ns;
+  double peer_cpu_perc;
+  struct epoll_event event;
+  int i, l, s;
+
+  /* Parse command-line options. */
+  get_options(argc, argv);
+
+  jtr_y_high = opt_num_samples;
+  jtr_store_init(opt_results_store, opt_cpu_num);
+
+  for (s = 0; s < WAKE_NUM; s++) {
+    if (jtr_name_in_list(opt_Strategies, wake_names[s])) {
+      break;
+    }
+  }
+  if (s == WAKE_NUM) {
+    fprintf(stderr, "No known strategy in '%s'\n", opt_Strategies);
+    usage();
+  }
+
+  wake_ns = (int *)malloc(opt_num_samples * sizeof(int));
+  SYSE(wake_ns == NULL);
+
+  /* Empty out the results buffer (and page it in). */
+  for (i = 0; i < sizeof(jtr_results_buf); i++) {
+    jtr_results_buf[i] = 0;
+  }
+  for (i = 0; i < sizeof(jtr_gnuplot_buf); i++) {
+    jtr_gnuplot_buf[i] = '\0';
+  }
+  for (i = 0; i < opt_num_samples; i++) {
+    wake_ns[i] = 0;
+  }
+
+  wake_efd = eventfd(0, 0);
+  SYSE(wake_efd < 0);
+  wake_epfd = epoll_create1(0);
+  SYSE(wake_epfd < 0);
+  memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  SYSE(epoll_ctl(wake_epfd, EPOLL_CTL_ADD, wake_efd, &event));
+
+  if (opt_cpu_num >= 0) {
+    jtr_pin_cpu(opt_cpu_num);
+    peer_cpu_num = jtr_cpu_related(opt_cpu_num, opt_Peer_placement);
+  }
+
+  if (opt_fifo_priority >= 0) {
+    jtr_set_fifo_priority(opt_fifo_priority);
+  }
+
+  if (opt_timebase == 3 && ! jtr_cycles_init()) {
+    opt_timebase = 1;  /* No usable cycle counter. */
+  }
+
+  for (i = 0; i < 20; i++) {
+    jtr_calibrate();
+  }
+
+  if (opt_skew_table != NULL) {
+    if (jtr_tscskew_load(opt_skew_table) == 0
+        || ! jtr_tscskew_known(opt_cpu_num)
+        || ! jtr_tscskew_known(peer_cpu_num)) {
+      fprintf(stderr, "Skew table '%s' can't correct cpu %d to %d;"
+              " both must be pinned and in jtr_tscskew's -C list\n",
+              opt_skew_table, opt_cpu_num, peer_cpu_num);
+      exit(1);
+    }
+  }
+
+  jtr_preflight_print(opt_cpu_num);
+
+  /* Conduct the timing tests! */
+
+  for (wake_strategy = 0; wake_strategy < WAKE_NUM; wake_strategy++) {
+    if (! jtr_name_in_list(opt_Strategies, wake_names[wake_strategy])) {
+      continue;
+    }
+    for (l = 0; l < opt_loops; l++) {
+      wake_seq = 0;
+      ack_seq = 0;
+      wake_sample = 0;
+      SYSE(pthread_create(&peer_thread_id, NULL, peer_thread, NULL));
+      if (peer_cpu_num >= 0) {
+        jtr_pin_thread(peer_thread_id, peer_cpu_num);
+      }
+
+      jtr_histo_init(opt_histo_buckets);
+      cpu_start_ns = peer_cpu_ns();
+      SYSE(clock_gettime(CLOCK_MONOTONIC, &wall_start));
+      jtr_measure_calls(opt_warmup_loops, opt_num_samples, opt_pause,
+                        opt_timebase, wake_cb, NULL);
+      cpu_ns = peer_cpu_ns() - cpu_start_ns;
+      SYSE(clock_gettime(CLOCK_MONOTONIC, &wall_end));
+      wall_ns = (long long)(wall_end.tv_sec - wall_start.tv_sec) * NANOS_PER_SEC
+                + (wall_end.tv_nsec - wall_start.tv_nsec);
+      peer_cpu_perc = (wall_ns > 0) ? (100.0 * cpu_ns) / wall_ns : 0.0;
+
+      wake_signal(-1);
+      SYSE(pthread_join(peer_thread_id, NULL));
+
+      /* The histogram is of the wake-up times, not of the timed calls. */
+      jtr_histo_init(opt_histo_buckets);
+      for (s = 0; s < opt_num_samples; s++) {
+        if (unlikely(wake_ns[s] < 0)) {
+          jtr_neg_diffs ++;
+          wake_ns[s] = 0;
+        }
+        jtr_histo_accum(wake_ns[s]);
+      }
+
+      snprintf(title, sizeof(title),
+              "%s (%s): peer_cpu_num=%d, peer_cpu_perc=%.1f,"
+              " Yield_spin_ns=%d, skew_table=%s,"
+              " cpu_num=%d, fifo_priority=%d, histo_buckets=%d,"
+              " num_samples=%d,\n"
+              " pause=%d timebase=%d, warmup_loops=%d, gettime_cost=%lld,\n"
+              " rdtsc_cost=%lld, ticks_per_sec=%lld,"
+              " jtr_1000_loops_cost=%lld",
+              opt_descr, wake_names[wake_strategy], peer_cpu_num,
+              peer_cpu_perc, opt_Yield_spin_ns,
+              (opt_skew_table == NULL) ? "none" : opt_skew_table,
+              opt_cpu_num, opt_fifo_priority, opt_histo_buckets,
+              opt_num_samples,
+              opt_pause, opt_timebase, opt_warmup_loops, jtr_gettime_cost,
+              jtr_rdtsc_cost, jtr_ticks_per_sec, jtr_1000_loops_cost);
+      SYSE(title[sizeof(title)-2] != '\0'); /* Don't fill. */
+      snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+               sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+               "%s\n", title);
+      SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+      jtr_histo_print_all(opt_verbose, title);
+
+      snprintf(label, sizeof(label), "%-9s peer_cpu=%5.1f%%",
+               wake_names[wake_strategy], peer_cpu_perc);
+      jtr_histo_brief(wake_summary_buf, sizeof(wake_summary_buf), label);
+    }  /* for l */
+  }  /* for wake_strategy */
+
+  snprintf(&jtr_results_buf[strlen(jtr_results_buf)],
+           sizeof(jtr_results_buf) - strlen(jtr_results_buf),
+           "Wake strategy summary (ns, peer_cpu=%% of one CPU used by the"
+           " woken thread):\n%s", wake_summary_buf);
+  SYSE(jtr_results_buf[sizeof(jtr_results_buf)-2] != '\0'); /* Don't fill. */
+
+  if (opt_verbose >= 0) {
+    printf("%s", jtr_results_buf);
+
+    if (opt_gnuplot_file != NULL) {
+      FILE *gnuplot_fp = fopen(opt_gnuplot_file, "w");
+      SYSE(gnuplot_fp == NULL);
+
+      fprintf(gnuplot_fp, "%s", jtr_gnuplot_buf);
+      fclose(gnuplot_fp);
+    }
+  }
+
+  return 0;
+}  /* main */
@@ -0,0 +1,6 @@
+#!/bin/sh
+# tst_alloc.sh
+
+. ./lbm.sh
+
+./jtr_alloc -d "tst_alloc.sh" -c 5 -C l3,socket $* >tst_alloc.txt
@@ -0,0 +1,6 @@
+#!/bin/sh
+# tst_detour.sh
+
+. ./lbm.sh
+
+./jtr_detour -d "tst_detour.sh" -C 1-3 -D 10 -g tst_detour.gp $* >tst_detour.txt
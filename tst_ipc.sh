@@ -0,0 +1,7 @@
+#!/bin/sh
+# tst_ipc.sh
+
+. ./lbm.sh
+
+# -h 2000 expands histogram.
+./jtr_ipc -d "tst_ipc.sh" -h 2000 -g tst_ipc.gp $* >tst_ipc.txt
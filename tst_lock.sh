@@ -0,0 +1,8 @@
+#!/bin/sh
+# tst_lock.sh
+
+. ./lbm.sh
+
+# Each sending thread needs its own CPU: -T 4 uses CPUs 5 to 8.
+
+./jtr_lock -d "tst_lock.sh" -c 5 -T 4 $* >tst_lock.txt
@@ -0,0 +1,11 @@
+#!/bin/sh
+# tst_noise.sh
+
+. ./lbm.sh
+
+# Repeat the null test under each interference profile. The noise threads
+# run on cores 7, 9, and 11 (and the SMT sibling of core 5); change them to
+# fit your host's topology.
+./jtr_null -d "tst_noise.sh" -h 200 -l 1 \
+  -N "none/membw:7/l3:9/syscall:11/smt/membw:7,l3:9,syscall:11,smt" \
+  -g tst_noise.gp $* >tst_noise.txt
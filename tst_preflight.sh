@@ -0,0 +1,6 @@
+#!/bin/sh
+# tst_preflight.sh
+
+. ./lbm.sh
+
+./jtr_preflight -d "tst_preflight.sh" -C 1-3,5,7 $* >tst_preflight.txt
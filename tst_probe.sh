@@ -0,0 +1,6 @@
+#!/bin/sh
+# tst_probe.sh
+
+. ./lbm.sh
+
+./jtr_probe -d "tst_probe.sh" -h 200 -g tst_probe.gp $* >tst_probe.txt
@@ -0,0 +1,7 @@
+#!/bin/sh
+# tst_rcv.sh
+
+. ./lbm.sh
+
+# -h 2000 expands histogram; receive latencies are microseconds, not ns.
+./jtr_rcv -d "tst_rcv.sh" -h 2000 -g tst_rcv.gp $* >tst_rcv.txt
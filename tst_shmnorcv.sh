@@ -0,0 +1,6 @@
+#!/bin/sh
+# tst_shmnorcv.sh
+
+. ./lbm.sh
+
+./jtr_shm -d "tst_shmnorcv.sh" -R 0 -W 64k -h 200 -g tst_shmnorcv.gp $* >tst_shmnorcv.txt
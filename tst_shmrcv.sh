@@ -0,0 +1,7 @@
+#!/bin/sh
+# tst_shmrcv.sh
+
+. ./lbm.sh
+
+# -h 1000 expands histogram for the one-way times.
+./jtr_shm -d "tst_shmrcv.sh" -R 1 -W 64k -h 1000 -g tst_shmrcv.gp $* >tst_shmrcv.txt
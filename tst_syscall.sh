@@ -0,0 +1,6 @@
+#!/bin/sh
+# tst_syscall.sh
+
+. ./lbm.sh
+
+./jtr_syscall -d "tst_syscall.sh" -c 5 -o jtr_results $* >tst_syscall.txt
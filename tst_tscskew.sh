@@ -0,0 +1,6 @@
+#!/bin/sh
+# tst_tscskew.sh
+
+. ./lbm.sh
+
+./jtr_tscskew -d "tst_tscskew.sh" -C 1-3 -D 60 $* >tst_tscskew.txt
@@ -0,0 +1,6 @@
+#!/bin/sh
+# tst_wake.sh
+
+. ./lbm.sh
+
+./jtr_wake -d "tst_wake.sh" -c 5 -C l3,socket $* >tst_wake.txt
@@ -0,0 +1,24 @@
+#!/bin/sh
+# tst_xdp.sh
+
+. ./lbm.sh
+
+# AF_XDP send over a veth pair in generic (skb/copy) mode, so it can run on
+# any Linux host without a special NIC. Requires root to create the veth pair
+# and to open the AF_XDP socket. The veth pair is private to this host, so
+# the multicast group below never reaches the real network.
+if ip link show jtrveth0 >/dev/null 2>&1; then :
+else :
+  ip link add jtrveth0 type veth peer name jtrveth1
+  ip link set jtrveth0 up
+  ip link set jtrveth1 up
+  ip addr add 10.199.0.1/24 dev jtrveth0
+fi
+
+D=12000
+G=239.255.99.1
+I=10.199.0.1
+T=1
+
+# -h 1500 expands histogram.
+./jtr_sock -d "tst_xdp.sh" -D $D -G $G -I $I -T $T -X jtrveth0 -h 1500 -g tst_xdp.gp $* >tst_xdp.txt